@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/BigInt.h"
+
+/*
+ * Measure where each multiplication and division algorithm starts to beat
+ * the one below it on this machine, and print thresholds to pass to
+ * BigInt::setThresholds.
+ *
+ * For every candidate size n, the product of two n-limb operands (or the
+ * quotient of a 2n-limb dividend by an n-limb divisor) is timed twice:
+ * once with the algorithm under test allowed only at the top level (its
+ * threshold set to n), and once with it disabled (threshold n + 1). The
+ * crossover is the first size at which the algorithm wins twice in a row.
+ *
+ * The limb kernels, which the crossovers depend on, are compared first.
+ * Set BIGINT_KERNELS to one of the names listed to tune for that set.
+ * Last, large products are timed with 1, 2, 4 and so on up to the number
+ * of hardware threads, to show how multiplication scales.
+*/
+
+namespace
+{
+    // log10(2^64), the number of decimal digits held by one limb
+    const double DIGITS_PER_LIMB = 19.265919722494796;
+
+    std::mt19937_64 generator(2017);
+
+    BigInt randomBigInt(std::size_t limbs)
+    {
+        // Starting with a 1 keeps the value within exactly \a limbs limbs
+        std::size_t digits =
+            static_cast<std::size_t>(limbs * DIGITS_PER_LIMB);
+        std::string representation(1, '1');
+        for (std::size_t i = 1; i < digits; i++)
+            representation.push_back('0' + generator() % 10);
+
+        return BigInt(representation);
+    }
+
+    BigInt multiply(const BigInt& a, const BigInt& b)
+    {
+        return a * b;
+    }
+
+    BigInt divide(const BigInt& a, const BigInt& b)
+    {
+        return a / b;
+    }
+
+    typedef BigInt (*Operation)(const BigInt&, const BigInt&);
+
+    /*
+     * Return the average time in microseconds of one application of
+     * \a operation to a and b under the given thresholds.
+    */
+
+    double timeOperation(Operation operation, const BigInt& a,
+            const BigInt& b, const BigInt::Thresholds& thresholds)
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        BigInt::setThresholds(thresholds);
+
+        int iterations = 0;
+        Clock::time_point start = Clock::now();
+        Clock::duration elapsed;
+        do
+        {
+            BigInt result = operation(a, b);
+            iterations++;
+            elapsed = Clock::now() - start;
+        } while (elapsed < std::chrono::milliseconds(50));
+
+        return std::chrono::duration<double, std::micro>(elapsed).count()
+            / iterations;
+    }
+
+    /*
+     * Find the crossover for the threshold selected by \a field, starting
+     * from \a base for all the others. Division is timed when \a operation
+     * is divide, and multiplication otherwise.
+    */
+
+    std::size_t findCrossover(const char* name, BigInt::Thresholds base,
+            std::size_t BigInt::Thresholds::* field,
+            const std::vector<std::size_t>& sizes,
+            Operation operation = multiply)
+    {
+        std::cout << name << std::endl;
+        std::cout << std::setw(8) << "limbs" << std::setw(14) << "without"
+            << std::setw(14) << "with" << std::endl;
+
+        std::size_t candidate = 0;
+        int wins = 0;
+
+        for (std::size_t size : sizes)
+        {
+            BigInt a = randomBigInt(operation == divide ? 2 * size : size);
+            BigInt b = randomBigInt(size);
+
+            BigInt::Thresholds without = base;
+            without.*field = size + 1;
+            BigInt::Thresholds with = base;
+            with.*field = size;
+
+            double withoutTime = timeOperation(operation, a, b, without);
+            double withTime = timeOperation(operation, a, b, with);
+
+            std::cout << std::setw(8) << size << std::fixed
+                << std::setprecision(2) << std::setw(14) << withoutTime
+                << std::setw(14) << withTime << std::endl;
+
+            if (withTime < withoutTime)
+            {
+                if (wins == 0)
+                    candidate = size;
+                if (++wins == 2)
+                    break;
+            }
+            else
+                wins = 0;
+        }
+
+        if (wins < 2)
+            candidate = sizes.back();
+
+        std::cout << "  -> " << candidate << " limbs" << std::endl
+            << std::endl;
+        return candidate;
+    }
+
+    /*
+     * Time a schoolbook product and quotient with each set of limb
+     * kernels the CPU supports, then go back to the one in use.
+    */
+
+    void compareKernels()
+    {
+        const std::size_t NEVER = static_cast<std::size_t>(-1);
+        BigInt::Thresholds schoolbook = {NEVER, NEVER, NEVER, NEVER, NEVER};
+        BigInt a = randomBigInt(64);
+        BigInt b = randomBigInt(32);
+        std::string current = BigInt::getKernels();
+
+        std::cout << "Limb kernels, 64 x 32 limbs" << std::endl;
+        std::cout << std::setw(12) << "kernels" << std::setw(14) << "multiply"
+            << std::setw(14) << "divide" << std::endl;
+        for (const std::string& name : BigInt::getAvailableKernels())
+        {
+            BigInt::setKernels(name);
+            double multiplyTime = timeOperation(multiply, a, b, schoolbook);
+            double divideTime = timeOperation(divide, a, b, schoolbook);
+            std::cout << std::setw(12) << name << std::fixed
+                << std::setprecision(2) << std::setw(14) << multiplyTime
+                << std::setw(14) << divideTime << std::endl;
+        }
+
+        BigInt::setKernels(current);
+        std::cout << "  -> using " << current << std::endl << std::endl;
+    }
+
+    /*
+     * Time products of two equal operands of a few large sizes with every
+     * power-of-two thread count up to the hardware's, and the hardware's
+     * own count, splitting every product that reaches the NTT.
+    */
+
+    void scaleThreads(const BigInt::Thresholds& thresholds)
+    {
+        BigInt::Parallelism initial = BigInt::getParallelism();
+        std::size_t hardware = std::max(1u,
+                std::thread::hardware_concurrency());
+        std::vector<std::size_t> counts;
+        for (std::size_t threads = 1; threads < hardware; threads *= 2)
+            counts.push_back(threads);
+        counts.push_back(hardware);
+
+        std::cout << "Multiplication by thread count, in milliseconds"
+            << std::endl << std::setw(8) << "limbs";
+        for (std::size_t threads : counts)
+            std::cout << std::setw(10) << threads;
+        std::cout << std::endl;
+
+        for (std::size_t limbs : {8192, 32768, 131072})
+        {
+            BigInt a = randomBigInt(limbs);
+            BigInt b = randomBigInt(limbs);
+
+            std::cout << std::setw(8) << limbs;
+            for (std::size_t threads : counts)
+            {
+                BigInt::setParallelism({threads, thresholds.ntt});
+                double time = timeOperation(multiply, a, b, thresholds);
+                std::cout << std::fixed << std::setprecision(2)
+                    << std::setw(10) << time / 1000 << std::flush;
+            }
+            std::cout << std::endl;
+        }
+
+        BigInt::setParallelism(initial);
+        std::cout << std::endl;
+    }
+
+    std::vector<std::size_t> geometricSizes(std::size_t from, std::size_t to)
+    {
+        std::vector<std::size_t> sizes;
+        for (std::size_t size = from; size <= to; size += size / 8 + 1)
+            sizes.push_back(size);
+        return sizes;
+    }
+}
+
+int main()
+{
+    const std::size_t NEVER = static_cast<std::size_t>(-1);
+    BigInt::Thresholds tuned = {NEVER, NEVER, NEVER, NEVER, NEVER};
+
+    compareKernels();
+
+    tuned.karatsuba = findCrossover("Karatsuba over schoolbook", tuned,
+            &BigInt::Thresholds::karatsuba, geometricSizes(4, 256));
+    tuned.toom3 = findCrossover("Toom-3 over Karatsuba", tuned,
+            &BigInt::Thresholds::toom3,
+            geometricSizes(tuned.karatsuba, 2048));
+    tuned.toom4 = findCrossover("Toom-4 over Toom-3", tuned,
+            &BigInt::Thresholds::toom4, geometricSizes(tuned.toom3, 4096));
+    tuned.ntt = findCrossover("NTT over Toom", tuned,
+            &BigInt::Thresholds::ntt, geometricSizes(tuned.karatsuba, 16384));
+    tuned.burnikelZiegler = findCrossover("Burnikel-Ziegler over schoolbook",
+            tuned, &BigInt::Thresholds::burnikelZiegler,
+            geometricSizes(4, 2048), divide);
+
+    std::cout << "Suggested thresholds: {" << tuned.karatsuba << ", "
+        << tuned.toom3 << ", " << tuned.toom4 << ", " << tuned.ntt << ", "
+        << tuned.burnikelZiegler << "}" << std::endl << std::endl;
+
+    scaleThreads(tuned);
+
+    return 0;
+}
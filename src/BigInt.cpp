@@ -1,65 +1,243 @@
-#include <cmath>
+#include <algorithm>
+#include <climits>
+#include <memory>
+#include <ostream>
+#include <thread>
 
 #include "BigInt.h"
+#include "BigIntKernels.h"
 
-/*! 
- * Construct a BigInt instance from a std::string \a intString.
- *
- * @param intString An integer string. The value of the constructed 
- *  BigInt will be the value of the string.
-*/
+using namespace BigIntKernels;
 
-BigInt::BigInt(std::string intString)
+BigInt::Thresholds BigInt::thresholds = {32, 400, 700, 1024, 150};
+BigInt::Parallelism BigInt::parallelism = {1, 4096};
+
+namespace
 {
-    bool hitFirstNonZeroDigit = false;
+    /*
+     * Write the decimal digits of \a magnitude, preceded by a minus sign
+     * if \a negative is set, into \a out, which has room for
+     * decimalDigitsBound + 1 characters. Return the number of characters
+     * written.
+    */
+
+    std::size_t writeDecimal(char* out, const LimbStorage& magnitude,
+            bool negative)
+    {
+        std::size_t width = decimalDigitsBound(magnitude.data(),
+                magnitude.size());
+        char* digits = out + (negative ? 1 : 0);
+        limbsToDecimal(digits, width, magnitude.data(), magnitude.size());
+
+        // The bound may be one digit too many
+        std::size_t leadingZeros = 0;
+        while (leadingZeros + 1 < width && digits[leadingZeros] == '0')
+            leadingZeros++;
+        if (leadingZeros != 0)
+            std::copy(digits + leadingZeros, digits + width, digits);
+
+        if (negative)
+            out[0] = '-';
+        return width - leadingZeros + (negative ? 1 : 0);
+    }
 
-    std::string firstChar = intString.substr(0, 1);
-    if (firstChar.compare("-") == 0)
+    void squareMagnitude(LimbVector& magnitude)
     {
-        nonNegative = false;
-        intString.erase(0, 1);
+        LimbVector square(2 * magnitude.size());
+        squareLimbs(square.data(), magnitude.data(), magnitude.size());
+        square.resize(normalizedSize(square.data(), square.size()));
+        magnitude.swap(square);
     }
-    else
-        nonNegative = true;
 
-    for (unsigned int i = 0; i < intString.length(); i++)
+    void multiplyMagnitude(LimbVector& magnitude,
+            const LimbVector& factor)
+    {
+        LimbVector product(magnitude.size() + factor.size());
+        if (magnitude.size() >= factor.size())
+            multiplyLimbs(product.data(), magnitude.data(), magnitude.size(),
+                    factor.data(), factor.size());
+        else
+            multiplyLimbs(product.data(), factor.data(), factor.size(),
+                    magnitude.data(), magnitude.size());
+        product.resize(normalizedSize(product.data(), product.size()));
+        magnitude.swap(product);
+    }
+
+    /*
+     * Multiply \a magnitude by 2^\a bits in place.
+    */
+
+    void shiftMagnitudeLeft(LimbVector& magnitude, std::size_t bits)
     {
-        std::string c = intString.substr(i,1);
-        if (isdigit(c[0]))
+        unsigned int bitShift = bits % 64;
+        if (bitShift != 0)
         {
-            int nextDigit = std::stoi(c);
-            if (hitFirstNonZeroDigit || nextDigit > 0)
+            Limb top = shiftLeftLimbs(magnitude.data(), magnitude.data(),
+                    magnitude.size(), bitShift);
+            if (top != 0)
+                magnitude.push_back(top);
+        }
+
+        magnitude.insert(magnitude.begin(), bits / 64, 0);
+    }
+
+    /*
+     * Raise the nonzero magnitude \a base to the positive \a exponent by
+     * left-to-right sliding-window exponentiation: runs of up to
+     * windowBits exponent bits ending in a one are handled with a single
+     * multiplication by a precomputed odd power of the base.
+    */
+
+    LimbVector powerMagnitude(const LimbVector& base,
+            std::uint64_t exponent)
+    {
+        int bits = 64 - __builtin_clzll(exponent);
+        int windowBits = bits <= 8 ? 1 : bits <= 24 ? 2 : bits <= 48 ? 3 : 4;
+
+        // oddPowers[i] holds base^(2i + 1)
+        std::vector<LimbVector> oddPowers(1, base);
+        if (windowBits > 1)
+        {
+            LimbVector baseSquare = base;
+            squareMagnitude(baseSquare);
+            for (int i = 1; i < (1 << (windowBits - 1)); i++)
             {
-                intVector.push_back(nextDigit);
-                if (!hitFirstNonZeroDigit)
-                    hitFirstNonZeroDigit = true;
+                oddPowers.push_back(oddPowers.back());
+                multiplyMagnitude(oddPowers.back(), baseSquare);
             }
         }
-        else
-            throw("Non-integer string given to constructor. Giving up.");
-    } 
 
-    if (intVector.size() == 0)
-        intVector = {0};
+        LimbVector result;
+        for (int bit = bits - 1; bit >= 0;)
+        {
+            if (((exponent >> bit) & 1) == 0)
+            {
+                squareMagnitude(result);
+                bit--;
+                continue;
+            }
+
+            int low = std::max(bit - windowBits + 1, 0);
+            while (((exponent >> low) & 1) == 0)
+                low++;
+            int width = bit - low + 1;
+            std::uint64_t window = (exponent >> low) &
+                ((static_cast<std::uint64_t>(1) << width) - 1);
+
+            // The top bit of the exponent is set, so the first window
+            // starts the result
+            if (result.empty())
+                result = oddPowers[window / 2];
+            else
+            {
+                for (int i = 0; i < width; i++)
+                    squareMagnitude(result);
+                multiplyMagnitude(result, oddPowers[window / 2]);
+            }
+
+            bit = low - 1;
+        }
+
+        return result;
+    }
+
+    /*
+     * Combine values[0..count) in a balanced tree, multiplying them if
+     * \a multiplying is set and adding them otherwise. offsets[i] is the
+     * number of limbs before values[i], so that a subtree knows its size
+     * without walking its leaves. The values are moved from.
+     *
+     * Subtrees only run on other threads under the default memory
+     * resource, since another may not be safe to share between threads.
+    */
+
+    BigInt combineTree(BigInt* values, const std::size_t* offsets,
+            std::size_t count, bool multiplying)
+    {
+        if (count == 1)
+            return std::move(values[0]);
+
+        std::size_t half = count / 2;
+        bool parallel = useParallel(offsets[count] - offsets[0]) &&
+            BigIntMemoryResource::getCurrent() ==
+            BigIntMemoryResource::getDefault();
+        BigInt halves[2];
+        runTasks(2, parallel, [&](std::size_t k)
+        {
+            halves[k] = k == 0 ?
+                combineTree(values, offsets, half, multiplying) :
+                combineTree(values + half, offsets + half, count - half,
+                        multiplying);
+        });
+
+        return multiplying ? std::move(halves[0]) * halves[1] :
+            std::move(halves[0]) + halves[1];
+    }
 }
 
 /*!
- * Construct a BigInt from an integer \a intToInt.
+ * Construct a BigInt instance from a std::string \a intString.
  *
- * This BigInt will have the same value as \a intToInt.
+ * @param intString An integer string. The value of the constructed
+ *  BigInt will be the value of the string.
 */
 
-BigInt::BigInt(int intToInt)
+BigInt::BigInt(std::string intString)
 {
-    intVector = BigInt(std::to_string(intToInt)).intVector;
-    if (intToInt < 0)
+    std::size_t start = 0;
+    nonNegative = true;
+    if (!intString.empty() && intString[0] == '-')
+    {
         nonNegative = false;
-    else
-        nonNegative = true;
+        start = 1;
+    }
+
+    for (std::size_t i = start; i < intString.length(); i++)
+    {
+        if (!isdigit(intString[i]))
+            throw("Non-integer string given to constructor. Giving up.");
+    }
 
+    limbs = decimalToLimbs(intString.data() + start,
+            intString.length() - start);
     normalize();
 }
 
+/*
+ * Construct a BigInt from the magnitude and sign of a built-in integer.
+ * This is what the constructor template for built-in integers calls.
+*/
+
+BigInt::BigInt(UInt128 magnitude, bool negative)
+{
+    nonNegative = !negative;
+
+    Limb parts[2] = {static_cast<Limb>(magnitude),
+        static_cast<Limb>(magnitude >> 64)};
+    limbs.assign(parts, parts + normalizedSize(parts, 2));
+
+    normalize();
+}
+
+/*
+ * Return the magnitude of this BigInt as a built-in integer, throwing if
+ * it is greater than \a limit.
+*/
+
+BigInt::UInt128 BigInt::magnitudeAtMost(UInt128 limit) const
+{
+    UInt128 magnitude = 0;
+    if (limbs.size() > 2)
+        throw ("BigInt is out of range for the requested type");
+
+    for (std::size_t i = limbs.size(); i-- > 0;)
+        magnitude = (magnitude << 64) | limbs[i];
+    if (magnitude > limit)
+        throw ("BigInt is out of range for the requested type");
+
+    return magnitude;
+}
+
 /*!
  * Construct a BigInt with no given initial value.
  * In this case, the BigInt is initialized to 0.
@@ -67,203 +245,216 @@ BigInt::BigInt(int intToInt)
 
 BigInt::BigInt()
 {
-    intVector = {0};
     nonNegative = true;
 }
 
-/*! 
- * Return the internal vector representation of the int.
+/*!
+ * Return the decimal digits of the int, most significant first.
  *
- * This should generally not be accessed. It exists for testing only.
+ * This should generally not be accessed. It exists for testing only,
+ * and converts the internal limbs to decimal on every call.
 */
 
 std::vector<int> BigInt::getVector()
 {
-    return intVector;
+    std::vector<int> digits;
+    for (char c : BigInt::abs(*this).operator std::string())
+        digits.push_back(c - '0');
+    return digits;
 }
 
-BigInt BigInt::addTwoNegatives(BigInt bi1, BigInt bi2)
+/*!
+ * Convert the BigInt to its decimal representation.
+*/
+
+BigInt::operator std::string() const
 {
-    bi1.nonNegative = true;
-    bi2.nonNegative = true;
+    std::string representation(decimalDigitsBound(limbs.data(),
+                limbs.size()) + 1, '\0');
+    representation.resize(writeDecimal(&representation[0], limbs,
+                !nonNegative));
 
-    return (bi1 + bi2) * -1;
+    return representation;
 }
 
-BigInt BigInt::addTwoPositives(BigInt bi1, BigInt bi2)
+BigInt BigInt::addTwoNegatives(const BigInt& bi1, const BigInt& bi2)
 {
-    BigInt sum;
-    sum.nonNegative = true;
+    BigInt sum = addTwoPositives(bi1, bi2);
+    sum.nonNegative = false;
 
-    std::vector<int> sumVector;
+    return sum;
+}
 
-    std::vector<int> shortVector;
-    std::vector<int> longVector;
-    if (bi1.intVector.size() > bi2.intVector.size())
-    {
-        shortVector = bi2.intVector;
-        longVector = bi1.intVector;
-    }
-    else
-    {
-        shortVector = bi1.intVector;
-        longVector = bi2.intVector;
-    }
+BigInt BigInt::addTwoPositives(const BigInt& bi1, const BigInt& bi2)
+{
+    BigInt sum;
+    addMagnitudes(sum.limbs, bi1.limbs, bi2.limbs);
 
-    unsigned int longMaxIndex = longVector.size() - 1;
-    unsigned int shortMaxIndex = shortVector.size() - 1;
+    return sum;
+}
 
-    unsigned int i = 0;
+BigInt BigInt::addNegativeToPositive(const BigInt& positive,
+        const BigInt& negative)
+{
+    BigInt result;
 
-    int carry = 0;
+    int comparison = compareMagnitudes(positive, negative);
+    if (comparison == 0)
+        return result;
 
-    while (i <= shortMaxIndex)
-    {
-        int nextTerm = longVector.at(longMaxIndex - i) + 
-                shortVector.at(shortMaxIndex - i) + carry;
+    // Always subtract the smaller magnitude from the larger one
+    if (comparison > 0)
+        subtractMagnitudes(result.limbs, positive.limbs, negative.limbs);
+    else
+        subtractMagnitudes(result.limbs, negative.limbs, positive.limbs);
 
-        if (nextTerm < 10)
-        {
-            sumVector.insert(sumVector.begin(), nextTerm);
-            carry = 0;
-        }
-        else
-        {
-            carry = 1;
-            sumVector.insert(sumVector.begin(), nextTerm - 10);
-        }
-        
-        i++;
-    }
+    result.nonNegative = (comparison > 0);
 
-    while (i <= longMaxIndex)
-    {
-        int nextTerm = longVector.at(longMaxIndex - i) + carry;
-        if (nextTerm < 10)
-        {
-            sumVector.insert(sumVector.begin(), nextTerm);
-            carry = 0;
-        }
-        else
-        {
-            sumVector.insert(sumVector.begin(), nextTerm - 10);
-            carry = 1;
-        }
-        i++;
-    }
+    return result;
+}
 
-    if (carry == 1)
-    {
-        sumVector.insert(sumVector.begin(), 1);
-    }
+/*
+ * Store |a| + |b| in \a result, which may be the same storage as \a a or
+ * \a b. The result is sized once, up front.
+*/
 
-    sum.intVector = sumVector;
-    sum.nonNegative = true;
+void BigInt::addMagnitudes(LimbStorage& result, const LimbStorage& a,
+        const LimbStorage& b)
+{
+    std::size_t aSize = a.size();
+    std::size_t bSize = b.size();
+    std::size_t longSize = aSize >= bSize ? aSize : bSize;
+
+    result.resize(longSize);
+
+    // Resizing may have moved a or b if either is result, so only take
+    // pointers afterwards. The carry limb is only added when there is
+    // one, so that sums which still fit inline stay there.
+    Limb carry;
+    if (aSize >= bSize)
+        carry = addLimbs(result.data(), a.data(), aSize, b.data(), bSize);
+    else
+        carry = addLimbs(result.data(), b.data(), bSize, a.data(), aSize);
 
-    return sum.normalize();
+    if (carry != 0)
+        result.push_back(carry);
 }
 
-BigInt BigInt::addNegativeToPositive(BigInt positive, BigInt negative)
-{
-    BigInt result;
-    std::vector<int> resultVector;
-    int carry = 0;
-    int nextTerm;
-
-    if (BigInt::abs(positive) >= BigInt::abs(negative) || 
-            positive.intVector.size() != negative.intVector.size())
-    {
-        std::vector<int> longVector;
-        std::vector<int> shortVector;
+/*
+ * Store |larger| - |smaller| in \a result, which may be the same storage as
+ * either operand. The magnitude of \a larger must be at least that of
+ * \a smaller.
+*/
 
-        if (positive.intVector.size() >= negative.intVector.size())
-        {
-            longVector = positive.intVector;
-            shortVector = negative.intVector;
-        }
-        else
-        {
-            longVector = negative.intVector;
-            shortVector = positive.intVector;
-        }
+void BigInt::subtractMagnitudes(LimbStorage& result,
+        const LimbStorage& larger, const LimbStorage& smaller)
+{
+    std::size_t largerSize = larger.size();
+    std::size_t smallerSize = smaller.size();
 
-        int longVectorMaxIndex = longVector.size() - 1;
-        int shortVectorMaxIndex = shortVector.size() - 1;
+    result.resize(largerSize);
+    subtractLimbs(result.data(), larger.data(), largerSize,
+            smaller.data(), smallerSize);
 
-        for (int i = shortVectorMaxIndex; i >= 0; i--)
-        {
-            nextTerm = longVector.at(longVectorMaxIndex 
-                    - shortVectorMaxIndex + i) - 
-                shortVector.at(i) + carry;
+    while (!result.empty() && result.back() == 0)
+        result.pop_back();
+}
 
-            if (nextTerm < 0)
-            {
-                carry = -1;
-                nextTerm += 10;
-            }
-            else
-                carry = 0;
+/*
+ * Add \a magnitude to this BigInt in place, with the sign given by
+ * \a magnitudeNonNegative. This is the shared core of +=, -= and the
+ * operators taking a built-in integer.
+*/
 
-            resultVector.insert(resultVector.begin(), nextTerm);
-        }
+void BigInt::addInPlace(const LimbStorage& magnitude,
+        bool magnitudeNonNegative)
+{
+    if (nonNegative == magnitudeNonNegative)
+    {
+        addMagnitudes(limbs, limbs, magnitude);
+        return;
+    }
 
-        for (int i = longVectorMaxIndex - shortVectorMaxIndex - 1; i >= 0; i--)
-        {
-            nextTerm = longVector.at(i) + carry;
-            if (nextTerm < 0)
-            {
-                carry = -1;
-                nextTerm += 10;
-            }
-            else
-            {
-                carry = 0;
-            }
+    int comparison = compareMagnitudes(limbs, magnitude);
+    if (comparison == 0)
+    {
+        limbs.clear();
+        nonNegative = true;
+    }
+    else if (comparison > 0)
+        subtractMagnitudes(limbs, limbs, magnitude);
+    else
+    {
+        subtractMagnitudes(limbs, magnitude, limbs);
+        nonNegative = magnitudeNonNegative;
+    }
+}
 
-            resultVector.insert(resultVector.begin(), nextTerm);
-        }
+/*!
+ * Add \a bi to this BigInt, reusing this BigInt's storage.
+*/
 
-        if (carry != 0)
-            resultVector.insert(resultVector.begin(), 1);
+BigInt& BigInt::operator+=(const BigInt& bi)
+{
+    addInPlace(bi.limbs, bi.nonNegative);
+    return *this;
+}
 
-        result.intVector = resultVector;
-        result.nonNegative = 
-            (BigInt::abs(positive) >= BigInt::abs(negative));
+/*!
+ * Subtract \a bi from this BigInt, reusing this BigInt's storage.
+*/
 
-        return result.normalize();
-    }
+BigInt& BigInt::operator-=(const BigInt& bi)
+{
+    addInPlace(bi.limbs, !bi.nonNegative || bi.limbs.empty());
+    return *this;
+}
 
-    for (int i = positive.intVector.size() - 1; i >= 0; i--)
-    {
-        nextTerm = negative.intVector.at(i) - positive.intVector.at(i) 
-            + carry;
-        if (nextTerm < 0)
-        {
-            carry = -1;
-            nextTerm += 10;
-        }
-        else
-            carry = 0;
+/*!
+ * Compare the magnitudes \a a and \a b.
+ *
+ * Returns a negative number, zero, or a positive number when a is less
+ * than, equal to, or greater than b.
+*/
 
-        resultVector.insert(resultVector.begin(), nextTerm);
-    }
+int BigInt::compareMagnitudes(const LimbStorage& a, const LimbStorage& b)
+{
+    if (a.size() != b.size())
+        return a.size() < b.size() ? -1 : 1;
 
-    result.intVector = resultVector;
-    result.nonNegative = (BigInt::abs(positive) >= BigInt::abs(negative));
+    return compareLimbs(a.data(), b.data(), a.size());
+}
 
-    return result.normalize();
+/*!
+ * Compare the magnitudes of \a bi1 and \a bi2, ignoring their signs.
+*/
 
+int BigInt::compareMagnitudes(const BigInt& bi1, const BigInt& bi2)
+{
+    return compareMagnitudes(bi1.limbs, bi2.limbs);
 }
 
-int getNumberOfDigitsInInt(int i)
+/*!
+ * Compare this BigInt with \a bi.
+ *
+ * Returns -1, 0 or 1 when this BigInt is less than, equal to, or greater
+ * than \a bi. The signs and then the limb counts settle most comparisons,
+ * and the limbs themselves are only read from the top down until they
+ * differ. Nothing is copied or allocated.
+*/
+
+int BigInt::compare(const BigInt& bi) const
 {
-    float logOfInt = log10(i);
-    if (floor(logOfInt) == logOfInt)
-        return logOfInt + 1;
-    return ceil(logOfInt);
+    if (nonNegative != bi.nonNegative)
+        return nonNegative ? 1 : -1;
+
+    // Zero is always stored as non-negative, so both values are nonzero
+    // or both have the same sign
+    int comparison = compareMagnitudes(limbs, bi.limbs);
+    return nonNegative ? comparison : -comparison;
 }
 
-/*! 
+/*!
  * Check that two BigInts are equal.
  *
  * Two BigInts are said to be equal if and only if their digits are the same.
@@ -271,14 +462,20 @@ int getNumberOfDigitsInInt(int i)
 
 bool BigInt::operator==(const BigInt& bi) const
 {
-    // For zero, we don't care about the sign
-    std::vector<int> zeroVector = {0};
-    if (intVector == zeroVector && bi.intVector == zeroVector)
-        return true;
-    return (intVector == bi.intVector && isNonNegative() == bi.nonNegative);
+    // Zero is always stored as non-negative, so the sign can be compared
+    return (limbs == bi.limbs && isNonNegative() == bi.nonNegative);
 }
 
-/*! 
+/*!
+ * Check that two BigInts are not equal.
+*/
+
+bool BigInt::operator!=(const BigInt& bi) const
+{
+    return !(*this == bi);
+}
+
+/*!
  * Decide if one BigInt is less than another.
  *
  * Return true if this BigInt is less than \a bi.
@@ -286,41 +483,10 @@ bool BigInt::operator==(const BigInt& bi) const
 
 bool BigInt::operator< (const BigInt& bi) const
 {
-    if (this->nonNegative && bi.nonNegative)
-    {
-        BigInt comparison = bi;
-        BigInt normalizedComparison = comparison.normalize();
-
-        if (normalizedComparison.intVector.size() < 
-                this->intVector.size())
-            return false;
-        if (normalizedComparison.intVector.size() >
-                this->intVector.size())
-            return true;
-
-        for (unsigned int i = 0; i < this->intVector.size(); i++)
-        {
-            if (this->intVector.at(i) > 
-                    normalizedComparison.intVector.at(i))
-                return false;
-            else if (this->intVector.at(i) < 
-                    normalizedComparison.intVector.at(i))
-                return true;
-        }
-
-        // The two BigInts are equal
-        return false;
-    }
-    else if (!(this->nonNegative) && !bi.nonNegative)
-    {
-        return (BigInt::abs(bi) < BigInt::abs(*this));
-    }
-    else if (this->nonNegative && !bi.nonNegative)
-        return false;
-    return true;
+    return compare(bi) < 0;
 }
 
-/*! 
+/*!
  * Decide if one BigInt is greater than another.
  *
  * Return true if this BigInt is greater than \a bi.
@@ -328,10 +494,10 @@ bool BigInt::operator< (const BigInt& bi) const
 
 bool BigInt::operator> (const BigInt& bi) const
 {
-    return !(*this < bi || *this == bi);
+    return compare(bi) > 0;
 }
 
-/*! 
+/*!
  * Decide if one BigInt is less than or equal to another.
  *
  * Return true if this BigInt is less than or equal to \a bi.
@@ -339,10 +505,10 @@ bool BigInt::operator> (const BigInt& bi) const
 
 bool BigInt::operator<=(const BigInt& bi) const
 {
-    return (*this < bi || *this == bi);
+    return compare(bi) <= 0;
 }
 
-/*! 
+/*!
  * Decide if one BigInt is greater than or equal to another.
  *
  * Return true if this BigInt is greater than or equal to \a bi.
@@ -350,43 +516,179 @@ bool BigInt::operator<=(const BigInt& bi) const
 
 bool BigInt::operator>=(const BigInt& bi) const
 {
-    return ((*this > bi) || *this == bi);
+    return compare(bi) >= 0;
 }
 
-BigInt BigInt::normalize()
+BigInt& BigInt::normalize()
 {
-    while (intVector.at(0) == 0 && intVector.size() > 1)
-        intVector.erase(intVector.begin(), intVector.begin() + 1);
+    while (!limbs.empty() && limbs.back() == 0)
+        limbs.pop_back();
+
+    // There is no negative zero
+    if (limbs.empty())
+        nonNegative = true;
+
     return *this;
 }
 
 /*!
  * Raise one BigInt to the exponent given by \a power.
+ *
+ * Exponents beyond the range of long long are only accepted for bases
+ * of 0, 1 and -1, as no other power that large would fit in memory.
 */
 
-BigInt BigInt::expt(const BigInt &power)
+BigInt BigInt::expt(const BigInt &power) const
 {
-    BigInt exponentInt = *this;
     if (!power.nonNegative)
         throw ("expt only accepts non-negative values");
-    if (power.intVector.at(0) == 0 && power.intVector.size() == 1)
-        return BigInt("1");
+    if (power.limbs.empty())
+        return expt(0);
+    if (power.limbs.size() == 1 && power.limbs[0] <= LLONG_MAX)
+        return expt(static_cast<long long>(power.limbs[0]));
+
+    if (limbs.empty() || (limbs.size() == 1 && limbs[0] == 1))
+        return expt(power.limbs[0] % 2 == 0 ? 2 : 1);
+    throw ("expt result too large");
+}
 
-    BigInt powerCount("1");
-    while (!(powerCount == power))
-    {
-        exponentInt = exponentInt * *this;
-        powerCount = powerCount + BigInt("1");
-    }
-    return exponentInt;
+/*!
+ * Raise one BigInt to the native integer exponent \a power.
+ *
+ * Factors of two in the base are taken out first and applied to the
+ * result as a single shift, so powers of two (and the binary half of
+ * powers of ten) cost no multiplications. The rest is computed by
+ * sliding-window exponentiation, with squarings done by the dedicated
+ * squaring kernel.
+*/
+
+BigInt BigInt::expt(long long power) const
+{
+    if (power < 0)
+        throw ("expt only accepts non-negative values");
+    if (power == 0)
+        return BigInt(1);
+
+    BigInt result;
+    if (limbs.empty())
+        return result;
+
+    std::size_t zeroLimbs = 0;
+    while (limbs[zeroLimbs] == 0)
+        zeroLimbs++;
+    unsigned int zeroBits = __builtin_ctzll(limbs[zeroLimbs]);
+
+    LimbVector odd(limbs.begin() + zeroLimbs, limbs.end());
+    if (zeroBits != 0)
+        shiftRightLimbs(odd.data(), odd.data(), odd.size(), zeroBits);
+    odd.resize(normalizedSize(odd.data(), odd.size()));
+
+    std::uint64_t exponent = static_cast<std::uint64_t>(power);
+    std::uint64_t twos = 64 * static_cast<std::uint64_t>(zeroLimbs) +
+        zeroBits;
+    if (twos != 0 && exponent > SIZE_MAX / 64 / twos)
+        throw ("expt result too large");
+
+    if (odd.size() != 1 || odd[0] != 1)
+        odd = powerMagnitude(odd, exponent);
+    shiftMagnitudeLeft(odd, twos * exponent);
+    result.limbs = std::move(odd);
+
+    result.nonNegative = nonNegative || exponent % 2 == 0;
+    return result;
 }
 
-BigInt BigInt::pow10(int power)
+/*!
+ * Return the thresholds currently used to choose a multiplication or
+ * division algorithm.
+*/
+
+const BigInt::Thresholds& BigInt::getThresholds()
 {
-    for (int j = 0; j < power; j++)
-        this->intVector.push_back(0);
+    return thresholds;
+}
 
-    return *this;
+/*!
+ * Replace the multiplication and division thresholds with
+ * \a newThresholds.
+ *
+ * This is not synchronised with running operations, so it should be
+ * called before any BigInts are multiplied or divided. The Karatsuba and
+ * Burnikel-Ziegler thresholds are raised to at least 4 limbs, below which
+ * their recursions cannot shrink.
+*/
+
+void BigInt::setThresholds(const Thresholds& newThresholds)
+{
+    thresholds = newThresholds;
+    if (thresholds.karatsuba < 4)
+        thresholds.karatsuba = 4;
+    if (thresholds.burnikelZiegler < 4)
+        thresholds.burnikelZiegler = 4;
+}
+
+/*!
+ * Return the name of the limb kernels in use.
+*/
+
+std::string BigInt::getKernels()
+{
+    return BigIntKernels::selectedKernels();
+}
+
+/*!
+ * Switch to the limb kernels called \a name, which must be one of those
+ * getAvailableKernels() returns.
+ *
+ * As with setThresholds, this is not synchronised with running
+ * operations.
+*/
+
+void BigInt::setKernels(const std::string& name)
+{
+    if (!BigIntKernels::selectKernels(name))
+        throw ("Limb kernels are unknown or not supported by this CPU");
+}
+
+/*!
+ * Return the names of every set of limb kernels that this CPU supports,
+ * fastest first. The last is always "portable".
+*/
+
+std::vector<std::string> BigInt::getAvailableKernels()
+{
+    return BigIntKernels::availableKernels();
+}
+
+/*!
+ * Return the thread count and size threshold currently used to split
+ * multiplications across threads.
+*/
+
+const BigInt::Parallelism& BigInt::getParallelism()
+{
+    return parallelism;
+}
+
+/*!
+ * Replace the thread count and threshold with \a newParallelism, starting
+ * or stopping worker threads to match. A thread count of zero is replaced
+ * by the number of hardware threads.
+ *
+ * As with setThresholds, this is not synchronised with running
+ * operations. The large buffers of a split multiplication still come from
+ * the calling thread's scratch space, but handing out the work makes a few
+ * small allocations, so a BigIntWorkspace is only free of allocations
+ * while its products stay below the threshold.
+*/
+
+void BigInt::setParallelism(const Parallelism& newParallelism)
+{
+    parallelism = newParallelism;
+    if (parallelism.threads == 0)
+        parallelism.threads = std::max(1u,
+                std::thread::hardware_concurrency());
+    BigIntKernels::setWorkerThreads(parallelism.threads);
 }
 
 bool BigInt::isNonNegative() const
@@ -394,12 +696,28 @@ bool BigInt::isNonNegative() const
     return nonNegative;
 }
 
-BigInt BigInt::abs(const BigInt bi) 
+BigInt BigInt::abs(BigInt bi)
 {
-    BigInt calculatedAbs = bi;
-    calculatedAbs.nonNegative = true;
+    bi.nonNegative = true;
+    return bi;
+}
+
+/*
+ * The shared part of product() and sum(), which leaves \a values in a
+ * valid but unspecified state.
+*/
+
+BigInt BigInt::reduceTree(std::vector<BigInt>& values, bool multiplying)
+{
+    if (values.empty())
+        return BigInt(multiplying ? 1 : 0);
+
+    std::vector<std::size_t> offsets(values.size() + 1, 0);
+    for (std::size_t i = 0; i < values.size(); i++)
+        offsets[i + 1] = offsets[i] + values[i].limbs.size();
 
-    return calculatedAbs;
+    return combineTree(values.data(), offsets.data(), values.size(),
+            multiplying);
 }
 
 /*!
@@ -410,20 +728,237 @@ BigInt BigInt::abs(const BigInt bi)
 */
 BigInt operator+(const BigInt& b1, const BigInt& b2)
 {
-    BigInt lhs = b1;
-    BigInt rhs = b2;
-    if (!lhs.nonNegative && !rhs.nonNegative)
-        return BigInt::addTwoNegatives(lhs, rhs);
-    if (lhs.nonNegative && rhs.nonNegative)
-        return BigInt::addTwoPositives(lhs, rhs);
-    if (lhs.nonNegative && !rhs.nonNegative)
-        return BigInt::addNegativeToPositive(lhs, rhs);
-    return BigInt::addNegativeToPositive(rhs, lhs);
+    if (!b1.nonNegative && !b2.nonNegative)
+        return BigInt::addTwoNegatives(b1, b2);
+    if (b1.nonNegative && b2.nonNegative)
+        return BigInt::addTwoPositives(b1, b2);
+    if (b1.nonNegative && !b2.nonNegative)
+        return BigInt::addNegativeToPositive(b1, b2);
+    return BigInt::addNegativeToPositive(b2, b1);
+}
+
+/*!
+ * Add two BigInts, reusing the storage of \a b1.
+*/
+
+BigInt operator+(BigInt&& b1, const BigInt& b2)
+{
+    b1 += b2;
+    return std::move(b1);
+}
+
+/*!
+ * Add two BigInts, reusing the storage of \a b2.
+*/
+
+BigInt operator+(const BigInt& b1, BigInt&& b2)
+{
+    b2 += b1;
+    return std::move(b2);
+}
+
+/*!
+ * Add two BigInts, reusing the storage of \a b1.
+*/
+
+BigInt operator+(BigInt&& b1, BigInt&& b2)
+{
+    b1 += b2;
+    return std::move(b1);
+}
+
+/*
+ * Return -bi, leaving zero as it is.
+*/
+
+BigInt BigInt::negate(BigInt bi)
+{
+    if (!bi.limbs.empty())
+        bi.nonNegative = !bi.nonNegative;
+    return bi;
+}
+
+/*
+ * Return bi plus the built-in integer whose magnitude and sign are
+ * \a magnitude and \a negative. Subtraction negates the sign. The copy
+ * of bi has room for a carry, so the single-limb path never reallocates.
+*/
+
+BigInt BigInt::addNative(const BigInt& bi, UInt128 magnitude,
+        bool negative)
+{
+    BigInt result = bi;
+    result.addNativeInPlace(magnitude, negative);
+    return result;
+}
+
+/*
+ * Add the built-in integer whose magnitude and sign are \a magnitude and
+ * \a negative to this BigInt in place. A magnitude that fits in a limb is
+ * added to or subtracted from the low limb, and the carry or borrow only
+ * ripples as far as it reaches. Wider ones go through addInPlace.
+*/
+
+void BigInt::addNativeInPlace(UInt128 magnitude, bool negative)
+{
+    if ((magnitude >> 64) != 0)
+    {
+        addInPlace(BigInt(magnitude, false).limbs, !negative);
+        return;
+    }
+
+    Limb limb = static_cast<Limb>(magnitude);
+    if (limb == 0)
+        return;
+    if (limbs.empty())
+    {
+        limbs.push_back(limb);
+        nonNegative = !negative;
+        return;
+    }
+
+    std::size_t size = limbs.size();
+    if (nonNegative != negative)
+    {
+        // The same signs, so the magnitudes add
+        Limb carry = limb;
+        for (std::size_t i = 0; i < size && carry != 0; i++)
+        {
+            limbs[i] += carry;
+            carry = (limbs[i] < carry);
+        }
+        if (carry != 0)
+            limbs.push_back(carry);
+        return;
+    }
+
+    if (size == 1 && limbs[0] < limb)
+    {
+        // The operand is the larger, so the sign flips
+        limbs[0] = limb - limbs[0];
+        nonNegative = !nonNegative;
+        return;
+    }
+
+    // The magnitude is at least the limb, so the borrow stops in it
+    Limb borrow = limb;
+    for (std::size_t i = 0; borrow != 0; i++)
+    {
+        Limb before = limbs[i];
+        limbs[i] = before - borrow;
+        borrow = (before < borrow);
+    }
+    normalize();
+}
+
+/*
+ * Divide the magnitude of \a dividend by the magnitude of \a divisor,
+ * storing the results in whichever of \a quotient and \a remainder are
+ * not null. Both results are non-negative, and either may be the same
+ * object as one of the operands.
+*/
+
+void BigInt::divideMagnitudes(const BigInt& dividend, const BigInt& divisor,
+        BigInt* quotient, BigInt* remainder)
+{
+    std::size_t dividendSize = dividend.limbs.size();
+    std::size_t divisorSize = divisor.limbs.size();
+
+    if (divisorSize == 1)
+    {
+        divideByNative(dividend, divisor.limbs[0], false, quotient,
+                remainder);
+        if (quotient)
+            quotient->nonNegative = true;
+        if (remainder)
+            remainder->nonNegative = true;
+        return;
+    }
+
+    // Results are written straight into their own storage, even when they
+    // are the dividend, since the division reads the dividend before
+    // writing anything and its results are no longer than it is. A result
+    // that is only the divisor may need more room than the divisor has
+    // while the divisor is still being read, so it is built aside and
+    // swapped in.
+    LimbStorage quotientAside;
+    LimbStorage remainderAside;
+    bool quotientAliased = (quotient == &divisor && quotient != &dividend);
+    bool remainderAliased = (remainder == &divisor &&
+            remainder != &dividend);
+    LimbStorage& quotientLimbs = (quotient && !quotientAliased) ?
+        quotient->limbs : quotientAside;
+    LimbStorage& remainderLimbs = (remainder && !remainderAliased) ?
+        remainder->limbs : remainderAside;
+
+    if (compareMagnitudes(dividend, divisor) < 0)
+    {
+        // The dividend is the remainder, and is already in place if the
+        // remainder is the dividend itself
+        if (remainder && remainder != &dividend)
+            remainderLimbs = dividend.limbs;
+        quotientLimbs.clear();
+    }
+    else
+    {
+        // A result that is the dividend keeps all of its limbs until the
+        // division has read them, and is shrunk afterwards
+        std::size_t quotientSize = dividendSize - divisorSize + 1;
+        if (quotient && quotient != &dividend)
+            quotientLimbs.resize(quotientSize);
+        if (remainder && remainder != &dividend)
+            remainderLimbs.resize(divisorSize);
+        divideLimbs(quotient ? quotientLimbs.data() : nullptr,
+                remainder ? remainderLimbs.data() : nullptr,
+                dividend.limbs.data(), dividendSize, divisor.limbs.data(),
+                divisorSize);
+        if (quotient)
+            quotientLimbs.resize(quotientSize);
+        if (remainder)
+            remainderLimbs.resize(divisorSize);
+    }
+
+    if (quotient)
+    {
+        if (quotientAliased)
+            quotient->limbs.swap(quotientLimbs);
+        quotient->nonNegative = true;
+        quotient->normalize();
+    }
+
+    if (remainder)
+    {
+        if (remainderAliased)
+            remainder->limbs.swap(remainderLimbs);
+        remainder->nonNegative = true;
+        remainder->normalize();
+    }
 }
 
-BigInt operator+(const BigInt& bi, const int& i)
+/*!
+ * Divide \a dividend by \a divisor, returning the quotient and the
+ * remainder together.
+ *
+ * As with operator/ and operator%, the quotient is rounded toward zero and
+ * the remainder takes the sign of the dividend, so that
+ * dividend == quotient * divisor + remainder.
+*/
+
+std::pair<BigInt, BigInt> BigInt::divmod(const BigInt& dividend,
+        const BigInt& divisor)
 {
-    return BigInt(i) + bi;
+    if (divisor.limbs.empty())
+        throw("Attempt to divide by zero");
+
+    std::pair<BigInt, BigInt> result;
+    divideMagnitudes(dividend, divisor, &result.first, &result.second);
+
+    result.first.nonNegative = (dividend.nonNegative == divisor.nonNegative);
+    result.first.normalize();
+    result.second.nonNegative = dividend.nonNegative;
+    result.second.normalize();
+
+    return result;
 }
 
 /* !
@@ -434,208 +969,473 @@ BigInt operator+(const BigInt& bi, const int& i)
 */
 BigInt operator/(const BigInt& b1, const BigInt& b2)
 {
-    BigInt dividend = b1;
-    BigInt divisor = b2;
+    if (b2.limbs.empty())
+        throw("Attempt to divide by zero");
 
-    // Simple base cases
-    if (divisor == 1)
-        return dividend;
+    BigInt quotient;
+    BigInt::divideMagnitudes(b1, b2, &quotient, nullptr);
 
-    if (divisor == -1)
-        return -1 * dividend;
+    quotient.nonNegative = (b1.nonNegative == b2.nonNegative);
+    quotient.normalize();
+    return quotient;
+}
 
-    // In this case, return 0
-    if (BigInt::abs(divisor) > BigInt::abs(dividend))
-        return BigInt();
+/*!
+ * Replace this BigInt with its quotient on division by \a bi, rounded
+ * toward zero, reusing this BigInt's storage.
+*/
 
-    if (divisor == 0)
+BigInt& BigInt::operator/=(const BigInt& bi)
+{
+    if (bi.limbs.empty())
         throw("Attempt to divide by zero");
 
-    BigInt quotientInt;
+    bool quotientNonNegative = (nonNegative == bi.nonNegative);
+    divideMagnitudes(*this, bi, this, nullptr);
+
+    nonNegative = quotientNonNegative;
+    normalize();
+
+    return *this;
+}
+
+/*
+ * Divide \a bi by a built-in integer, storing the quotient and remainder
+ * in whichever of \a quotient and \a remainder are not null. Divisors
+ * that fit in a limb take a single pass of the limb division kernel.
+*/
 
-    divisor = BigInt::abs(divisor);
-    dividend = BigInt::abs(dividend);
+void BigInt::divideByNative(const BigInt& bi, UInt128 magnitude,
+        bool negative, BigInt* quotient, BigInt* remainder)
+{
+    if (magnitude == 0)
+        throw("Attempt to divide by zero");
 
-    // Find the first chunk of digits in the dividend larger than the divisor
-    int counter = 0;
-    BigInt smallInt(dividend.intVector.at(counter));
+    // Either result may be bi itself, so take its sign first
+    bool dividendNonNegative = bi.nonNegative;
 
-    while (smallInt < divisor)
+    if ((magnitude >> 64) != 0)
+        divideMagnitudes(bi, BigInt(magnitude, false), quotient, remainder);
+    else if (quotient)
+    {
+        // The limb kernel divides in place, so the quotient starts as a
+        // copy of the dividend unless it is the dividend
+        if (quotient != &bi)
+            quotient->limbs = bi.limbs;
+        Limb remainderLimb = divideByLimb(quotient->limbs.data(),
+                quotient->limbs.data(), quotient->limbs.size(),
+                static_cast<Limb>(magnitude));
+
+        if (remainder)
+        {
+            remainder->limbs.clear();
+            remainder->limbs.push_back(remainderLimb);
+        }
+    }
+    else if (remainder)
     {
-        counter++;
-        smallInt.intVector.push_back(dividend.intVector.at(counter));
+        Limb remainderLimb = divideByLimb(nullptr, bi.limbs.data(),
+                bi.limbs.size(), static_cast<Limb>(magnitude));
+        remainder->limbs.clear();
+        remainder->limbs.push_back(remainderLimb);
     }
 
-    // Figure out what digit we need to multiply the divisor by 
-    // to get the closest to smallInt
-    int i = 1;
-    for (; i < 10; i++)
+    if (quotient)
     {
-        if ((i + 1) * divisor > smallInt)
-            break;
-
-        else if (i * divisor == smallInt)
-            break;
+        quotient->nonNegative = (dividendNonNegative != negative);
+        quotient->normalize();
+    }
+    if (remainder)
+    {
+        remainder->nonNegative = dividendNonNegative;
+        remainder->normalize();
     }
+}
 
-    quotientInt.intVector.push_back(i);
+/*
+ * Divide a built-in integer by \a bi, storing the quotient and remainder
+ * in whichever of \a quotient and \a remainder are not null. Both fit in
+ * 128 bits, so this is done in built-in arithmetic.
+*/
 
-    // Find out how many powers of ten to multiply by
-    int powersOfTen = dividend.intVector.size() - counter - 1;
-    quotientInt = quotientInt * pow(10, powersOfTen);
+void BigInt::divideNative(UInt128 magnitude, bool negative,
+        const BigInt& bi, BigInt* quotient, BigInt* remainder)
+{
+    if (bi.limbs.empty())
+        throw("Attempt to divide by zero");
 
-    BigInt remainder = dividend - (divisor * quotientInt);
-    quotientInt = quotientInt.normalize() + remainder / divisor;
-    quotientInt.nonNegative = !(b1.nonNegative ^ b2.nonNegative);
-    return quotientInt;
-}
+    UInt128 divisor = 0;
+    if (bi.limbs.size() <= 2)
+        divisor = bi.magnitudeAtMost(~static_cast<UInt128>(0));
 
-BigInt operator/(const BigInt& bi, const int& i)
-{
-    return bi / BigInt(i);
+    // A divisor of more than 128 bits is larger than any built-in integer
+    UInt128 quotientMagnitude = divisor != 0 ? magnitude / divisor : 0;
+    UInt128 remainderMagnitude = divisor != 0 ? magnitude % divisor :
+        magnitude;
+
+    if (quotient)
+        *quotient = BigInt(quotientMagnitude, negative == bi.nonNegative);
+    if (remainder)
+        *remainder = BigInt(remainderMagnitude, negative);
 }
 
-/*! 
- * Implement subtraction between two BigInts.
+/*!
+ * Implement the remainder of division between two BigInts.
  *
- * This constructs a new BigInt whose value is the difference between
- * the self BigInt and the given \a b1.
+ * The result has the sign of \a b1, matching the built-in % operator.
 */
 
-BigInt operator-(const BigInt& b1, const BigInt& b2)
+BigInt operator%(const BigInt& b1, const BigInt& b2)
 {
-    BigInt negative = b2;
-    negative.nonNegative = !negative.nonNegative;
-    return b1 + negative;
+    if (b2.limbs.empty())
+        throw("Attempt to divide by zero");
+
+    BigInt remainder;
+    BigInt::divideMagnitudes(b1, b2, nullptr, &remainder);
+
+    remainder.nonNegative = b1.nonNegative;
+    remainder.normalize();
+    return remainder;
 }
 
 /*!
- * Implement multiplication between BigInts.
- *
- * Returns the product of the integers represented by \a b1 and \a b2.
+ * Replace this BigInt with its remainder on division by \a bi, reusing
+ * this BigInt's storage.
 */
 
-BigInt operator*(const BigInt& b1, const BigInt& b2)
+BigInt& BigInt::operator%=(const BigInt& bi)
 {
-    BigInt productInt;
+    if (bi.limbs.empty())
+        throw("Attempt to divide by zero");
 
-    unsigned int factor1Length = b2.intVector.size();
-    int currentDigitCounter = factor1Length - 1;
+    bool dividendNonNegative = nonNegative;
+    divideMagnitudes(*this, bi, nullptr, this);
 
-    while (currentDigitCounter >= 0)
-    {
-        int currentPowerOf10 = (factor1Length - 1) - currentDigitCounter;
-        int currentDigit = b2.intVector.at(currentDigitCounter);
+    nonNegative = dividendNonNegative;
+    normalize();
 
-        BigInt currentTerm = b1 * currentDigit;
-        currentTerm = currentTerm.pow10(currentPowerOf10);
-        productInt = productInt + currentTerm;
+    return *this;
+}
 
-        currentDigitCounter -= 1;
-    }
+/*!
+ * Shift \a bi left by \a bits, multiplying it by 2^bits.
+*/
 
-    productInt.nonNegative = !(b1.nonNegative ^ b2.nonNegative);
+BigInt operator<<(BigInt bi, std::size_t bits)
+{
+    bi <<= bits;
+    return bi;
+}
+
+/*!
+ * Shift \a bi right by \a bits, dividing it by 2^bits and rounding
+ * toward negative infinity, as for a two's complement integer.
+*/
 
-    return productInt.normalize();
+BigInt operator>>(BigInt bi, std::size_t bits)
+{
+    bi >>= bits;
+    return bi;
 }
 
-BigInt BigInt::multiplyByDigit(const BigInt& bi, int i)
+/*!
+ * Shift this BigInt left by \a bits in place.
+*/
+
+BigInt& BigInt::operator<<=(std::size_t bits)
 {
-    BigInt product;
+    if (limbs.empty() || bits == 0)
+        return *this;
+
+    std::size_t size = limbs.size();
+    std::size_t limbShift = bits / 64;
+    unsigned int bitShift = bits % 64;
 
-    std::vector<int> productIntVector;
-    int indexMax = bi.intVector.size() - 1;
-    
-    for (unsigned int j = 0; j < bi.intVector.size(); j++)
+    // Only add a top limb if bits are shifted into it
+    bool carryLimb = bitShift != 0 &&
+        (limbs[size - 1] >> (64 - bitShift)) != 0;
+    limbs.resize(size + limbShift + (carryLimb ? 1 : 0));
+
+    Limb* data = limbs.data();
+    if (bitShift == 0)
+        std::copy_backward(data, data + size, data + size + limbShift);
+    else
     {
-        productIntVector.insert(productIntVector.begin(), 
-                                    bi.intVector.at(indexMax - j) * i);
+        Limb top = shiftLeftLimbs(data + limbShift, data, size, bitShift);
+        if (carryLimb)
+            data[size + limbShift] = top;
     }
+    std::fill(data, data + limbShift, 0);
 
-    int j = 0;
-    int carry = 0;
+    return *this;
+}
 
-    while (j <= indexMax)
+/*!
+ * Shift this BigInt right by \a bits in place, rounding toward negative
+ * infinity.
+*/
+
+BigInt& BigInt::operator>>=(std::size_t bits)
+{
+    std::size_t size = limbs.size();
+    std::size_t limbShift = bits / 64;
+    unsigned int bitShift = bits % 64;
+
+    // A negative value moves one further from zero if any of the bits
+    // shifted out are set
+    bool roundAway = false;
+    if (!nonNegative)
     {
-        int currentTerm = productIntVector.at(indexMax - j) + carry;
-        if (currentTerm > 10)
-        {
-            carry = floor(currentTerm / 10);
-            productIntVector.at(indexMax - j) = currentTerm - 10 * carry;
-        }
+        for (std::size_t i = 0; i < limbShift && i < size && !roundAway; i++)
+            roundAway = (limbs[i] != 0);
+        if (limbShift < size && bitShift != 0)
+            roundAway = roundAway ||
+                (limbs[limbShift] << (64 - bitShift)) != 0;
+    }
+
+    if (limbShift >= size)
+        limbs.clear();
+    else
+    {
+        Limb* data = limbs.data();
+        if (bitShift == 0)
+            std::copy(data + limbShift, data + size, data);
         else
-        {
-            carry = 0;
-            productIntVector.at(indexMax - j) = currentTerm;
-        }
-        j++;
+            shiftRightLimbs(data, data + limbShift, size - limbShift,
+                    bitShift);
+        limbs.resize(normalizedSize(data, size - limbShift));
     }
 
-    if (carry > 0)
-        productIntVector.insert(productIntVector.begin(), carry);
+    if (roundAway)
+    {
+        const Limb one = 1;
+        if (limbs.empty())
+            limbs.push_back(one);
+        else if (addLimbs(limbs.data(), limbs.data(), limbs.size(), &one,
+                    1) != 0)
+            limbs.push_back(one);
+    }
 
-    product.intVector = productIntVector;
-    return product.normalize();
+    normalize();
+    return *this;
 }
 
-/*!  
- * Implement usual integer multiplication of BigInts.
+/*!
+ * Exchange the values of this BigInt and \a other without copying their
+ * limbs.
+*/
+
+void BigInt::swap(BigInt& other) noexcept
+{
+    limbs.swap(other.limbs);
+    std::swap(nonNegative, other.nonNegative);
+}
+
+/*!
+ * Implement subtraction between two BigInts.
  *
- * Note that \a i is a usual C++ int, not a BigInt.
+ * This constructs a new BigInt whose value is the difference between
+ * the self BigInt and the given \a b1.
 */
 
-BigInt operator*(const BigInt& bi, const int& i)
+BigInt operator-(const BigInt& b1, const BigInt& b2)
+{
+    // b1 - b2 is b1 + (-b2); zero is its own negation
+    bool b2Negated = !b2.nonNegative || b2.limbs.empty();
+
+    if (!b1.nonNegative && !b2Negated)
+        return BigInt::addTwoNegatives(b1, b2);
+    if (b1.nonNegative && b2Negated)
+        return BigInt::addTwoPositives(b1, b2);
+    if (b1.nonNegative && !b2Negated)
+        return BigInt::addNegativeToPositive(b1, b2);
+    return BigInt::addNegativeToPositive(b2, b1);
+}
+
+/*!
+ * Subtract \a b2 from \a b1, reusing the storage of \a b1.
+*/
+
+BigInt operator-(BigInt&& b1, const BigInt& b2)
+{
+    b1 -= b2;
+    return std::move(b1);
+}
+
+/*!
+ * Subtract \a b2 from \a b1, reusing the storage of \a b2.
+*/
+
+BigInt operator-(const BigInt& b1, BigInt&& b2)
+{
+    b2 -= b1;
+    return BigInt::negate(std::move(b2));
+}
+
+/*!
+ * Subtract \a b2 from \a b1, reusing the storage of \a b1.
+*/
+
+BigInt operator-(BigInt&& b1, BigInt&& b2)
+{
+    b1 -= b2;
+    return std::move(b1);
+}
+
+/*!
+ * Implement multiplication between BigInts.
+ *
+ * Returns the product of the integers represented by \a b1 and \a b2.
+*/
+
+BigInt operator*(const BigInt& b1, const BigInt& b2)
 {
     BigInt productInt;
+    BigInt::multiplyMagnitudes(productInt.limbs, b1.limbs, b2.limbs);
+    productInt.nonNegative = !(b1.nonNegative ^ b2.nonNegative);
 
-    int factor = i;
+    productInt.normalize();
 
-    bool multiplyingByNegative;
+    return productInt;
+}
+
+/*
+ * Store |a| * |b| in \a result, reusing its storage. \a result must not
+ * be the same storage as either operand.
+*/
 
-    if (factor < 0)
+void BigInt::multiplyMagnitudes(LimbStorage& result, const LimbStorage& a,
+        const LimbStorage& b)
+{
+    if (a.empty() || b.empty())
     {
-        multiplyingByNegative = true;
-        factor *= -1;
+        result.clear();
+        return;
+    }
+
+    const LimbStorage& longVector = a.size() >= b.size() ? a : b;
+    const LimbStorage& shortVector = a.size() >= b.size() ? b : a;
+
+    std::size_t productSize = longVector.size() + shortVector.size();
+    if (productSize <= 2 * LimbStorage::INLINE_LIMBS)
+    {
+        // Multiply on the stack, since the product of two small values
+        // may still fit inline
+        Limb buffer[2 * LimbStorage::INLINE_LIMBS];
+        multiplyLimbs(buffer, longVector.data(), longVector.size(),
+                shortVector.data(), shortVector.size());
+        result.assign(buffer, buffer + normalizedSize(buffer, productSize));
     }
     else
-        multiplyingByNegative = false;
+    {
+        result.resize(productSize);
+        multiplyLimbs(result.data(), longVector.data(), longVector.size(),
+                shortVector.data(), shortVector.size());
+        result.resize(normalizedSize(result.data(), productSize));
+    }
+}
 
-    int numberOfDigits = getNumberOfDigitsInInt(factor);
+/*!
+ * Multiply this BigInt by \a bi, which may be this BigInt. The product
+ * cannot overlap the operands, so it is formed on the stack when small
+ * and in the thread's scratch space otherwise, then copied into this
+ * BigInt's storage, which is only reallocated if it is too short.
+*/
 
-    for (int j = 0; j < numberOfDigits; j++)
+BigInt& BigInt::operator*=(const BigInt& bi)
+{
+    if (limbs.empty() || bi.limbs.empty())
     {
-        int currentDigit = 
-            floor((factor % (int)pow(10, j + 1)) / pow(10, j));
-        BigInt currentTerm = BigInt::multiplyByDigit(bi, currentDigit);
-        
-        currentTerm = currentTerm.pow10(j);
-        productInt = productInt + currentTerm;
+        limbs.clear();
+        nonNegative = true;
+        return *this;
     }
 
-    if (multiplyingByNegative)
+    const LimbStorage& longer = limbs.size() >= bi.limbs.size() ?
+        limbs : bi.limbs;
+    const LimbStorage& shorter = limbs.size() >= bi.limbs.size() ?
+        bi.limbs : limbs;
+    std::size_t productSize = longer.size() + shorter.size();
+
+    Limb buffer[2 * LimbStorage::INLINE_LIMBS];
+    ScratchVector scratch;
+    Limb* product = buffer;
+    if (productSize > 2 * LimbStorage::INLINE_LIMBS)
     {
-        if (bi.nonNegative)
-            productInt.nonNegative = false;
-        else
-            productInt.nonNegative = true;
+        scratch.resize(productSize);
+        product = scratch.data();
     }
-    else if (!bi.nonNegative)
-        productInt.nonNegative = false;
 
-    return productInt.normalize();
+    multiplyLimbs(product, longer.data(), longer.size(), shorter.data(),
+            shorter.size());
+    limbs.assign(product, product + normalizedSize(product, productSize));
+    nonNegative = (nonNegative == bi.nonNegative);
+
+    return *this;
 }
 
-std::ostream& operator<<(std::ostream& os, const BigInt& bi)
+BigInt BigInt::multiplyByLimb(const BigInt& bi, Limb limb)
+{
+    BigInt product;
+    product.limbs.resize(bi.limbs.size());
+    Limb carry = BigIntKernels::multiplyByLimb(product.limbs.data(),
+            bi.limbs.data(), bi.limbs.size(), limb);
+    if (carry != 0)
+        product.limbs.push_back(carry);
+    product.normalize();
+    return product;
+}
+
+/*
+ * Return bi times the built-in integer whose magnitude and sign are
+ * \a magnitude and \a negative. Factors that fit in a limb take a single
+ * pass of the limb multiplication kernel.
+*/
+
+void BigInt::multiplyNativeInPlace(UInt128 magnitude, bool negative)
 {
-    std::string representation = "";
-    for (int i : bi.intVector)
+    if ((magnitude >> 64) != 0)
     {
-        representation.append(std::to_string(i));
+        *this *= BigInt(magnitude, negative);
+        return;
     }
 
-    if (!bi.nonNegative)
-        representation.insert(0, "-");
+    Limb carry = BigIntKernels::multiplyByLimb(limbs.data(), limbs.data(),
+            limbs.size(), static_cast<Limb>(magnitude));
+    if (carry != 0)
+        limbs.push_back(carry);
+
+    nonNegative = (nonNegative != negative);
+    normalize();
+}
+
+BigInt BigInt::multiplyNative(const BigInt& bi, UInt128 magnitude,
+        bool negative)
+{
+    if ((magnitude >> 64) != 0)
+        return bi * BigInt(magnitude, negative);
+
+    BigInt productInt = multiplyByLimb(bi, static_cast<Limb>(magnitude));
+    productInt.nonNegative = (bi.nonNegative != negative);
+
+    productInt.normalize();
+
+    return productInt;
+}
+
+/*!
+ * Write the decimal representation of \a bi to \a os. Without a field
+ * width set, the digits go straight from a buffer to the stream.
+*/
+
+std::ostream& operator<<(std::ostream& os, const BigInt& bi)
+{
+    if (os.width() != 0)
+        return os << static_cast<std::string>(bi);
 
-    os << representation;
+    std::unique_ptr<char[]> buffer(new char[decimalDigitsBound(
+                bi.limbs.data(), bi.limbs.size()) + 1]);
+    os.write(buffer.get(), writeDecimal(buffer.get(), bi.limbs,
+                !bi.nonNegative));
     return os;
 }
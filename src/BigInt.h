@@ -1,69 +1,524 @@
 #ifndef BIGINT_H
 #define BIGINT_H
 
+#include <cstddef>
+#include <cstdint>
+#if defined(__cpp_impl_three_way_comparison) && \
+    __cpp_impl_three_way_comparison >= 201907L
+#include <compare>
+#endif
 #include <vector>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "BigIntLimbStorage.h"
 
 /*!
  * \class BigInt
  *
  * \brief A class to handle large integers in C++.
  *
- * BigInt implements integers of arbitrary length and arithmetic on 
+ * BigInt implements integers of arbitrary length and arithmetic on
  * those integers. It can be used identically to an int, although
  * using any operation between a BigInt and an int will produce a BigInt.
+ * Every built-in integer type, including __int128 and unsigned __int128,
+ * converts implicitly to a BigInt, and the arithmetic operators take
+ * those types directly without building a BigInt for them.
+ *
+ * Internally, the magnitude is stored as a little-endian sequence of
+ * 64-bit limbs, held inside the BigInt itself for values of up to 128
+ * bits. Decimal digits are only produced when a BigInt is
+ * converted to a string or written to a stream.
 */
 
+class BigIntModContext;
+
+namespace BigIntExpr
+{
+    template <typename Derived>
+    struct Expression;
+    class Evaluator;
+}
+
 class BigInt
 {
     public:
+        __extension__ typedef __int128 Int128;
+        __extension__ typedef unsigned __int128 UInt128;
+
+        /*!
+         * True for the built-in integer types other than bool. The 128-bit
+         * types are listed separately, since std::is_integral only
+         * includes them in GNU mode.
+        */
+        template <typename T>
+        struct IsNativeInteger : std::integral_constant<bool,
+            (std::is_integral<T>::value && !std::is_same<T, bool>::value) ||
+            std::is_same<T, Int128>::value ||
+            std::is_same<T, UInt128>::value>
+        {
+        };
+
         BigInt();
         BigInt(std::string stringToInt);
-        BigInt(int intToInt);
-        BigInt expt(const BigInt &power);
-        std::vector<int> getVector();
-        operator std::string()
+
+        /*!
+         * Construct a BigInt with the value of the built-in integer
+         * \a value.
+        */
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        BigInt(T value) :
+            BigInt(nativeMagnitude(value), isNativeNegative(value))
         {
-            std::string representation = "";
-            for (int i : intVector)
-            {
-                representation.append(std::to_string(i));
-            }
+        }
 
-            if (!nonNegative)
-                representation.insert(0, "-");
+        /*!
+         * Convert to a built-in integer type, throwing if the value is
+         * out of its range.
+        */
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        explicit operator T() const
+        {
+            bool isSigned = static_cast<T>(-1) < static_cast<T>(0);
+            unsigned int bits = 8 * sizeof(T);
 
-            return representation;
-        };
+            // A signed type reaches one further below zero than above it
+            UInt128 limit;
+            if (isSigned)
+                limit = (static_cast<UInt128>(1) << (bits - 1)) -
+                    (nonNegative ? 1 : 0);
+            else
+                limit = nonNegative ? ~static_cast<UInt128>(0) >>
+                    (128 - bits) : 0;
+
+            UInt128 magnitude = magnitudeAtMost(limit);
+            return static_cast<T>(nonNegative ? magnitude :
+                    static_cast<UInt128>(0) - magnitude);
+        }
+
+        BigInt expt(const BigInt &power) const;
+        BigInt expt(long long power) const;
+        std::vector<int> getVector();
+        operator std::string() const;
         friend std::ostream& operator << (std::ostream& os, const BigInt&);
+        friend class BigIntModContext;
+        friend class BigIntWorkspace;
+        friend class BigIntExpr::Evaluator;
+
+        /*!
+         * Evaluate a lazy expression from BigIntExpr.h into this BigInt,
+         * reusing its storage.
+        */
+        template <typename E>
+        BigInt& operator=(const BigIntExpr::Expression<E>& expression);
+
         friend BigInt operator+(const BigInt& b1, const BigInt& b2);
-        friend BigInt operator+(const BigInt& bi, const int& i);
+        friend BigInt operator+(BigInt&& b1, const BigInt& b2);
+        friend BigInt operator+(const BigInt& b1, BigInt&& b2);
+        friend BigInt operator+(BigInt&& b1, BigInt&& b2);
+        BigInt& operator+=(const BigInt& bi);
+        BigInt& operator-=(const BigInt& bi);
         friend BigInt operator*(const BigInt& b1, const BigInt& b2);
-        friend BigInt operator*(const BigInt& bi, const int& i);
+        BigInt& operator*=(const BigInt& bi);
         friend BigInt operator-(const BigInt& b1, const BigInt& b2);
-        friend BigInt operator/(const BigInt& dividend, const BigInt& 
+        friend BigInt operator-(BigInt&& b1, const BigInt& b2);
+        friend BigInt operator-(const BigInt& b1, BigInt&& b2);
+        friend BigInt operator-(BigInt&& b1, BigInt&& b2);
+        friend BigInt operator/(const BigInt& dividend, const BigInt&
+                divisor);
+        BigInt& operator/=(const BigInt& bi);
+        friend BigInt operator%(const BigInt& dividend, const BigInt&
                 divisor);
-        friend BigInt operator/(const BigInt& dividend, const int& divisor);
-        static BigInt abs(const BigInt bi);
+        BigInt& operator%=(const BigInt& bi);
+        friend BigInt operator<<(BigInt bi, std::size_t bits);
+        friend BigInt operator>>(BigInt bi, std::size_t bits);
+        BigInt& operator<<=(std::size_t bits);
+        BigInt& operator>>=(std::size_t bits);
+        friend BigInt operator&(BigInt b1, const BigInt& b2);
+        friend BigInt operator|(BigInt b1, const BigInt& b2);
+        friend BigInt operator^(BigInt b1, const BigInt& b2);
+        BigInt& operator&=(const BigInt& bi);
+        BigInt& operator|=(const BigInt& bi);
+        BigInt& operator^=(const BigInt& bi);
+        BigInt operator~() const;
+        std::size_t bitLength() const;
+        std::size_t popcount() const;
+        bool testBit(std::size_t index) const;
+        void swap(BigInt& other) noexcept;
+
+        friend void swap(BigInt& b1, BigInt& b2) noexcept
+        {
+            b1.swap(b2);
+        }
+
+        static std::pair<BigInt, BigInt> divmod(const BigInt& dividend,
+                const BigInt& divisor);
+        static BigInt powmod(const BigInt& base, const BigInt& exponent,
+                const BigInt& modulus, bool constantTime = false);
+        static BigInt abs(BigInt bi);
+
+        /*!
+         * Return the product of the values in [\a first, \a last), or 1 if
+         * the range is empty. The elements may be BigInts or anything
+         * that converts to one. They are multiplied in a balanced tree, so
+         * the operands of each multiplication stay about the same size,
+         * and large subtrees run side by side as getParallelism() allows.
+        */
+        template <typename InputIterator>
+        static BigInt product(InputIterator first, InputIterator last)
+        {
+            std::vector<BigInt> values(first, last);
+            return reduceTree(values, true);
+        }
+
+        /*!
+         * Return the sum of the values in [\a first, \a last), or 0 if the
+         * range is empty, added up in a balanced tree as product() does.
+        */
+        template <typename InputIterator>
+        static BigInt sum(InputIterator first, InputIterator last)
+        {
+            std::vector<BigInt> values(first, last);
+            return reduceTree(values, false);
+        }
+
+        static BigInt factorial(std::uint64_t n);
+        static BigInt binomial(std::uint64_t n, std::uint64_t k);
+        static BigInt primorial(std::uint64_t n);
+        static BigInt gcd(const BigInt& a, const BigInt& b);
+        static std::tuple<BigInt, BigInt, BigInt> xgcd(const BigInt& a,
+                const BigInt& b);
+        static BigInt lcm(const BigInt& a, const BigInt& b);
+        static BigInt modinv(const BigInt& a, const BigInt& modulus);
+        static BigInt isqrt(const BigInt& n);
+        static BigInt iroot(const BigInt& n, unsigned int k);
+        static bool isPerfectSquare(const BigInt& n);
+        static bool isPerfectPower(const BigInt& n);
+        static bool isProbablePrime(const BigInt& n);
+        static std::vector<bool> isProbablePrime(
+                const std::vector<BigInt>& candidates);
+        static BigInt nextPrime(const BigInt& n);
+
+        int compare(const BigInt& bi) const;
         bool operator==(const BigInt&) const;
+        bool operator!=(const BigInt&) const;
         bool operator< (const BigInt&) const;
         bool operator> (const BigInt&) const;
         bool operator<=(const BigInt&) const;
         bool operator>=(const BigInt&) const;
+#if defined(__cpp_impl_three_way_comparison) && \
+    __cpp_impl_three_way_comparison >= 201907L
+        std::strong_ordering operator<=>(const BigInt& bi) const
+        {
+            return compare(bi) <=> 0;
+        }
+#endif
         bool isNonNegative() const;
 
+        /*!
+         * Arithmetic with a built-in integer on either side. Operands of
+         * up to 64 bits go straight to the single-limb kernels, and work
+         * in place on a BigInt that is an rvalue or the target of a
+         * compound assignment.
+        */
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        BigInt& operator+=(T value)
+        {
+            addNativeInPlace(nativeMagnitude(value), isNativeNegative(value));
+            return *this;
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        BigInt& operator-=(T value)
+        {
+            addNativeInPlace(nativeMagnitude(value),
+                    !isNativeNegative(value));
+            return *this;
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        BigInt& operator*=(T value)
+        {
+            multiplyNativeInPlace(nativeMagnitude(value),
+                    isNativeNegative(value));
+            return *this;
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        BigInt& operator/=(T value)
+        {
+            divideByNative(*this, nativeMagnitude(value),
+                    isNativeNegative(value), this, nullptr);
+            return *this;
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        BigInt& operator%=(T value)
+        {
+            divideByNative(*this, nativeMagnitude(value),
+                    isNativeNegative(value), nullptr, this);
+            return *this;
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        friend BigInt operator+(BigInt&& bi, T value)
+        {
+            return std::move(bi += value);
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        friend BigInt operator+(T value, BigInt&& bi)
+        {
+            return std::move(bi += value);
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        friend BigInt operator-(BigInt&& bi, T value)
+        {
+            return std::move(bi -= value);
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        friend BigInt operator-(T value, BigInt&& bi)
+        {
+            return negate(std::move(bi -= value));
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        friend BigInt operator*(BigInt&& bi, T value)
+        {
+            return std::move(bi *= value);
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        friend BigInt operator*(T value, BigInt&& bi)
+        {
+            return std::move(bi *= value);
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        friend BigInt operator/(BigInt&& bi, T value)
+        {
+            return std::move(bi /= value);
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        friend BigInt operator%(BigInt&& bi, T value)
+        {
+            return std::move(bi %= value);
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        friend BigInt operator+(const BigInt& bi, T value)
+        {
+            return addNative(bi, nativeMagnitude(value),
+                    isNativeNegative(value));
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        friend BigInt operator+(T value, const BigInt& bi)
+        {
+            return addNative(bi, nativeMagnitude(value),
+                    isNativeNegative(value));
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        friend BigInt operator-(const BigInt& bi, T value)
+        {
+            return addNative(bi, nativeMagnitude(value),
+                    !isNativeNegative(value));
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        friend BigInt operator-(T value, const BigInt& bi)
+        {
+            return negate(addNative(bi, nativeMagnitude(value),
+                        !isNativeNegative(value)));
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        friend BigInt operator*(const BigInt& bi, T value)
+        {
+            return multiplyNative(bi, nativeMagnitude(value),
+                    isNativeNegative(value));
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        friend BigInt operator*(T value, const BigInt& bi)
+        {
+            return multiplyNative(bi, nativeMagnitude(value),
+                    isNativeNegative(value));
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        friend BigInt operator/(const BigInt& bi, T value)
+        {
+            BigInt quotient;
+            divideByNative(bi, nativeMagnitude(value),
+                    isNativeNegative(value), &quotient, nullptr);
+            return quotient;
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        friend BigInt operator/(T value, const BigInt& bi)
+        {
+            BigInt quotient;
+            divideNative(nativeMagnitude(value), isNativeNegative(value), bi,
+                    &quotient, nullptr);
+            return quotient;
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        friend BigInt operator%(const BigInt& bi, T value)
+        {
+            BigInt remainder;
+            divideByNative(bi, nativeMagnitude(value),
+                    isNativeNegative(value), nullptr, &remainder);
+            return remainder;
+        }
+
+        template <typename T, typename = typename std::enable_if<
+            IsNativeInteger<T>::value>::type>
+        friend BigInt operator%(T value, const BigInt& bi)
+        {
+            BigInt remainder;
+            divideNative(nativeMagnitude(value), isNativeNegative(value), bi,
+                    nullptr, &remainder);
+            return remainder;
+        }
+
+        /*!
+         * Operand sizes, in 64-bit limbs, at which multiplication and
+         * division switch to a faster algorithm. Each multiplication
+         * algorithm is used once the smaller operand has at least that
+         * many limbs; Burnikel-Ziegler division is used once both the
+         * divisor and the quotient do. The bench target measures suitable
+         * values for the host.
+        */
+        struct Thresholds
+        {
+            std::size_t karatsuba;
+            std::size_t toom3;
+            std::size_t toom4;
+            std::size_t ntt;
+            std::size_t burnikelZiegler;
+        };
+        static const Thresholds& getThresholds();
+        static void setThresholds(const Thresholds& newThresholds);
+
+        /*!
+         * The set of limb kernels in use: "portable", or the instruction
+         * set extensions it uses joined by '+', such as "adx+avx2". The
+         * fastest set the CPU supports is chosen at startup, unless the
+         * BIGINT_KERNELS environment variable names another one.
+        */
+        static std::string getKernels();
+        static void setKernels(const std::string& name);
+        static std::vector<std::string> getAvailableKernels();
+
+        /*!
+         * How many threads a multiplication may use, counting the calling
+         * thread, and how many 64-bit limbs the smaller operand needs
+         * before it is split up. Zero threads means one per hardware
+         * thread. The default of one thread keeps everything on the
+         * calling thread. Results do not depend on the thread count.
+        */
+        struct Parallelism
+        {
+            std::size_t threads;
+            std::size_t threshold;
+        };
+        static const Parallelism& getParallelism();
+        static void setParallelism(const Parallelism& newParallelism);
+
     private:
-        std::vector<int> intVector;
-        static BigInt multiplyByDigit(const BigInt& bi, int i);
-        BigInt pow10(int power);
-        static BigInt addTwoNegatives(BigInt bi1, BigInt bi2);
-        static BigInt addTwoPositives(BigInt bi1, BigInt bi2);
-        static BigInt addNegativeToPositive(BigInt positive, 
-                BigInt negative);
+        class GcdReducer;
+
+        // Magnitude, least significant limb first. Zero has no limbs.
+        LimbStorage limbs;
+
+        BigInt(UInt128 magnitude, bool negative);
+        UInt128 magnitudeAtMost(UInt128 limit) const;
+
+        template <typename T>
+        static bool isNativeNegative(T value)
+        {
+            return value < static_cast<T>(0);
+        }
+
+        template <typename T>
+        static UInt128 nativeMagnitude(T value)
+        {
+            // Negating in 128 bits also covers the most negative value
+            UInt128 bits = static_cast<UInt128>(value);
+            return isNativeNegative(value) ? static_cast<UInt128>(0) - bits :
+                bits;
+        }
+
+        static BigInt negate(BigInt bi);
+        static bool isStrongProbablePrime(const BigIntModContext& context);
+        static bool isStrongLucasProbablePrime(
+                const BigIntModContext& context);
+        static BigInt reduceTree(std::vector<BigInt>& values,
+                bool multiplying);
+        static BigInt addNative(const BigInt& bi, UInt128 magnitude,
+                bool negative);
+        void addNativeInPlace(UInt128 magnitude, bool negative);
+        static BigInt multiplyNative(const BigInt& bi, UInt128 magnitude,
+                bool negative);
+        void multiplyNativeInPlace(UInt128 magnitude, bool negative);
+        static void divideByNative(const BigInt& bi, UInt128 magnitude,
+                bool negative, BigInt* quotient, BigInt* remainder);
+        static void divideNative(UInt128 magnitude, bool negative,
+                const BigInt& bi, BigInt* quotient, BigInt* remainder);
+        static void multiplyMagnitudes(LimbStorage& result,
+                const LimbStorage& a, const LimbStorage& b);
+        static BigInt multiplyByLimb(const BigInt& bi, std::uint64_t limb);
+        static BigInt addTwoNegatives(const BigInt& bi1, const BigInt& bi2);
+        static BigInt addTwoPositives(const BigInt& bi1, const BigInt& bi2);
+        static BigInt addNegativeToPositive(const BigInt& positive,
+                const BigInt& negative);
+        static void addMagnitudes(LimbStorage& result, const LimbStorage& a,
+                const LimbStorage& b);
+        static void subtractMagnitudes(LimbStorage& result,
+                const LimbStorage& larger, const LimbStorage& smaller);
+        void addInPlace(const LimbStorage& magnitude,
+                bool magnitudeNonNegative);
+        static int compareMagnitudes(const LimbStorage& a,
+                const LimbStorage& b);
+        static int compareMagnitudes(const BigInt& bi1, const BigInt& bi2);
+        static void divideMagnitudes(const BigInt& dividend,
+                const BigInt& divisor, BigInt* quotient, BigInt* remainder);
         bool nonNegative;
-        BigInt normalize();
+        BigInt& normalize();
+        static Thresholds thresholds;
+        static Parallelism parallelism;
 };
 
 #endif
-
-
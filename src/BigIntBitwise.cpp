@@ -0,0 +1,226 @@
+#include <algorithm>
+
+#include "BigInt.h"
+#include "BigIntKernels.h"
+
+using namespace BigIntKernels;
+
+/*
+ * Bitwise operations, which treat a BigInt as an infinitely long two's
+ * complement number, as Python's int does. A negative a is then the
+ * complement of A = |a| - 1, a non-negative value, so every case becomes
+ * one operation on two non-negative values, perhaps with the result
+ * complemented:
+ *
+ * - ~A & ~B = ~(A | B) and ~A & b = b & ~A
+ * - ~A | ~B = ~(A & B) and ~A | b = ~(A & ~b)
+ * - ~A ^ ~B = A ^ B and ~A ^ b = ~(A ^ b)
+ *
+ * A complemented result ~R is the negative value with magnitude R + 1.
+ * The operation itself is the combineLimbs kernel, so nothing costs more
+ * than a pass over the limbs.
+*/
+
+namespace
+{
+    /*
+     * Return |a| - 1 for the nonzero magnitude \a magnitude.
+    */
+
+    ScratchVector lessOne(const LimbStorage& magnitude)
+    {
+        ScratchVector result(magnitude.begin(), magnitude.end());
+        const Limb one = 1;
+        subtractLimbs(result.data(), result.data(), result.size(), &one, 1);
+        result.resize(normalizedSize(result.data(), result.size()));
+        return result;
+    }
+
+    /*
+     * Replace the value with magnitude \a value and sign \a nonNegative by
+     * the result of \a operation on it and the value with magnitude
+     * \a other and sign \a otherNonNegative. \a other may be \a value.
+    */
+
+    void combineBits(LimbStorage& value, bool& nonNegative,
+            const LimbStorage& other, bool otherNonNegative,
+            BitOperation operation)
+    {
+        bool aNegative = !nonNegative;
+        bool bNegative = !otherNonNegative;
+        ScratchVector aLess;
+        ScratchVector bLess;
+        if (aNegative)
+            aLess = lessOne(value);
+        if (bNegative)
+            bLess = lessOne(other);
+        std::size_t aSize = aNegative ? aLess.size() : value.size();
+        std::size_t bSize = bNegative ? bLess.size() : other.size();
+
+        BitOperation kernel = operation;
+        bool swapped = false;
+        bool negative = false;
+        if (operation == BIT_AND)
+        {
+            kernel = aNegative && bNegative ? BIT_OR :
+                aNegative || bNegative ? BIT_AND_NOT : BIT_AND;
+            swapped = aNegative && !bNegative;
+            negative = aNegative && bNegative;
+        }
+        else if (operation == BIT_OR)
+        {
+            kernel = aNegative && bNegative ? BIT_AND :
+                aNegative || bNegative ? BIT_AND_NOT : BIT_OR;
+            swapped = bNegative && !aNegative;
+            negative = aNegative || bNegative;
+        }
+        else
+            negative = aNegative != bNegative;
+
+        std::size_t firstSize = swapped ? bSize : aSize;
+        std::size_t secondSize = swapped ? aSize : bSize;
+        std::size_t common = std::min(firstSize, secondSize);
+        std::size_t size = kernel == BIT_AND ? common :
+            kernel == BIT_AND_NOT ? firstSize :
+            std::max(firstSize, secondSize);
+
+        // Room for the carry out of R + 1. Resizing may move value, and
+        // other with it, so the operands are only found afterwards.
+        value.resize(size + 1);
+        const Limb* a = aNegative ? aLess.data() : value.data();
+        const Limb* b = bNegative ? bLess.data() : other.data();
+        const Limb* first = swapped ? b : a;
+        const Limb* second = swapped ? a : b;
+        Limb* result = value.data();
+
+        combineLimbs(result, first, second, common, kernel);
+        if (kernel != BIT_AND && firstSize > common && first != result)
+            std::copy(first + common, first + firstSize, result + common);
+        if ((kernel == BIT_OR || kernel == BIT_XOR) && secondSize > common &&
+                second != result)
+            std::copy(second + common, second + secondSize,
+                    result + common);
+
+        size = normalizedSize(result, size);
+        if (negative)
+        {
+            const Limb one = 1;
+            if (size == 0)
+                result[size++] = one;
+            else if (addLimbs(result, result, size, &one, 1) != 0)
+                result[size++] = one;
+        }
+
+        value.resize(size);
+        nonNegative = !negative || size == 0;
+    }
+}
+
+/*!
+ * Return the bitwise AND of \a b1 and \a b2, in two's complement.
+*/
+
+BigInt operator&(BigInt b1, const BigInt& b2)
+{
+    b1 &= b2;
+    return b1;
+}
+
+/*!
+ * Return the bitwise OR of \a b1 and \a b2, in two's complement.
+*/
+
+BigInt operator|(BigInt b1, const BigInt& b2)
+{
+    b1 |= b2;
+    return b1;
+}
+
+/*!
+ * Return the bitwise exclusive OR of \a b1 and \a b2, in two's
+ * complement.
+*/
+
+BigInt operator^(BigInt b1, const BigInt& b2)
+{
+    b1 ^= b2;
+    return b1;
+}
+
+BigInt& BigInt::operator&=(const BigInt& bi)
+{
+    combineBits(limbs, nonNegative, bi.limbs, bi.nonNegative, BIT_AND);
+    return *this;
+}
+
+BigInt& BigInt::operator|=(const BigInt& bi)
+{
+    combineBits(limbs, nonNegative, bi.limbs, bi.nonNegative, BIT_OR);
+    return *this;
+}
+
+BigInt& BigInt::operator^=(const BigInt& bi)
+{
+    combineBits(limbs, nonNegative, bi.limbs, bi.nonNegative, BIT_XOR);
+    return *this;
+}
+
+/*!
+ * Return the bitwise complement, which is -x - 1.
+*/
+
+BigInt BigInt::operator~() const
+{
+    return negate(*this + 1);
+}
+
+/*!
+ * Return the number of bits in the magnitude, not counting a sign bit,
+ * which is 0 for 0. Like Python's int.bit_length(), this is the same for
+ * x and -x.
+*/
+
+std::size_t BigInt::bitLength() const
+{
+    if (limbs.empty())
+        return 0;
+    return 64 * limbs.size() - __builtin_clzll(limbs.back());
+}
+
+/*!
+ * Return the number of set bits in the magnitude. Like Python's
+ * int.bit_count(), this is the same for x and -x, since a negative value
+ * has infinitely many in two's complement.
+*/
+
+std::size_t BigInt::popcount() const
+{
+    std::size_t count = 0;
+    for (Limb limb : limbs)
+        count += __builtin_popcountll(limb);
+    return count;
+}
+
+/*!
+ * Return bit \a index of the value in two's complement, which is
+ * (x >> index) & 1.
+*/
+
+bool BigInt::testBit(std::size_t index) const
+{
+    std::size_t limb = index / 64;
+    unsigned int bit = index % 64;
+    if (nonNegative)
+        return limb < limbs.size() && ((limbs[limb] >> bit) & 1) != 0;
+
+    // The complement of |x| - 1, which has the low zeros of |x| set, then
+    // the lowest one cleared, and the bits above it
+    std::size_t zeros = 0;
+    while (limbs[zeros / 64] == 0)
+        zeros += 64;
+    zeros += __builtin_ctzll(limbs[zeros / 64]);
+
+    if (index <= zeros)
+        return index == zeros;
+    return limb >= limbs.size() || ((limbs[limb] >> bit) & 1) == 0;
+}
@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "BigInt.h"
+
+/*
+ * Factorials, binomial coefficients and primorials.
+ *
+ * All three are products of prime powers that are each at most n, so
+ * they are built by listing those powers, packing runs of them into
+ * single limbs and handing the limbs to BigInt::product. The balanced
+ * tree there keeps the large multiplications on the fast algorithms.
+ *
+ * The factorial uses Luschny's prime swing: n! = (floor(n / 2)!)^2 *
+ * swing(n), where the swing n! / (floor(n / 2)!)^2 has, for each odd prime
+ * p, one factor of p for every i with floor(n / p^i) odd. Only odd parts
+ * are multiplied, and the power of two, n minus the number of ones in n,
+ * is shifted in at the end.
+*/
+
+namespace
+{
+    typedef std::uint64_t Limb;
+
+    // The largest n whose primes are sieved
+    const Limb SIEVE_LIMIT = std::numeric_limits<std::uint32_t>::max();
+
+    // Binomials with k below n / BINOMIAL_RATIO are computed as a falling
+    // factorial divided by k!, which avoids sieving up to n
+    const Limb BINOMIAL_RATIO = 64;
+
+    /*
+     * Return the primes up to \a n in increasing order, sieving odd
+     * numbers only.
+    */
+
+    std::vector<std::uint32_t> primesUpTo(Limb n)
+    {
+        std::vector<std::uint32_t> primes;
+        if (n < 2)
+            return primes;
+
+        primes.push_back(2);
+
+        // composite[i] stands for 2i + 1
+        std::vector<bool> composite(n / 2 + 1, false);
+        for (Limb i = 1; 2 * i + 1 <= n; i++)
+        {
+            if (composite[i])
+                continue;
+
+            Limb p = 2 * i + 1;
+            primes.push_back(static_cast<std::uint32_t>(p));
+            for (Limb multiple = p * p; multiple <= n; multiple += 2 * p)
+                composite[multiple / 2] = true;
+        }
+
+        return primes;
+    }
+
+    /*
+     * Collects factors of up to one limb, multiplying consecutive ones
+     * together while they fit, and returns their product.
+    */
+
+    class FactorList
+    {
+        public:
+            FactorList() : packed(1) {}
+
+            void add(Limb factor)
+            {
+                if (packed > std::numeric_limits<Limb>::max() / factor)
+                {
+                    limbs.push_back(packed);
+                    packed = 1;
+                }
+                packed *= factor;
+            }
+
+            BigInt product()
+            {
+                limbs.push_back(packed);
+                packed = 1;
+                return BigInt::product(limbs.begin(), limbs.end());
+            }
+
+        private:
+            std::vector<Limb> limbs;
+            Limb packed;
+    };
+
+    /*
+     * Return the odd part of swing(n), using the sorted \a primes, which
+     * cover every prime up to n.
+    */
+
+    BigInt oddSwing(Limb n, const std::vector<std::uint32_t>& primes)
+    {
+        FactorList factors;
+        for (std::size_t i = 1; i < primes.size() && primes[i] <= n; i++)
+        {
+            Limb p = primes[i];
+            Limb power = 1;
+            for (Limb quotient = n / p; quotient > 0; quotient /= p)
+            {
+                if (quotient & 1)
+                    power *= p;
+            }
+
+            if (power > 1)
+                factors.add(power);
+        }
+
+        return factors.product();
+    }
+
+    /*
+     * Return the odd part of n!.
+    */
+
+    BigInt oddFactorial(Limb n, const std::vector<std::uint32_t>& primes)
+    {
+        if (n < 3)
+            return BigInt(1);
+
+        BigInt half = oddFactorial(n / 2, primes);
+        return half * half * oddSwing(n, primes);
+    }
+}
+
+/*!
+ * Return \a n!. Throws if \a n is 2^32 or more, since the result would
+ * not fit in memory.
+*/
+
+BigInt BigInt::factorial(std::uint64_t n)
+{
+    if (n > SIEVE_LIMIT)
+        throw ("factorial is limited to n below 2^32");
+
+    std::vector<std::uint32_t> primes = primesUpTo(n);
+    std::size_t twos = n - __builtin_popcountll(n);
+    return oddFactorial(n, primes) << twos;
+}
+
+/*!
+ * Return the binomial coefficient \a n choose \a k, which is 0 when
+ * \a k is greater than \a n.
+ *
+ * The exponent of each prime p in the result is the number of borrows
+ * when k is subtracted from n in base p. When k is much smaller than n,
+ * the product of the k values above n - k is divided by k! instead, so
+ * that n can be as large as a 64-bit integer.
+*/
+
+BigInt BigInt::binomial(std::uint64_t n, std::uint64_t k)
+{
+    if (k > n)
+        return BigInt(0);
+    k = std::min(k, n - k);
+
+    if (n > SIEVE_LIMIT || k < n / BINOMIAL_RATIO)
+    {
+        FactorList numerator;
+        for (Limb i = n - k + 1; i <= n && i != 0; i++)
+            numerator.add(i);
+        return numerator.product() / factorial(k);
+    }
+
+    FactorList factors;
+    for (std::uint32_t prime : primesUpTo(n))
+    {
+        Limb p = prime;
+        Limb power = 1;
+        for (Limb a = n, b = k, c = n - k; a >= p;)
+        {
+            a /= p;
+            b /= p;
+            c /= p;
+            if (a != b + c)
+                power *= p;
+        }
+
+        if (power > 1)
+            factors.add(power);
+    }
+
+    return factors.product();
+}
+
+/*!
+ * Return the product of the primes up to \a n, which is 1 when \a n is
+ * less than 2. Throws if \a n is 2^32 or more.
+*/
+
+BigInt BigInt::primorial(std::uint64_t n)
+{
+    if (n > SIEVE_LIMIT)
+        throw ("primorial is limited to n below 2^32");
+
+    FactorList factors;
+    for (std::uint32_t prime : primesUpTo(n))
+        factors.add(prime);
+
+    return factors.product();
+}
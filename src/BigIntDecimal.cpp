@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+#include "BigIntKernels.h"
+
+/*
+ * Conversion between limbs and decimal digits.
+ *
+ * Both directions split the number around a power 10^(19 * 2^k), so that
+ * the halves can be converted independently: printing divides by the
+ * power and parsing multiplies by it. With fast multiplication and
+ * division this takes O(M(n) log n) time instead of the O(n^2) of
+ * converting one limb-sized chunk of digits at a time, which is kept as
+ * the base case.
+*/
+
+namespace BigIntKernels
+{
+    namespace
+    {
+        // The largest power of ten that fits in a limb
+        const Limb DECIMAL_CHUNK = 10000000000000000000ULL;
+        const std::size_t DECIMAL_CHUNK_DIGITS = 19;
+
+        // Sizes below which the chunk-at-a-time conversions are faster
+        const std::size_t PRINT_BASECASE_LIMBS = 40;
+        const std::size_t PARSE_BASECASE_DIGITS = 40 * DECIMAL_CHUNK_DIGITS;
+
+        /*
+         * Return 10^(19 * 2^level), computed by repeated squaring and kept
+         * for later conversions.
+        */
+
+        std::shared_ptr<const std::vector<Limb>> getDecimalPower(int level)
+        {
+            static std::mutex powersMutex;
+            static std::vector<std::shared_ptr<const std::vector<Limb>>>
+                powers;
+
+            std::lock_guard<std::mutex> lock(powersMutex);
+            if (powers.empty())
+                powers.push_back(std::make_shared<const std::vector<Limb>>(
+                            1, DECIMAL_CHUNK));
+
+            while (static_cast<int>(powers.size()) <= level)
+            {
+                const std::vector<Limb>& previous = *powers.back();
+                std::size_t size = previous.size();
+                std::vector<Limb> square(2 * size);
+                squareLimbs(square.data(), previous.data(), size);
+                square.resize(normalizedSize(square.data(), 2 * size));
+                powers.push_back(std::make_shared<const std::vector<Limb>>(
+                            std::move(square)));
+            }
+
+            return powers[level];
+        }
+
+        /*
+         * Return the largest level whose power has fewer than \a digits
+         * digits, so that splitting there leaves both parts non-empty.
+        */
+
+        int splitLevel(std::size_t digits)
+        {
+            int level = 0;
+            while ((DECIMAL_CHUNK_DIGITS << (level + 1)) < digits)
+                level++;
+            return level;
+        }
+
+        void printBasecase(char* out, std::size_t width, const Limb* a,
+                std::size_t size)
+        {
+            ScratchVector remaining(a, a + size);
+            std::size_t position = width;
+
+            while (size > 0 && position > 0)
+            {
+                Limb chunk = divideByLimb(remaining.data(), remaining.data(),
+                        size, DECIMAL_CHUNK);
+                size = normalizedSize(remaining.data(), size);
+
+                std::size_t chunkDigits = std::min(DECIMAL_CHUNK_DIGITS,
+                        position);
+                for (std::size_t i = 0; i < chunkDigits; i++)
+                {
+                    out[--position] = static_cast<char>('0' + chunk % 10);
+                    chunk /= 10;
+                }
+            }
+
+            std::fill(out, out + position, '0');
+        }
+
+        void parseBasecase(LimbVector& result, const char* digits,
+                std::size_t count)
+        {
+            // The first chunk takes whatever is left over by the others
+            std::size_t chunkLength = count % DECIMAL_CHUNK_DIGITS;
+            if (chunkLength == 0)
+                chunkLength = DECIMAL_CHUNK_DIGITS;
+
+            for (std::size_t i = 0; i < count; i += chunkLength,
+                    chunkLength = DECIMAL_CHUNK_DIGITS)
+            {
+                Limb chunkValue = 0;
+                Limb chunkScale = 1;
+                for (std::size_t j = i; j < i + chunkLength; j++)
+                {
+                    chunkValue = chunkValue * 10 + (digits[j] - '0');
+                    chunkScale *= 10;
+                }
+
+                Limb carry = chunkValue;
+                for (Limb& limb : result)
+                {
+                    DoubleLimb current = static_cast<DoubleLimb>(limb) *
+                        chunkScale + carry;
+                    limb = static_cast<Limb>(current);
+                    carry = static_cast<Limb>(current >> 64);
+                }
+                if (carry != 0)
+                    result.push_back(carry);
+            }
+        }
+    }
+
+    std::size_t decimalDigitsBound(const Limb* a, std::size_t size)
+    {
+        size = normalizedSize(a, size);
+        if (size == 0)
+            return 1;
+
+        // log10(2) is just below 0.30103, which rounds the bound up
+        std::size_t bits = 64 * size - __builtin_clzll(a[size - 1]);
+        return static_cast<std::size_t>(bits * 0.30103) + 1;
+    }
+
+    void limbsToDecimal(char* out, std::size_t width, const Limb* a,
+            std::size_t size)
+    {
+        size = normalizedSize(a, size);
+        if (size < PRINT_BASECASE_LIMBS)
+        {
+            printBasecase(out, width, a, size);
+            return;
+        }
+
+        int level = splitLevel(width);
+        std::size_t lowWidth = DECIMAL_CHUNK_DIGITS << level;
+        std::shared_ptr<const std::vector<Limb>> power =
+            getDecimalPower(level);
+        std::size_t powerSize = power->size();
+
+        if (powerSize > size)
+        {
+            std::fill(out, out + width - lowWidth, '0');
+            limbsToDecimal(out + width - lowWidth, lowWidth, a, size);
+            return;
+        }
+
+        ScratchVector quotient(size - powerSize + 1);
+        ScratchVector remainder(powerSize);
+        divideLimbs(quotient.data(), remainder.data(), a, size,
+                power->data(), powerSize);
+
+        limbsToDecimal(out, width - lowWidth, quotient.data(),
+                quotient.size());
+        limbsToDecimal(out + width - lowWidth, lowWidth, remainder.data(),
+                powerSize);
+    }
+
+    LimbVector decimalToLimbs(const char* digits, std::size_t count)
+    {
+        LimbVector result;
+        if (count <= PARSE_BASECASE_DIGITS)
+        {
+            parseBasecase(result, digits, count);
+            result.resize(normalizedSize(result.data(), result.size()));
+            return result;
+        }
+
+        int level = splitLevel(count);
+        std::size_t lowCount = DECIMAL_CHUNK_DIGITS << level;
+        std::shared_ptr<const std::vector<Limb>> power =
+            getDecimalPower(level);
+
+        LimbVector high = decimalToLimbs(digits, count - lowCount);
+        LimbVector low = decimalToLimbs(digits + count - lowCount,
+                lowCount);
+        if (high.empty())
+            return low;
+
+        // high * 10^lowCount + low
+        result.resize(high.size() + power->size() + 1);
+        if (high.size() >= power->size())
+            multiplyLimbs(result.data(), high.data(), high.size(),
+                    power->data(), power->size());
+        else
+            multiplyLimbs(result.data(), power->data(), power->size(),
+                    high.data(), high.size());
+        if (!low.empty())
+            addLimbs(result.data(), result.data(), result.size(), low.data(),
+                    low.size());
+
+        result.resize(normalizedSize(result.data(), result.size()));
+        return result;
+    }
+}
@@ -0,0 +1,284 @@
+#include <algorithm>
+
+#include "BigInt.h"
+#include "BigIntKernels.h"
+
+/*
+ * Long division of limb arrays. divideLimbs switches from schoolbook to
+ * Burnikel-Ziegler division once both the divisor and the quotient reach
+ * the threshold in BigInt::getThresholds().
+*/
+
+namespace BigIntKernels
+{
+    namespace
+    {
+        /*
+         * Knuth's Algorithm D (TAOCP vol. 2, 4.3.1). The divisor is shifted so
+         * that its top bit is set, which makes each estimated quotient limb at
+         * most two too large; the estimate is refined against the next divisor
+         * limb and, rarely, corrected by adding the divisor back.
+        */
+
+        void divideSchoolbook(Limb* quotient, Limb* remainder,
+                const Limb* a, std::size_t aSize, const Limb* b,
+                std::size_t bSize)
+        {
+            unsigned int shift = __builtin_clzll(b[bSize - 1]);
+
+            ScratchVector normalized(aSize + 1 + bSize);
+            Limb* u = normalized.data();
+            Limb* v = u + aSize + 1;
+
+            if (shift == 0)
+            {
+                std::copy(a, a + aSize, u);
+                u[aSize] = 0;
+                std::copy(b, b + bSize, v);
+            }
+            else
+            {
+                u[aSize] = shiftLeftLimbs(u, a, aSize, shift);
+                shiftLeftLimbs(v, b, bSize, shift);
+            }
+
+            const Limb vTop = v[bSize - 1];
+            const Limb vNext = v[bSize - 2];
+
+            for (std::size_t j = aSize - bSize + 1; j-- > 0;)
+            {
+                // Estimate the quotient limb from the top two limbs of the
+                // current remainder and the top limb of the divisor
+                DoubleLimb numerator =
+                    (static_cast<DoubleLimb>(u[j + bSize]) << 64) |
+                    u[j + bSize - 1];
+                DoubleLimb estimate = numerator / vTop;
+                DoubleLimb estimateRemainder = numerator % vTop;
+
+                while ((estimate >> 64) != 0 ||
+                        static_cast<DoubleLimb>(static_cast<Limb>(estimate)) *
+                        vNext > ((estimateRemainder << 64) | u[j + bSize - 2]))
+                {
+                    estimate--;
+                    estimateRemainder += vTop;
+                    if ((estimateRemainder >> 64) != 0)
+                        break;
+                }
+
+                Limb quotientLimb = static_cast<Limb>(estimate);
+                Limb borrow = subtractMultiplyByLimb(u + j, v, bSize,
+                        quotientLimb);
+                Limb top = u[j + bSize];
+                u[j + bSize] = top - borrow;
+
+                if (top < borrow)
+                {
+                    // The estimate was one too large
+                    quotientLimb--;
+                    u[j + bSize] += addLimbs(u + j, u + j, bSize, v, bSize);
+                }
+
+                if (quotient)
+                    quotient[j] = quotientLimb;
+            }
+
+            if (remainder)
+            {
+                if (shift == 0)
+                    std::copy(u, u + bSize, remainder);
+                else
+                    shiftRightLimbs(remainder, u, bSize, shift);
+            }
+        }
+
+        void divideTwoByOne(Limb* quotient, Limb* remainder, const Limb* a,
+                const Limb* b, std::size_t n, std::size_t threshold);
+
+        /*
+         * Divide the 3h-limb \a a by the 2h-limb \a b, whose top bit is
+         * set, storing h quotient limbs and 2h remainder limbs. Requires
+         * a < b * 2^(64h), so that the quotient fits.
+         *
+         * The quotient is first estimated by dividing the top 2h limbs of
+         * a by the top h limbs of b, which is at most two too large.
+        */
+
+        void divideThreeByTwo(Limb* quotient, Limb* remainder, const Limb* a,
+                const Limb* b, std::size_t h, std::size_t threshold)
+        {
+            const Limb* bHigh = b + h;
+
+            // The remainder of the estimate with the low h limbs of a
+            // appended below it
+            ScratchVector partial(2 * h + 1);
+            std::copy(a, a + h, partial.begin());
+
+            if (compareLimbs(a + 2 * h, bHigh, h) < 0)
+            {
+                divideTwoByOne(quotient, partial.data() + h, a + h, bHigh, h,
+                        threshold);
+                partial[2 * h] = 0;
+            }
+            else
+            {
+                // The top limbs of a equal bHigh, so the estimate is
+                // 2^(64h) - 1 and its remainder is the next h limbs of a
+                // plus bHigh
+                std::fill(quotient, quotient + h, ~static_cast<Limb>(0));
+                partial[2 * h] = addLimbs(partial.data() + h, a + h, h,
+                        bHigh, h);
+            }
+
+            ScratchVector product(2 * h);
+            multiplyLimbs(product.data(), quotient, h, b, h);
+            Limb borrow = subtractLimbs(partial.data(), partial.data(),
+                    2 * h + 1, product.data(), 2 * h);
+
+            // Add the divisor back while the remainder is negative
+            const Limb one = 1;
+            while (borrow != 0)
+            {
+                subtractLimbs(quotient, quotient, h, &one, 1);
+                if (addLimbs(partial.data(), partial.data(), 2 * h + 1, b,
+                            2 * h) != 0)
+                    borrow = 0;
+            }
+
+            std::copy(partial.begin(), partial.begin() + 2 * h, remainder);
+        }
+
+        /*
+         * Divide the 2n-limb \a a by the n-limb \a b, whose top bit is set,
+         * storing n quotient limbs and n remainder limbs. Requires
+         * a < b * 2^(64n), so that the quotient fits.
+        */
+
+        void divideTwoByOne(Limb* quotient, Limb* remainder, const Limb* a,
+                const Limb* b, std::size_t n, std::size_t threshold)
+        {
+            if (n % 2 != 0 || n < threshold)
+            {
+                ScratchVector fullQuotient(n + 1);
+                divideSchoolbook(fullQuotient.data(), remainder, a, 2 * n, b,
+                        n);
+                std::copy(fullQuotient.begin(), fullQuotient.begin() + n,
+                        quotient);
+                return;
+            }
+
+            std::size_t h = n / 2;
+
+            // The top half of the quotient comes from the top 3h limbs of
+            // a, and the bottom half from their remainder followed by the
+            // low h limbs of a
+            ScratchVector partial(3 * h);
+            std::copy(a, a + h, partial.begin());
+            divideThreeByTwo(quotient + h, partial.data() + h, a + h, b, h,
+                    threshold);
+            divideThreeByTwo(quotient, remainder, partial.data(), b, h,
+                    threshold);
+        }
+
+        /*
+         * Burnikel and Ziegler's recursive division ("Fast Recursive
+         * Division", MPI-I-98-1-022). The divisor is padded and shifted up
+         * to n limbs with its top bit set, where n halves evenly down to
+         * below the threshold, and the dividend is consumed n limbs at a
+         * time by 2n-by-n divisions. Each of those costs a couple of
+         * half-size multiplications at every level of the recursion, so
+         * the whole division takes O(M(n) log n) time for fast
+         * multiplication M.
+        */
+
+        void divideBurnikelZiegler(Limb* quotient, Limb* remainder,
+                const Limb* a, std::size_t aSize, const Limb* b,
+                std::size_t bSize, std::size_t threshold)
+        {
+            std::size_t step = 1;
+            while (bSize / step >= threshold)
+                step *= 2;
+            std::size_t n = (bSize + step - 1) / step * step;
+
+            std::size_t offset = n - bSize;
+            unsigned int shift = __builtin_clzll(b[bSize - 1]);
+
+            ScratchVector divisor(n);
+            ScratchVector dividend(aSize + offset + 1);
+            if (shift == 0)
+            {
+                std::copy(b, b + bSize, divisor.begin() + offset);
+                std::copy(a, a + aSize, dividend.begin() + offset);
+            }
+            else
+            {
+                shiftLeftLimbs(divisor.data() + offset, b, bSize, shift);
+                dividend[aSize + offset] = shiftLeftLimbs(
+                        dividend.data() + offset, a, aSize, shift);
+            }
+
+            // Split the dividend into the fewest blocks of n limbs that
+            // leave the top bit of the top block clear, so that the top
+            // block is less than the divisor
+            std::size_t dividendSize = normalizedSize(dividend.data(),
+                    dividend.size());
+            std::size_t dividendBits = 64 * dividendSize -
+                __builtin_clzll(dividend[dividendSize - 1]);
+            std::size_t blocks = std::max<std::size_t>(
+                    dividendBits / (64 * n) + 1, 2);
+            dividend.resize(blocks * n);
+
+            ScratchVector blockQuotient((blocks - 1) * n);
+            ScratchVector current(2 * n);
+            ScratchVector blockRemainder(n);
+            std::copy(dividend.end() - 2 * n, dividend.end(),
+                    current.begin());
+
+            for (std::size_t i = blocks - 1; i-- > 0;)
+            {
+                divideTwoByOne(blockQuotient.data() + i * n,
+                        blockRemainder.data(), current.data(),
+                        divisor.data(), n, threshold);
+
+                if (i > 0)
+                {
+                    std::copy(blockRemainder.begin(), blockRemainder.end(),
+                            current.begin() + n);
+                    std::copy(dividend.begin() + (i - 1) * n,
+                            dividend.begin() + i * n, current.begin());
+                }
+            }
+
+            if (quotient)
+            {
+                std::size_t quotientSize = aSize - bSize + 1;
+                std::size_t copied = std::min(quotientSize,
+                        blockQuotient.size());
+                std::copy(blockQuotient.begin(),
+                        blockQuotient.begin() + copied, quotient);
+                std::fill(quotient + copied, quotient + quotientSize, 0);
+            }
+
+            if (remainder)
+            {
+                if (shift == 0)
+                    std::copy(blockRemainder.begin() + offset,
+                            blockRemainder.end(), remainder);
+                else
+                    shiftRightLimbs(remainder,
+                            blockRemainder.data() + offset, bSize, shift);
+            }
+        }
+    }
+
+    void divideLimbs(Limb* quotient, Limb* remainder, const Limb* a,
+            std::size_t aSize, const Limb* b, std::size_t bSize)
+    {
+        std::size_t threshold = BigInt::getThresholds().burnikelZiegler;
+
+        if (bSize >= threshold && aSize - bSize >= threshold)
+            divideBurnikelZiegler(quotient, remainder, a, aSize, b, bSize,
+                    threshold);
+        else
+            divideSchoolbook(quotient, remainder, a, aSize, b, bSize);
+    }
+}
@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "BigIntExpr.h"
+#include "BigIntKernels.h"
+
+using namespace BigIntKernels;
+
+namespace BigIntExpr
+{
+    namespace
+    {
+        /*
+         * BigInts that are not borrowed by a Scratch at the moment. Each
+         * keeps the buffer it grew to, so a loop that evaluates similar
+         * expressions stops allocating once the pool holds one value per
+         * level of nesting.
+        */
+
+        std::vector<BigInt>& scratchPool()
+        {
+            thread_local std::vector<BigInt> pool;
+            return pool;
+        }
+    }
+
+    BigInt& Evaluator::Scratch::get()
+    {
+        if (!borrowed)
+        {
+            std::vector<BigInt>& pool = scratchPool();
+            if (!pool.empty())
+            {
+                value.swap(pool.back());
+                pool.pop_back();
+            }
+            borrowed = true;
+        }
+        return value;
+    }
+
+    Evaluator::Scratch::~Scratch()
+    {
+        // Values from other memory resources may not outlive them, so
+        // only those from the default one are kept
+        if (!borrowed || value.limbs.getResource() !=
+                BigIntMemoryResource::getDefault())
+            return;
+
+        // Losing the buffer is better than throwing from a destructor
+        try
+        {
+            scratchPool().push_back(std::move(value));
+        }
+        catch (...)
+        {
+        }
+    }
+
+    /*
+     * Store a * b in \a result, which may be either operand. An operand
+     * that is result is scaled in place when the other fits in a limb.
+    */
+
+    void Evaluator::multiply(BigInt& result, const BigInt& a,
+            const BigInt& b)
+    {
+        if (&result == &a && b.limbs.size() == 1)
+            scale(result, b);
+        else if (&result == &b && a.limbs.size() == 1)
+            scale(result, a);
+        else if (&result == &a || &result == &b)
+        {
+            Scratch scratch;
+            multiply(scratch.get(), a, b);
+            result.swap(scratch.get());
+        }
+        else
+        {
+            BigInt::multiplyMagnitudes(result.limbs, a.limbs, b.limbs);
+            result.nonNegative = (a.nonNegative == b.nonNegative);
+            result.normalize();
+        }
+    }
+
+    /*
+     * Multiply \a result by \a factor in place. A single-limb factor
+     * takes one pass of the limb kernel over result's own buffer.
+    */
+
+    void Evaluator::scale(BigInt& result, const BigInt& factor)
+    {
+        if (factor.limbs.size() != 1)
+        {
+            multiply(result, result, factor);
+            return;
+        }
+
+        Limb carry = BigIntKernels::multiplyByLimb(result.limbs.data(),
+                result.limbs.data(), result.limbs.size(), factor.limbs[0]);
+        if (carry != 0)
+            result.limbs.push_back(carry);
+
+        result.nonNegative = (result.nonNegative == factor.nonNegative);
+        result.normalize();
+    }
+
+    /*
+     * Add a * b to \a result, or subtract it if \a subtract is set. When
+     * the shorter factor is below the Karatsuba threshold and the product
+     * cannot change the sign of result, it is accumulated straight into
+     * result's limbs one limb of the factor at a time, as schoolbook
+     * multiplication would form it; otherwise it is formed in a scratch
+     * value and then added.
+    */
+
+    void Evaluator::addProduct(BigInt& result, const BigInt& a,
+            const BigInt& b, bool subtract)
+    {
+        if (a.limbs.empty() || b.limbs.empty())
+            return;
+
+        bool productNonNegative = (a.nonNegative == b.nonNegative) !=
+            subtract;
+        const BigInt& multiple = a.limbs.size() >= b.limbs.size() ? a : b;
+        const BigInt& factor = a.limbs.size() >= b.limbs.size() ? b : a;
+        std::size_t multipleSize = multiple.limbs.size();
+        std::size_t factorSize = factor.limbs.size();
+        std::size_t productSize = multipleSize + factorSize;
+
+        bool fusable = &result != &a && &result != &b &&
+            factorSize < BigInt::getThresholds().karatsuba;
+        bool sameSign = result.limbs.empty() ||
+            result.nonNegative == productNonNegative;
+
+        if (fusable && sameSign)
+        {
+            if (result.limbs.empty())
+                result.nonNegative = productNonNegative;
+
+            // The sum is below 2^(64 size), so with the extra top limb
+            // every row's carry comes to rest inside the buffer
+            std::size_t size = std::max(result.limbs.size(),
+                    productSize) + 1;
+            result.limbs.resize(size);
+
+            Limb* out = result.limbs.data();
+            for (std::size_t j = 0; j < factorSize; j++)
+            {
+                Limb carry = addMultiplyByLimb(out + j,
+                        multiple.limbs.data(), multipleSize,
+                        factor.limbs[j]);
+                for (std::size_t i = j + multipleSize; carry != 0; i++)
+                {
+                    out[i] += carry;
+                    carry = (out[i] < carry) ? 1 : 0;
+                }
+            }
+
+            result.normalize();
+            return;
+        }
+
+        // A result with more limbs than the product is larger than it, so
+        // the product can be taken off in place without a sign change
+        if (fusable && result.limbs.size() > productSize)
+        {
+            Limb* out = result.limbs.data();
+            for (std::size_t j = 0; j < factorSize; j++)
+            {
+                Limb borrow = subtractMultiplyByLimb(out + j,
+                        multiple.limbs.data(), multipleSize,
+                        factor.limbs[j]);
+                for (std::size_t i = j + multipleSize; borrow != 0; i++)
+                {
+                    Limb previous = out[i];
+                    out[i] = previous - borrow;
+                    borrow = (previous < borrow) ? 1 : 0;
+                }
+            }
+
+            result.normalize();
+            return;
+        }
+
+        Scratch scratch;
+        BigInt::multiplyMagnitudes(scratch.get().limbs, a.limbs, b.limbs);
+        result.addInPlace(scratch.get().limbs, productNonNegative);
+    }
+
+    void Evaluator::negate(BigInt& result)
+    {
+        if (!result.limbs.empty())
+            result.nonNegative = !result.nonNegative;
+    }
+}
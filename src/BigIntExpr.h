@@ -0,0 +1,530 @@
+#ifndef BIGINT_EXPR_H
+#define BIGINT_EXPR_H
+
+#include <type_traits>
+
+#include "BigInt.h"
+
+/*!
+ * \namespace BigIntExpr
+ *
+ * \brief Lazy BigInt arithmetic that is evaluated on assignment.
+ *
+ * Wrapping one operand in lazy() makes + - * build an expression tree
+ * instead of a BigInt at every step. Assigning the tree to a BigInt
+ * evaluates it into that BigInt's storage: multiplications by a built-in
+ * integer scale the destination in place, and products that are added to
+ * or subtracted from the destination use a fused multiply-accumulate,
+ * so that a loop such as
+ *
+ * \code
+ * using BigIntExpr::lazy;
+ * for (const BigInt& coefficient : coefficients)
+ *     acc = lazy(acc) * x + coefficient;
+ * \endcode
+ *
+ * reuses the same few buffers on every iteration. += and -= take
+ * expressions too. An expression holds references to the BigInts in it,
+ * so it must be assigned within the statement that builds it.
+*/
+
+namespace BigIntExpr
+{
+    template <typename Derived>
+    struct Expression
+    {
+        const Derived& derived() const
+        {
+            return static_cast<const Derived&>(*this);
+        }
+
+        operator BigInt() const;
+    };
+
+    // A BigInt operand, held by reference
+    struct Term : Expression<Term>
+    {
+        explicit Term(const BigInt& value) : value(value) {}
+        const BigInt& value;
+    };
+
+    // A built-in integer operand, held as a BigInt that fits inline
+    struct Constant : Expression<Constant>
+    {
+        template <typename T>
+        explicit Constant(T value) : value(value) {}
+        BigInt value;
+    };
+
+    struct Add {};
+    struct Subtract {};
+    struct Multiply {};
+
+    template <typename Op, typename L, typename R>
+    struct Binary : Expression<Binary<Op, L, R>>
+    {
+        Binary(const L& left, const R& right) : left(left), right(right) {}
+        L left;
+        R right;
+    };
+
+    template <typename T>
+    struct IsLeaf : std::integral_constant<bool,
+        std::is_same<T, Term>::value || std::is_same<T, Constant>::value>
+    {
+    };
+
+    /*
+     * The node type that an operand of + - * becomes. Operands that are
+     * not expressions, BigInts or built-in integers have no type here,
+     * which keeps the operators out of overload resolution for them.
+    */
+
+    template <typename T, typename Enable = void>
+    struct Wrapped
+    {
+    };
+
+    template <typename T>
+    struct Wrapped<T, typename std::enable_if<
+        std::is_base_of<Expression<T>, T>::value>::type>
+    {
+        typedef T type;
+        static const T& wrap(const T& expression) { return expression; }
+    };
+
+    template <>
+    struct Wrapped<BigInt, void>
+    {
+        typedef Term type;
+        static Term wrap(const BigInt& bi) { return Term(bi); }
+    };
+
+    template <typename T>
+    struct Wrapped<T, typename std::enable_if<
+        BigInt::IsNativeInteger<T>::value>::type>
+    {
+        typedef Constant type;
+        static Constant wrap(T value) { return Constant(value); }
+    };
+
+    template <typename T>
+    struct IsExpression : std::is_base_of<Expression<T>, T>
+    {
+    };
+
+    template <typename L, typename R>
+    struct HasExpression : std::integral_constant<bool,
+        IsExpression<typename std::decay<L>::type>::value ||
+        IsExpression<typename std::decay<R>::type>::value>
+    {
+    };
+
+    /*
+     * The node that an operator builds from operands of types L and R.
+     * The operators take forwarding references, so that they are as good
+     * a match as BigInt's own operators for rvalue BigInts, which live
+     * until the end of the statement that evaluates the expression.
+    */
+
+    template <typename Op, typename L, typename R>
+    struct Node
+    {
+        typedef Wrapped<typename std::decay<L>::type> Left;
+        typedef Wrapped<typename std::decay<R>::type> Right;
+        typedef Binary<Op, typename Left::type, typename Right::type> type;
+
+        static type make(const typename std::decay<L>::type& left,
+                const typename std::decay<R>::type& right)
+        {
+            return type(Left::wrap(left), Right::wrap(right));
+        }
+    };
+
+    /*!
+     * Start a lazy expression from \a bi.
+    */
+
+    inline Term lazy(const BigInt& bi)
+    {
+        return Term(bi);
+    }
+
+    template <typename L, typename R, typename = typename std::enable_if<
+        HasExpression<L, R>::value>::type>
+    typename Node<Add, L, R>::type operator+(L&& left, R&& right)
+    {
+        return Node<Add, L, R>::make(left, right);
+    }
+
+    template <typename L, typename R, typename = typename std::enable_if<
+        HasExpression<L, R>::value>::type>
+    typename Node<Subtract, L, R>::type operator-(L&& left, R&& right)
+    {
+        return Node<Subtract, L, R>::make(left, right);
+    }
+
+    template <typename L, typename R, typename = typename std::enable_if<
+        HasExpression<L, R>::value>::type>
+    typename Node<Multiply, L, R>::type operator*(L&& left, R&& right)
+    {
+        return Node<Multiply, L, R>::make(left, right);
+    }
+
+    /*
+     * The steps that evaluation is made of. They work on BigInt's limbs
+     * directly, so they are compiled in BigIntExpr.cpp.
+    */
+
+    class Evaluator
+    {
+        public:
+            // A BigInt borrowed from a per-thread pool for the lifetime
+            // of the Scratch, so that intermediate values keep their
+            // buffers from one evaluation to the next
+            class Scratch
+            {
+                public:
+                    Scratch() : borrowed(false) {}
+                    ~Scratch();
+                    Scratch(const Scratch&) = delete;
+                    Scratch& operator=(const Scratch&) = delete;
+                    BigInt& get();
+
+                private:
+                    BigInt value;
+                    bool borrowed;
+            };
+
+            static void multiply(BigInt& result, const BigInt& a,
+                    const BigInt& b);
+            static void scale(BigInt& result, const BigInt& factor);
+            static void addProduct(BigInt& result, const BigInt& a,
+                    const BigInt& b, bool subtract);
+            static void negate(BigInt& result);
+    };
+
+    // Whether evaluating e reads the BigInt at \a bi
+    inline bool refersTo(const Term& term, const BigInt* bi)
+    {
+        return &term.value == bi;
+    }
+
+    inline bool refersTo(const Constant&, const BigInt*)
+    {
+        return false;
+    }
+
+    template <typename Op, typename L, typename R>
+    bool refersTo(const Binary<Op, L, R>& e, const BigInt* bi)
+    {
+        return refersTo(e.left, bi) || refersTo(e.right, bi);
+    }
+
+    // A leaf on the left of a larger right-hand side is added last, so
+    // that the right-hand side can be built in result itself
+    template <typename L, typename R>
+    struct AddsLeftLast : std::integral_constant<bool,
+        IsLeaf<L>::value && !IsLeaf<R>::value>
+    {
+    };
+
+    inline bool assignableInPlace(const Term&, const BigInt*)
+    {
+        return true;
+    }
+
+    inline bool assignableInPlace(const Constant&, const BigInt*)
+    {
+        return true;
+    }
+
+    template <typename Op, typename L, typename R>
+    bool assignableInPlace(const Binary<Op, L, R>& e, const BigInt* bi)
+    {
+        if (AddsLeftLast<L, R>::value)
+            return assignableInPlace(e.right, bi) && !refersTo(e.left, bi);
+        return assignableInPlace(e.left, bi) && !refersTo(e.right, bi);
+    }
+
+    template <typename L, typename R>
+    bool assignableInPlace(const Binary<Multiply, L, R>&, const BigInt*)
+    {
+        return true;
+    }
+
+    template <typename L>
+    bool assignableInPlace(const Binary<Multiply, L, Constant>& e,
+            const BigInt* bi)
+    {
+        return assignableInPlace(e.left, bi);
+    }
+
+    template <typename R>
+    bool assignableInPlace(const Binary<Multiply, Constant, R>& e,
+            const BigInt* bi)
+    {
+        return assignableInPlace(e.right, bi);
+    }
+
+    inline bool assignableInPlace(
+            const Binary<Multiply, Constant, Constant>&, const BigInt*)
+    {
+        return true;
+    }
+
+    inline bool accumulableInPlace(const Term&, const BigInt*)
+    {
+        return true;
+    }
+
+    inline bool accumulableInPlace(const Constant&, const BigInt*)
+    {
+        return true;
+    }
+
+    template <typename Op, typename L, typename R>
+    bool accumulableInPlace(const Binary<Op, L, R>& e, const BigInt* bi)
+    {
+        return accumulableInPlace(e.left, bi) && !refersTo(e.right, bi);
+    }
+
+    template <typename L, typename R>
+    bool accumulableInPlace(const Binary<Multiply, L, R>&, const BigInt*)
+    {
+        return true;
+    }
+
+    /*
+     * assignTo stores the value of an expression in \a result and
+     * accumulate adds it to (or subtracts it from) \a result. Products
+     * only read their operands before writing to result, and the first
+     * operand of a sum is evaluated first, so an expression may read
+     * result as long as no operand does so after result has been
+     * written; assignableInPlace and accumulableInPlace check that.
+    */
+
+    template <typename L, typename R>
+    void assignTo(BigInt& result, const Binary<Add, L, R>& e);
+    template <typename L, typename R>
+    void assignTo(BigInt& result, const Binary<Subtract, L, R>& e);
+    template <typename L, typename R>
+    void assignTo(BigInt& result, const Binary<Multiply, L, R>& e);
+    template <typename L>
+    void assignTo(BigInt& result, const Binary<Multiply, L, Constant>& e);
+    template <typename R>
+    void assignTo(BigInt& result, const Binary<Multiply, Constant, R>& e);
+    inline void assignTo(BigInt& result,
+            const Binary<Multiply, Constant, Constant>& e);
+
+    template <typename L, typename R>
+    void accumulate(BigInt& result, const Binary<Add, L, R>& e,
+            bool subtract);
+    template <typename L, typename R>
+    void accumulate(BigInt& result, const Binary<Subtract, L, R>& e,
+            bool subtract);
+    template <typename L, typename R>
+    void accumulate(BigInt& result, const Binary<Multiply, L, R>& e,
+            bool subtract);
+
+    inline void assignTo(BigInt& result, const Term& term)
+    {
+        result = term.value;
+    }
+
+    inline void assignTo(BigInt& result, const Constant& constant)
+    {
+        result = constant.value;
+    }
+
+    inline void accumulate(BigInt& result, const Term& term, bool subtract)
+    {
+        if (subtract)
+            result -= term.value;
+        else
+            result += term.value;
+    }
+
+    inline void accumulate(BigInt& result, const Constant& constant,
+            bool subtract)
+    {
+        if (subtract)
+            result -= constant.value;
+        else
+            result += constant.value;
+    }
+
+    inline const BigInt& valueOf(const Term& term, Evaluator::Scratch&)
+    {
+        return term.value;
+    }
+
+    inline const BigInt& valueOf(const Constant& constant,
+            Evaluator::Scratch&)
+    {
+        return constant.value;
+    }
+
+    template <typename Op, typename L, typename R>
+    const BigInt& valueOf(const Binary<Op, L, R>& e,
+            Evaluator::Scratch& scratch)
+    {
+        assignTo(scratch.get(), e);
+        return scratch.get();
+    }
+
+    template <typename L, typename R>
+    void assignSum(BigInt& result, const L& left, const R& right,
+            bool subtract, std::false_type)
+    {
+        assignTo(result, left);
+        accumulate(result, right, subtract);
+    }
+
+    template <typename L, typename R>
+    void assignSum(BigInt& result, const L& left, const R& right,
+            bool subtract, std::true_type)
+    {
+        assignTo(result, right);
+        if (subtract)
+            Evaluator::negate(result);
+        accumulate(result, left, false);
+    }
+
+    template <typename L, typename R>
+    void assignTo(BigInt& result, const Binary<Add, L, R>& e)
+    {
+        assignSum(result, e.left, e.right, false, AddsLeftLast<L, R>());
+    }
+
+    template <typename L, typename R>
+    void assignTo(BigInt& result, const Binary<Subtract, L, R>& e)
+    {
+        assignSum(result, e.left, e.right, true, AddsLeftLast<L, R>());
+    }
+
+    template <typename L, typename R>
+    void assignTo(BigInt& result, const Binary<Multiply, L, R>& e)
+    {
+        Evaluator::Scratch leftScratch;
+        Evaluator::Scratch rightScratch;
+        Evaluator::multiply(result, valueOf(e.left, leftScratch),
+                valueOf(e.right, rightScratch));
+    }
+
+    template <typename L>
+    void assignTo(BigInt& result, const Binary<Multiply, L, Constant>& e)
+    {
+        assignTo(result, e.left);
+        Evaluator::scale(result, e.right.value);
+    }
+
+    template <typename R>
+    void assignTo(BigInt& result, const Binary<Multiply, Constant, R>& e)
+    {
+        assignTo(result, e.right);
+        Evaluator::scale(result, e.left.value);
+    }
+
+    inline void assignTo(BigInt& result,
+            const Binary<Multiply, Constant, Constant>& e)
+    {
+        result = e.left.value;
+        Evaluator::scale(result, e.right.value);
+    }
+
+    template <typename L, typename R>
+    void accumulate(BigInt& result, const Binary<Add, L, R>& e,
+            bool subtract)
+    {
+        accumulate(result, e.left, subtract);
+        accumulate(result, e.right, subtract);
+    }
+
+    template <typename L, typename R>
+    void accumulate(BigInt& result, const Binary<Subtract, L, R>& e,
+            bool subtract)
+    {
+        accumulate(result, e.left, subtract);
+        accumulate(result, e.right, !subtract);
+    }
+
+    template <typename L, typename R>
+    void accumulate(BigInt& result, const Binary<Multiply, L, R>& e,
+            bool subtract)
+    {
+        Evaluator::Scratch leftScratch;
+        Evaluator::Scratch rightScratch;
+        Evaluator::addProduct(result, valueOf(e.left, leftScratch),
+                valueOf(e.right, rightScratch), subtract);
+    }
+
+    /*!
+     * Add the value of \a expression to \a bi.
+    */
+
+    template <typename E>
+    BigInt& operator+=(BigInt& bi, const Expression<E>& expression)
+    {
+        const E& e = expression.derived();
+        if (accumulableInPlace(e, &bi))
+            accumulate(bi, e, false);
+        else
+        {
+            Evaluator::Scratch scratch;
+            assignTo(scratch.get(), e);
+            bi += scratch.get();
+        }
+        return bi;
+    }
+
+    /*!
+     * Subtract the value of \a expression from \a bi.
+    */
+
+    template <typename E>
+    BigInt& operator-=(BigInt& bi, const Expression<E>& expression)
+    {
+        const E& e = expression.derived();
+        if (accumulableInPlace(e, &bi))
+            accumulate(bi, e, true);
+        else
+        {
+            Evaluator::Scratch scratch;
+            assignTo(scratch.get(), e);
+            bi -= scratch.get();
+        }
+        return bi;
+    }
+
+    template <typename Derived>
+    Expression<Derived>::operator BigInt() const
+    {
+        BigInt result;
+        assignTo(result, derived());
+        return result;
+    }
+}
+
+/*!
+ * Evaluate \a expression into this BigInt. An expression that reads this
+ * BigInt after it has been written is evaluated into a pooled scratch
+ * value first, which is then swapped in.
+*/
+
+template <typename E>
+BigInt& BigInt::operator=(const BigIntExpr::Expression<E>& expression)
+{
+    const E& e = expression.derived();
+    if (BigIntExpr::assignableInPlace(e, this))
+        BigIntExpr::assignTo(*this, e);
+    else
+    {
+        BigIntExpr::Evaluator::Scratch scratch;
+        BigIntExpr::assignTo(scratch.get(), e);
+        swap(scratch.get());
+    }
+    return *this;
+}
+
+#endif
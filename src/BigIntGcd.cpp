@@ -0,0 +1,475 @@
+#include <algorithm>
+#include <tuple>
+
+#include "BigInt.h"
+#include "BigIntKernels.h"
+
+using namespace BigIntKernels;
+
+/*
+ * Greatest common divisors, Bezout coefficients and modular inverses.
+ *
+ * A GcdReducer holds a pair a >= b >= 0 and reduces it towards (gcd, 0).
+ * It also keeps the rows of the matrix taking the starting pair to the
+ * current one, or just their first columns, which is all the cofactors
+ * need. Every step multiplies the pair by a matrix of determinant +-1,
+ * so the gcd never changes, even if a step is a poor one.
+ *
+ * - Large pairs take a half-GCD step. A recursive call on the top halves
+ *   of a and b finds a matrix that roughly halves their size, and that
+ *   matrix is applied to the full values. Halving a pair takes two such
+ *   calls on quarter-size parts, so this costs O(M(n) log n) instead of
+ *   O(n^2).
+ * - Other pairs take Lehmer steps. A run of Euclid's quotients is found
+ *   from the top 126 bits of a and b alone, checked as in Knuth's
+ *   Algorithm L. The matrix, whose entries fit in single limbs, is then
+ *   applied with the limb kernels. When a has at most 126 bits the top
+ *   bits are the whole values.
+ * - A plain gcd of values of up to two limbs is finished with Stein's
+ *   binary algorithm.
+*/
+
+namespace
+{
+    // Pairs whose b has at least this many limbs take half-GCD steps
+    const std::size_t HALF_GCD_LIMBS = 300;
+
+    // Bits of a and b that a Lehmer step looks at, few enough that sums
+    // with its cofactors cannot overflow
+    const std::size_t LEHMER_BITS = 126;
+
+    // Cofactors of a Lehmer step stay below this in magnitude
+    const BigInt::Int128 LEHMER_COFACTOR_LIMIT =
+        static_cast<BigInt::Int128>(1) << 63;
+
+    /*
+     * Return the 128 bits of \a x starting at bit \a offset, reading limbs
+     * past \a size as zeros.
+    */
+
+    BigInt::UInt128 bitsAt(const Limb* x, std::size_t size,
+            std::size_t offset)
+    {
+        std::size_t limb = offset / 64;
+        unsigned int shift = offset % 64;
+
+        Limb words[3];
+        for (std::size_t i = 0; i < 3; i++)
+            words[i] = limb + i < size ? x[limb + i] : 0;
+
+        Limb low = words[0];
+        Limb high = words[1];
+        if (shift != 0)
+        {
+            low = (words[0] >> shift) | (words[1] << (64 - shift));
+            high = (words[1] >> shift) | (words[2] << (64 - shift));
+        }
+        return (static_cast<BigInt::UInt128>(high) << 64) | low;
+    }
+
+    /*
+     * Store |p * x - q * y| in result, which has room for size + 1 limbs,
+     * and return whether p * x < q * y.
+    */
+
+    bool differenceOfProducts(Limb* result, const Limb* x, Limb p,
+            const Limb* y, Limb q, std::size_t size)
+    {
+        Limb top = multiplyByLimb(result, x, size, p);
+        Limb borrow = subtractMultiplyByLimb(result, y, size, q);
+        result[size] = top - borrow;
+        if (top >= borrow)
+            return false;
+
+        // The difference is negative and above -2^(64 * (size + 1)), so
+        // negating its two's complement gives the magnitude
+        Limb one = 1;
+        for (std::size_t i = 0; i <= size; i++)
+            result[i] = ~result[i];
+        addLimbs(result, result, size + 1, &one, 1);
+        return true;
+    }
+
+    unsigned int trailingZeros(BigInt::UInt128 x)
+    {
+        Limb low = static_cast<Limb>(x);
+        return low != 0 ? __builtin_ctzll(low) :
+            64 + __builtin_ctzll(static_cast<Limb>(x >> 64));
+    }
+
+    /*
+     * Stein's binary gcd.
+    */
+
+    BigInt::UInt128 binaryGcd(BigInt::UInt128 a, BigInt::UInt128 b)
+    {
+        if (a == 0)
+            return b;
+        if (b == 0)
+            return a;
+
+        unsigned int shift = trailingZeros(a | b);
+        a >>= trailingZeros(a);
+        while (b != 0)
+        {
+            b >>= trailingZeros(b);
+            if (a > b)
+                std::swap(a, b);
+            b -= a;
+        }
+        return a << shift;
+    }
+}
+
+class BigInt::GcdReducer
+{
+    public:
+        GcdReducer(BigInt first, BigInt second, int columns);
+
+        void reduce(std::size_t targetBits);
+        void halve();
+
+        BigInt a;
+        BigInt b;
+        // (a; b) = rows * (starting a; starting b), for the first columns
+        // columns only
+        BigInt rows[2][2];
+        int columns;
+
+    private:
+        void order();
+        void apply(const GcdReducer& inner);
+        void divisionStep();
+        bool lehmerStep();
+        bool binaryStep();
+};
+
+/*
+ * Start from the magnitudes of \a first and \a second, in whichever order
+ * makes a the larger, keeping \a columns columns of the matrix (0, 1 or
+ * 2).
+*/
+
+BigInt::GcdReducer::GcdReducer(BigInt first, BigInt second, int columns) :
+    a(std::move(first)), b(std::move(second)), columns(columns)
+{
+    rows[0][0] = 1;
+    rows[1][1] = 1;
+    order();
+}
+
+/*
+ * Reduce until b has at most \a targetBits bits. A target of zero runs
+ * Euclid's algorithm to the end, leaving the gcd in a.
+ *
+ * While b is large, each round halves the top bits of a and b in a
+ * reducer of their own, and then takes one division step. For a of l
+ * bits, dropping the low 2t - l bits leaves 2(l - t) bits, which halve
+ * to l - t, bringing b down to about the target t. When the target is
+ * less than half of l that drops nothing, so the low l / 2 bits are
+ * dropped instead.
+*/
+
+void BigInt::GcdReducer::reduce(std::size_t targetBits)
+{
+    while (b.bitLength() > targetBits)
+    {
+        if (b.limbs.size() >= HALF_GCD_LIMBS)
+        {
+            std::size_t l = a.bitLength();
+            std::size_t low = 2 * targetBits > l + 64 ?
+                2 * targetBits - l : l / 2;
+
+            GcdReducer top(a >> low, b >> low, 2);
+            top.halve();
+            apply(top);
+            if (b.bitLength() > targetBits)
+                divisionStep();
+        }
+        else if (targetBits == 0 && columns == 0 && binaryStep())
+            return;
+        else if (!lehmerStep())
+            divisionStep();
+    }
+}
+
+/*
+ * Reduce until b has about half as many bits as a.
+*/
+
+void BigInt::GcdReducer::halve()
+{
+    reduce(a.bitLength() / 2 + 1);
+}
+
+/*
+ * Make a and b non-negative with a >= b, adjusting the rows to match.
+*/
+
+void BigInt::GcdReducer::order()
+{
+    if (!a.nonNegative)
+    {
+        a.nonNegative = true;
+        for (int j = 0; j < columns; j++)
+            rows[0][j] = negate(std::move(rows[0][j]));
+    }
+    if (!b.nonNegative)
+    {
+        b.nonNegative = true;
+        for (int j = 0; j < columns; j++)
+            rows[1][j] = negate(std::move(rows[1][j]));
+    }
+    if (compareMagnitudes(a, b) < 0)
+    {
+        a.swap(b);
+        for (int j = 0; j < columns; j++)
+            rows[0][j].swap(rows[1][j]);
+    }
+}
+
+/*
+ * Multiply the pair and the rows by the matrix that \a inner found for
+ * the top parts of a and b.
+*/
+
+void BigInt::GcdReducer::apply(const GcdReducer& inner)
+{
+    const BigInt (&m)[2][2] = inner.rows;
+
+    BigInt nextA = m[0][0] * a + m[0][1] * b;
+    b = m[1][0] * a + m[1][1] * b;
+    a = std::move(nextA);
+
+    for (int j = 0; j < columns; j++)
+    {
+        BigInt top = m[0][0] * rows[0][j] + m[0][1] * rows[1][j];
+        rows[1][j] = m[1][0] * rows[0][j] + m[1][1] * rows[1][j];
+        rows[0][j] = std::move(top);
+    }
+
+    order();
+}
+
+/*
+ * Replace (a, b) with (b, a mod b).
+*/
+
+void BigInt::GcdReducer::divisionStep()
+{
+    std::pair<BigInt, BigInt> division = divmod(a, b);
+    a.swap(b);
+    b = std::move(division.second);
+
+    for (int j = 0; j < columns; j++)
+    {
+        rows[0][j].swap(rows[1][j]);
+        rows[1][j] -= division.first * rows[0][j];
+    }
+}
+
+/*
+ * Take as many of Euclid's steps as the top bits of a and b decide, and
+ * return false if they decide none.
+*/
+
+bool BigInt::GcdReducer::lehmerStep()
+{
+    std::size_t size = a.limbs.size();
+    std::size_t bits = a.bitLength();
+    std::size_t offset = bits > LEHMER_BITS ? bits - LEHMER_BITS : 0;
+
+    Int128 high = bitsAt(a.limbs.data(), size, offset);
+    Int128 low = bitsAt(b.limbs.data(), b.limbs.size(), offset);
+
+    // (high; low) = (A B; C D) * (top of a; top of b), as in Algorithm L
+    Int128 A = 1, B = 0, C = 0, D = 1;
+    while (true)
+    {
+        if (low + C <= 0 || low + D <= 0)
+            break;
+
+        Int128 q = (high + A) / (low + C);
+        if (q != (high + B) / (low + D) || q >= LEHMER_COFACTOR_LIMIT)
+            break;
+
+        Int128 nextC = A - q * C;
+        Int128 nextD = B - q * D;
+        if (nextC <= -LEHMER_COFACTOR_LIMIT ||
+                nextC >= LEHMER_COFACTOR_LIMIT ||
+                nextD <= -LEHMER_COFACTOR_LIMIT ||
+                nextD >= LEHMER_COFACTOR_LIMIT)
+            break;
+
+        A = C;
+        B = D;
+        C = nextC;
+        D = nextD;
+
+        Int128 next = high - q * low;
+        high = low;
+        low = next;
+    }
+
+    if (B == 0)
+        return false;
+
+    // The entries alternate in sign, A and D having one sign and B and C
+    // the other, so each new value is a difference of two products. B is
+    // nonzero, while A may be zero after a single step.
+    ScratchVector padded(size, 0);
+    std::copy(b.limbs.begin(), b.limbs.end(), padded.begin());
+    ScratchVector results(2 * (size + 1));
+    Limb* nextA = results.data();
+    Limb* nextB = nextA + size + 1;
+
+    bool aFlipped;
+    bool bFlipped;
+    if (B < 0)
+    {
+        aFlipped = differenceOfProducts(nextA, a.limbs.data(),
+                static_cast<Limb>(A), padded.data(), static_cast<Limb>(-B),
+                size);
+        bFlipped = differenceOfProducts(nextB, padded.data(),
+                static_cast<Limb>(D), a.limbs.data(), static_cast<Limb>(-C),
+                size);
+    }
+    else
+    {
+        aFlipped = differenceOfProducts(nextA, padded.data(),
+                static_cast<Limb>(B), a.limbs.data(), static_cast<Limb>(-A),
+                size);
+        bFlipped = differenceOfProducts(nextB, a.limbs.data(),
+                static_cast<Limb>(C), padded.data(), static_cast<Limb>(-D),
+                size);
+    }
+
+    a.limbs.assign(nextA, nextA + normalizedSize(nextA, size + 1));
+    b.limbs.assign(nextB, nextB + normalizedSize(nextB, size + 1));
+
+    std::int64_t entries[2][2] = {
+        {static_cast<std::int64_t>(A), static_cast<std::int64_t>(B)},
+        {static_cast<std::int64_t>(C), static_cast<std::int64_t>(D)}};
+    if (aFlipped)
+    {
+        entries[0][0] = -entries[0][0];
+        entries[0][1] = -entries[0][1];
+    }
+    if (bFlipped)
+    {
+        entries[1][0] = -entries[1][0];
+        entries[1][1] = -entries[1][1];
+    }
+
+    for (int j = 0; j < columns; j++)
+    {
+        BigInt top = rows[0][j] * entries[0][0] +
+            rows[1][j] * entries[0][1];
+        rows[1][j] = rows[0][j] * entries[1][0] +
+            rows[1][j] * entries[1][1];
+        rows[0][j] = std::move(top);
+    }
+
+    order();
+    return true;
+}
+
+/*
+ * Finish with Stein's algorithm if a fits in two limbs, returning
+ * whether it did.
+*/
+
+bool BigInt::GcdReducer::binaryStep()
+{
+    if (a.limbs.size() > 2)
+        return false;
+
+    a = BigInt(binaryGcd(static_cast<UInt128>(a), static_cast<UInt128>(b)),
+            false);
+    b = 0;
+    return true;
+}
+
+/*!
+ * Return the greatest common divisor of \a a and \a b, which is never
+ * negative. gcd(0, 0) is 0.
+*/
+
+BigInt BigInt::gcd(const BigInt& a, const BigInt& b)
+{
+    GcdReducer reducer(abs(a), abs(b), 0);
+    reducer.reduce(0);
+    return std::move(reducer.a);
+}
+
+/*!
+ * Return the gcd g of \a a and \a b along with x and y such that
+ * a * x + b * y = g. When b is nonzero, |x| is at most |b| / (2g), and
+ * otherwise x is the sign of a and y is 0.
+*/
+
+std::tuple<BigInt, BigInt, BigInt> BigInt::xgcd(const BigInt& a,
+        const BigInt& b)
+{
+    // Only the coefficient of a is kept; y follows from it at the end
+    GcdReducer reducer(abs(a), abs(b), 1);
+    reducer.reduce(0);
+    BigInt g = std::move(reducer.a);
+
+    if (b.limbs.empty())
+        return std::make_tuple(g, BigInt(a.limbs.empty() ? 0 :
+                    a.nonNegative ? 1 : -1), BigInt(0));
+
+    BigInt x = std::move(reducer.rows[0][0]);
+    if (!a.nonNegative)
+        x = negate(std::move(x));
+
+    // Bring x into (-m / 2, m / 2] for m = |b| / g
+    BigInt m = abs(b) / g;
+    x %= m;
+    if (!x.nonNegative)
+        x += m;
+    if (x + x > m)
+        x -= m;
+
+    BigInt y = (g - a * x) / b;
+    return std::make_tuple(std::move(g), std::move(x), std::move(y));
+}
+
+/*!
+ * Return the least common multiple of \a a and \a b, which is never
+ * negative. It is 0 if either is 0.
+*/
+
+BigInt BigInt::lcm(const BigInt& a, const BigInt& b)
+{
+    if (a.limbs.empty() || b.limbs.empty())
+        return BigInt(0);
+
+    return abs(a) / gcd(a, b) * abs(b);
+}
+
+/*!
+ * Return the inverse of \a a modulo \a modulus, in [0, modulus). Throws
+ * if the modulus is not positive or \a a shares a factor with it.
+*/
+
+BigInt BigInt::modinv(const BigInt& a, const BigInt& modulus)
+{
+    if (!modulus.nonNegative || modulus.limbs.empty())
+        throw ("modinv requires a positive modulus");
+
+    BigInt residue = a % modulus;
+    if (!residue.nonNegative)
+        residue += modulus;
+
+    GcdReducer reducer(residue, modulus, 1);
+    reducer.reduce(0);
+    if (!(reducer.a == BigInt(1)))
+        throw ("Value has no inverse modulo the modulus");
+
+    BigInt inverse = std::move(reducer.rows[0][0]) % modulus;
+    if (!inverse.nonNegative)
+        inverse += modulus;
+    return inverse;
+}
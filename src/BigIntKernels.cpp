@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "BigIntKernels.h"
+
+namespace BigIntKernels
+{
+    namespace Portable
+    {
+        Limb addLimbs(Limb* result, const Limb* a, std::size_t aSize,
+                const Limb* b, std::size_t bSize)
+        {
+            Limb carry = 0;
+            std::size_t i = 0;
+
+            for (; i < bSize; i++)
+            {
+                DoubleLimb nextTerm = static_cast<DoubleLimb>(a[i]) + b[i]
+                    + carry;
+                result[i] = static_cast<Limb>(nextTerm);
+                carry = static_cast<Limb>(nextTerm >> 64);
+            }
+
+            for (; i < aSize; i++)
+            {
+                Limb nextTerm = a[i] + carry;
+                carry = (nextTerm < carry);
+                result[i] = nextTerm;
+            }
+
+            return carry;
+        }
+
+        Limb subtractLimbs(Limb* result, const Limb* a, std::size_t aSize,
+                const Limb* b, std::size_t bSize)
+        {
+            Limb borrow = 0;
+            std::size_t i = 0;
+
+            for (; i < bSize; i++)
+            {
+                DoubleLimb nextTerm = static_cast<DoubleLimb>(a[i]) - b[i]
+                    - borrow;
+                result[i] = static_cast<Limb>(nextTerm);
+                borrow = static_cast<Limb>(nextTerm >> 64) & 1;
+            }
+
+            for (; i < aSize; i++)
+            {
+                Limb nextTerm = a[i] - borrow;
+                borrow = (a[i] < borrow);
+                result[i] = nextTerm;
+            }
+
+            return borrow;
+        }
+
+        Limb multiplyByLimb(Limb* result, const Limb* a, std::size_t size,
+                Limb factor)
+        {
+            Limb carry = 0;
+            for (std::size_t i = 0; i < size; i++)
+            {
+                DoubleLimb product = static_cast<DoubleLimb>(a[i]) * factor
+                    + carry;
+                result[i] = static_cast<Limb>(product);
+                carry = static_cast<Limb>(product >> 64);
+            }
+
+            return carry;
+        }
+
+        Limb addMultiplyByLimb(Limb* result, const Limb* a, std::size_t size,
+                Limb factor)
+        {
+            Limb carry = 0;
+            for (std::size_t i = 0; i < size; i++)
+            {
+                DoubleLimb product = static_cast<DoubleLimb>(a[i]) * factor
+                    + result[i] + carry;
+                result[i] = static_cast<Limb>(product);
+                carry = static_cast<Limb>(product >> 64);
+            }
+
+            return carry;
+        }
+
+        Limb subtractMultiplyByLimb(Limb* result, const Limb* a,
+                std::size_t size, Limb factor)
+        {
+            Limb borrow = 0;
+            for (std::size_t i = 0; i < size; i++)
+            {
+                DoubleLimb product = static_cast<DoubleLimb>(a[i]) * factor
+                    + borrow;
+                Limb low = static_cast<Limb>(product);
+                borrow = static_cast<Limb>(product >> 64) + (result[i] < low);
+                result[i] -= low;
+            }
+
+            return borrow;
+        }
+
+        Limb shiftLeftLimbs(Limb* result, const Limb* a, std::size_t size,
+                unsigned int bits)
+        {
+            Limb shiftedOut = 0;
+            for (std::size_t i = size; i-- > 0;)
+            {
+                Limb limb = a[i];
+                if (i == size - 1)
+                    shiftedOut = limb >> (64 - bits);
+                Limb below = i > 0 ? a[i - 1] >> (64 - bits) : 0;
+                result[i] = (limb << bits) | below;
+            }
+
+            return shiftedOut;
+        }
+
+        Limb shiftRightLimbs(Limb* result, const Limb* a, std::size_t size,
+                unsigned int bits)
+        {
+            Limb shiftedOut = size > 0 ? a[0] << (64 - bits) : 0;
+            for (std::size_t i = 0; i < size; i++)
+            {
+                Limb above = i + 1 < size ? a[i + 1] << (64 - bits) : 0;
+                result[i] = (a[i] >> bits) | above;
+            }
+
+            return shiftedOut;
+        }
+
+        int compareLimbs(const Limb* a, const Limb* b, std::size_t size)
+        {
+            for (std::size_t i = size; i-- > 0;)
+            {
+                if (a[i] != b[i])
+                    return a[i] < b[i] ? -1 : 1;
+            }
+
+            return 0;
+        }
+
+        std::size_t normalizedSize(const Limb* a, std::size_t size)
+        {
+            while (size > 0 && a[size - 1] == 0)
+                size--;
+            return size;
+        }
+
+        void combineLimbs(Limb* result, const Limb* a, const Limb* b,
+                std::size_t size, BitOperation operation)
+        {
+            switch (operation)
+            {
+                case BIT_AND:
+                    for (std::size_t i = 0; i < size; i++)
+                        result[i] = a[i] & b[i];
+                    break;
+                case BIT_OR:
+                    for (std::size_t i = 0; i < size; i++)
+                        result[i] = a[i] | b[i];
+                    break;
+                case BIT_XOR:
+                    for (std::size_t i = 0; i < size; i++)
+                        result[i] = a[i] ^ b[i];
+                    break;
+                case BIT_AND_NOT:
+                    for (std::size_t i = 0; i < size; i++)
+                        result[i] = a[i] & ~b[i];
+                    break;
+            }
+        }
+    }
+
+    Limb divideByLimb(Limb* quotient, const Limb* a, std::size_t size,
+            Limb divisor)
+    {
+        DoubleLimb remainder = 0;
+        for (std::size_t i = size; i-- > 0;)
+        {
+            DoubleLimb current = (remainder << 64) | a[i];
+            Limb quotientLimb = static_cast<Limb>(current / divisor);
+            remainder = static_cast<Limb>(current) - quotientLimb * divisor;
+            if (quotient)
+                quotient[i] = quotientLimb;
+        }
+
+        return static_cast<Limb>(remainder);
+    }
+
+    KernelTable kernels =
+    {
+        Portable::addLimbs, Portable::subtractLimbs, Portable::multiplyByLimb,
+        Portable::addMultiplyByLimb, Portable::subtractMultiplyByLimb,
+        Portable::shiftLeftLimbs, Portable::shiftRightLimbs,
+        Portable::compareLimbs, Portable::normalizedSize,
+        Portable::combineLimbs
+    };
+
+    namespace
+    {
+        std::string& selectedName()
+        {
+            static std::string name = "portable";
+            return name;
+        }
+
+        /*
+         * Return every kernel set the CPU supports, fastest first. The
+         * carrying kernels and the vector ones are chosen independently.
+        */
+
+        std::vector<std::string> supportedKernels()
+        {
+            std::vector<std::string> carrying;
+            std::vector<std::string> vector;
+#if defined(__x86_64__)
+            if (X86::hasAdx())
+                carrying.push_back("adx");
+            if (X86::hasAvx2())
+                vector.push_back("avx2");
+            if (X86::hasAvx512())
+                vector.push_back("avx512");
+#endif
+
+            std::vector<std::string> names;
+            for (std::size_t i = carrying.size() + 1; i-- > 0;)
+            {
+                for (std::size_t j = vector.size() + 1; j-- > 0;)
+                {
+                    std::string name = i > 0 ? carrying[i - 1] : "";
+                    if (j > 0)
+                        name += (name.empty() ? "" : "+") + vector[j - 1];
+                    names.push_back(name.empty() ? "portable" : name);
+                }
+            }
+            return names;
+        }
+
+        /*
+         * Pick the kernels at startup. Running before main() is safe
+         * because the table is filled with the portable kernels before
+         * any code runs at all.
+        */
+
+        bool selectStartupKernels()
+        {
+            const char* name = std::getenv("BIGINT_KERNELS");
+            if (name && selectKernels(name))
+                return true;
+            return selectKernels(supportedKernels().front());
+        }
+
+        const bool startupKernelsSelected = selectStartupKernels();
+    }
+
+    bool selectKernels(const std::string& name)
+    {
+        std::vector<std::string> supported = supportedKernels();
+        if (std::find(supported.begin(), supported.end(), name) ==
+                supported.end())
+            return false;
+
+        KernelTable table;
+        table.addLimbs = Portable::addLimbs;
+        table.subtractLimbs = Portable::subtractLimbs;
+        table.multiplyByLimb = Portable::multiplyByLimb;
+        table.addMultiplyByLimb = Portable::addMultiplyByLimb;
+        table.subtractMultiplyByLimb = Portable::subtractMultiplyByLimb;
+        table.shiftLeftLimbs = Portable::shiftLeftLimbs;
+        table.shiftRightLimbs = Portable::shiftRightLimbs;
+        table.compareLimbs = Portable::compareLimbs;
+        table.normalizedSize = Portable::normalizedSize;
+        table.combineLimbs = Portable::combineLimbs;
+
+#if defined(__x86_64__)
+        std::string::size_type plus = name.find('+');
+        std::string first = name.substr(0, plus);
+        std::string vector = (plus == std::string::npos) ? first :
+            name.substr(plus + 1);
+
+        if (first == "adx")
+        {
+            table.addLimbs = X86::addLimbs;
+            table.subtractLimbs = X86::subtractLimbs;
+            table.multiplyByLimb = X86::multiplyByLimb;
+            table.addMultiplyByLimb = X86::addMultiplyByLimb;
+            table.subtractMultiplyByLimb = X86::subtractMultiplyByLimb;
+        }
+
+        if (vector == "avx2")
+        {
+            table.shiftLeftLimbs = X86::shiftLeftLimbsAvx2;
+            table.shiftRightLimbs = X86::shiftRightLimbsAvx2;
+            table.compareLimbs = X86::compareLimbsAvx2;
+            table.normalizedSize = X86::normalizedSizeAvx2;
+            table.combineLimbs = X86::combineLimbsAvx2;
+        }
+        else if (vector == "avx512")
+        {
+            table.shiftLeftLimbs = X86::shiftLeftLimbsAvx512;
+            table.shiftRightLimbs = X86::shiftRightLimbsAvx512;
+            table.compareLimbs = X86::compareLimbsAvx512;
+            table.normalizedSize = X86::normalizedSizeAvx512;
+            table.combineLimbs = X86::combineLimbsAvx512;
+        }
+#endif
+
+        kernels = table;
+        selectedName() = name;
+        return true;
+    }
+
+    const std::string& selectedKernels()
+    {
+        return selectedName();
+    }
+
+    std::vector<std::string> availableKernels()
+    {
+        return supportedKernels();
+    }
+}
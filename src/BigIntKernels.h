@@ -0,0 +1,336 @@
+#ifndef BIGINT_KERNELS_H
+#define BIGINT_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "BigIntMemory.h"
+
+/*
+ * Low-level routines on little-endian arrays of 64-bit limbs, shared by
+ * the BigInt implementation files. Nothing in here is part of the public
+ * interface of the library.
+ *
+ * Unless noted otherwise, sizes are in limbs, operands may carry high zero
+ * limbs, and outputs must not overlap inputs.
+*/
+
+namespace BigIntKernels
+{
+    typedef std::uint64_t Limb;
+    __extension__ typedef unsigned __int128 DoubleLimb;
+
+    // Scratch space comes from a pool kept by each thread, so the buffers
+    // that multiplication and division use at every level of recursion
+    // are recycled instead of being returned to the global heap
+    void* allocateScratch(std::size_t bytes);
+    void deallocateScratch(void* memory, std::size_t bytes);
+
+    // Sends this thread's scratch space to \a pool for as long as it
+    // lives, so that a BigIntWorkspace can hold on to it between calls
+    class ScratchScope
+    {
+        public:
+            explicit ScratchScope(BigIntPool& pool);
+            ~ScratchScope();
+
+            ScratchScope(const ScratchScope&) = delete;
+            ScratchScope& operator=(const ScratchScope&) = delete;
+
+        private:
+            BigIntPool* previous;
+    };
+
+    template <typename T>
+    struct ScratchAllocator
+    {
+        typedef T value_type;
+
+        ScratchAllocator() {}
+
+        template <typename U>
+        ScratchAllocator(const ScratchAllocator<U>&) {}
+
+        T* allocate(std::size_t count)
+        {
+            return static_cast<T*>(allocateScratch(count * sizeof(T)));
+        }
+
+        void deallocate(T* memory, std::size_t count)
+        {
+            deallocateScratch(memory, count * sizeof(T));
+        }
+    };
+
+    template <typename T, typename U>
+    bool operator==(const ScratchAllocator<T>&, const ScratchAllocator<U>&)
+    {
+        return true;
+    }
+
+    template <typename T, typename U>
+    bool operator!=(const ScratchAllocator<T>&, const ScratchAllocator<U>&)
+    {
+        return false;
+    }
+
+    // Temporary limb storage used inside the algorithms
+    typedef std::vector<Limb, ScratchAllocator<Limb>> ScratchVector;
+
+    // Limbs that become the value of a BigInt, from the thread's current
+    // BigIntMemoryResource
+    typedef std::vector<Limb, BigIntAllocator<Limb>> LimbVector;
+
+    // The operations that combineLimbs applies to each pair of limbs
+    enum BitOperation
+    {
+        BIT_AND,
+        BIT_OR,
+        BIT_XOR,
+        // a & ~b
+        BIT_AND_NOT
+    };
+
+    // The kernels below are the inner loops of everything else, so each
+    // has a portable version and, on x86-64, versions that use instruction
+    // set extensions. Calls go through this table, which starts out with
+    // the portable versions and is switched to the fastest set the CPU
+    // supports before main() runs.
+    struct KernelTable
+    {
+        Limb (*addLimbs)(Limb*, const Limb*, std::size_t, const Limb*,
+                std::size_t);
+        Limb (*subtractLimbs)(Limb*, const Limb*, std::size_t, const Limb*,
+                std::size_t);
+        Limb (*multiplyByLimb)(Limb*, const Limb*, std::size_t, Limb);
+        Limb (*addMultiplyByLimb)(Limb*, const Limb*, std::size_t, Limb);
+        Limb (*subtractMultiplyByLimb)(Limb*, const Limb*, std::size_t,
+                Limb);
+        Limb (*shiftLeftLimbs)(Limb*, const Limb*, std::size_t,
+                unsigned int);
+        Limb (*shiftRightLimbs)(Limb*, const Limb*, std::size_t,
+                unsigned int);
+        int (*compareLimbs)(const Limb*, const Limb*, std::size_t);
+        std::size_t (*normalizedSize)(const Limb*, std::size_t);
+        void (*combineLimbs)(Limb*, const Limb*, const Limb*, std::size_t,
+                BitOperation);
+    };
+
+    extern KernelTable kernels;
+
+    // Install the kernel set called name, which is "portable" or the
+    // extensions it uses joined by '+', such as "adx+avx2". Returns false,
+    // changing nothing, if the name is unknown or the CPU lacks one of the
+    // extensions.
+    bool selectKernels(const std::string& name);
+    const std::string& selectedKernels();
+    std::vector<std::string> availableKernels();
+
+    // Store a + b in result and return the carry. Requires
+    // aSize >= bSize; result may alias a or b.
+    inline Limb addLimbs(Limb* result, const Limb* a, std::size_t aSize,
+            const Limb* b, std::size_t bSize)
+    {
+        return kernels.addLimbs(result, a, aSize, b, bSize);
+    }
+
+    // Store a - b in result and return the borrow. Requires
+    // aSize >= bSize; result may alias a or b.
+    inline Limb subtractLimbs(Limb* result, const Limb* a,
+            std::size_t aSize, const Limb* b, std::size_t bSize)
+    {
+        return kernels.subtractLimbs(result, a, aSize, b, bSize);
+    }
+
+    // Store a * factor in result and return the high limb. result may
+    // alias a.
+    inline Limb multiplyByLimb(Limb* result, const Limb* a,
+            std::size_t size, Limb factor)
+    {
+        return kernels.multiplyByLimb(result, a, size, factor);
+    }
+
+    // Add a * factor to result and return the carry out of the top limb.
+    inline Limb addMultiplyByLimb(Limb* result, const Limb* a,
+            std::size_t size, Limb factor)
+    {
+        return kernels.addMultiplyByLimb(result, a, size, factor);
+    }
+
+    // Subtract a * factor from result and return the borrow out of the
+    // top limb.
+    inline Limb subtractMultiplyByLimb(Limb* result, const Limb* a,
+            std::size_t size, Limb factor)
+    {
+        return kernels.subtractMultiplyByLimb(result, a, size, factor);
+    }
+
+    // Store a << bits in result and return the bits shifted out of the top
+    // limb. Requires 0 < bits < 64; result may be a or lie above it.
+    inline Limb shiftLeftLimbs(Limb* result, const Limb* a,
+            std::size_t size, unsigned int bits)
+    {
+        return kernels.shiftLeftLimbs(result, a, size, bits);
+    }
+
+    // Store a >> bits in result and return the bits shifted out of the
+    // bottom limb, in the high end of the returned limb. Requires
+    // 0 < bits < 64; result may be a or lie below it.
+    inline Limb shiftRightLimbs(Limb* result, const Limb* a,
+            std::size_t size, unsigned int bits)
+    {
+        return kernels.shiftRightLimbs(result, a, size, bits);
+    }
+
+    // Compare two arrays of the same size as unsigned numbers.
+    inline int compareLimbs(const Limb* a, const Limb* b, std::size_t size)
+    {
+        return kernels.compareLimbs(a, b, size);
+    }
+
+    // The size of a once its high zero limbs are ignored.
+    inline std::size_t normalizedSize(const Limb* a, std::size_t size)
+    {
+        return kernels.normalizedSize(a, size);
+    }
+
+    // Store a operation b in result, one limb at a time. result may alias
+    // a or b.
+    inline void combineLimbs(Limb* result, const Limb* a, const Limb* b,
+            std::size_t size, BitOperation operation)
+    {
+        kernels.combineLimbs(result, a, b, size, operation);
+    }
+
+    // The portable versions of the kernels above
+    namespace Portable
+    {
+        Limb addLimbs(Limb* result, const Limb* a, std::size_t aSize,
+                const Limb* b, std::size_t bSize);
+        Limb subtractLimbs(Limb* result, const Limb* a, std::size_t aSize,
+                const Limb* b, std::size_t bSize);
+        Limb multiplyByLimb(Limb* result, const Limb* a, std::size_t size,
+                Limb factor);
+        Limb addMultiplyByLimb(Limb* result, const Limb* a,
+                std::size_t size, Limb factor);
+        Limb subtractMultiplyByLimb(Limb* result, const Limb* a,
+                std::size_t size, Limb factor);
+        Limb shiftLeftLimbs(Limb* result, const Limb* a, std::size_t size,
+                unsigned int bits);
+        Limb shiftRightLimbs(Limb* result, const Limb* a, std::size_t size,
+                unsigned int bits);
+        int compareLimbs(const Limb* a, const Limb* b, std::size_t size);
+        std::size_t normalizedSize(const Limb* a, std::size_t size);
+        void combineLimbs(Limb* result, const Limb* a, const Limb* b,
+                std::size_t size, BitOperation operation);
+    }
+
+#if defined(__x86_64__)
+    // Versions for x86-64, in BigIntKernelsX86.cpp. The adx kernels carry
+    // with adc, sbb and the two independent carry chains of adcx and adox
+    // on products from mulx, so they also need BMI2. The avx2 and avx512
+    // kernels shift, compare and combine several limbs at a time.
+    namespace X86
+    {
+        bool hasAdx();
+        bool hasAvx2();
+        bool hasAvx512();
+
+        Limb addLimbs(Limb* result, const Limb* a, std::size_t aSize,
+                const Limb* b, std::size_t bSize);
+        Limb subtractLimbs(Limb* result, const Limb* a, std::size_t aSize,
+                const Limb* b, std::size_t bSize);
+        Limb multiplyByLimb(Limb* result, const Limb* a, std::size_t size,
+                Limb factor);
+        Limb addMultiplyByLimb(Limb* result, const Limb* a,
+                std::size_t size, Limb factor);
+        Limb subtractMultiplyByLimb(Limb* result, const Limb* a,
+                std::size_t size, Limb factor);
+
+        Limb shiftLeftLimbsAvx2(Limb* result, const Limb* a,
+                std::size_t size, unsigned int bits);
+        Limb shiftRightLimbsAvx2(Limb* result, const Limb* a,
+                std::size_t size, unsigned int bits);
+        int compareLimbsAvx2(const Limb* a, const Limb* b, std::size_t size);
+        std::size_t normalizedSizeAvx2(const Limb* a, std::size_t size);
+        void combineLimbsAvx2(Limb* result, const Limb* a, const Limb* b,
+                std::size_t size, BitOperation operation);
+
+        Limb shiftLeftLimbsAvx512(Limb* result, const Limb* a,
+                std::size_t size, unsigned int bits);
+        Limb shiftRightLimbsAvx512(Limb* result, const Limb* a,
+                std::size_t size, unsigned int bits);
+        int compareLimbsAvx512(const Limb* a, const Limb* b,
+                std::size_t size);
+        std::size_t normalizedSizeAvx512(const Limb* a, std::size_t size);
+        void combineLimbsAvx512(Limb* result, const Limb* a,
+                const Limb* b, std::size_t size, BitOperation operation);
+    }
+#endif
+
+    // Store a / divisor in quotient and return the remainder. quotient
+    // may alias a, or be null when only the remainder is needed.
+    Limb divideByLimb(Limb* quotient, const Limb* a, std::size_t size,
+            Limb divisor);
+
+    // Store a * b in result, which has room for aSize + bSize limbs.
+    // Requires aSize >= bSize >= 1.
+    void multiplyLimbs(Limb* result, const Limb* a, std::size_t aSize,
+            const Limb* b, std::size_t bSize);
+
+    // Store a * a in result, which has room for 2 * size limbs. Requires
+    // size >= 1. multiplyLimbs comes here when both operands are the same
+    // array.
+    void squareLimbs(Limb* result, const Limb* a, std::size_t size);
+
+    // Divide a by b, storing the aSize - bSize + 1 quotient limbs in
+    // quotient and the bSize remainder limbs in remainder. Requires
+    // aSize >= bSize >= 2 and a nonzero top limb in b. Either output may be
+    // null if it is not wanted. Both operands are copied into scratch space
+    // before anything is written, so one of the outputs may be a itself.
+    void divideLimbs(Limb* quotient, Limb* remainder, const Limb* a,
+            std::size_t aSize, const Limb* b, std::size_t bSize);
+
+    // An upper bound on the number of decimal digits of a, and at most
+    // one more than the exact count.
+    std::size_t decimalDigitsBound(const Limb* a, std::size_t size);
+
+    // Write a into out as exactly width decimal digits, padded with
+    // leading zeros. Requires a < 10^width.
+    void limbsToDecimal(char* out, std::size_t width, const Limb* a,
+            std::size_t size);
+
+    // Parse count decimal digits, which the caller has checked, into a
+    // magnitude without high zero limbs.
+    LimbVector decimalToLimbs(const char* digits, std::size_t count);
+
+    // multiplyLimbs by number-theoretic transform, for any sizes of at
+    // least one limb. Squares with a single forward transform when a and
+    // b are the same array.
+    void multiplyNtt(Limb* result, const Limb* a, std::size_t aSize,
+            const Limb* b, std::size_t bSize);
+
+    // Replace the worker pool with one that runs tasks on threads threads,
+    // counting the caller. One thread, or none, runs everything inline.
+    void setWorkerThreads(std::size_t threads);
+
+    // Run task(i) for every i below count, spread over the worker pool,
+    // and return once they have all finished. Tasks may call runParallel
+    // themselves. The first exception a task throws is rethrown here.
+    void runParallel(std::size_t count,
+            const std::function<void(std::size_t)>& task);
+
+    // runParallel if parallel is set, and a plain loop on this thread
+    // otherwise.
+    void runTasks(std::size_t count, bool parallel,
+            const std::function<void(std::size_t)>& task);
+
+    // Whether an operation whose smaller operand has size limbs should be
+    // split across threads.
+    bool useParallel(std::size_t size);
+}
+
+#endif
@@ -0,0 +1,618 @@
+#include "BigIntKernels.h"
+
+/*
+ * Limb kernels for x86-64. The carrying kernels are inline assembly, since
+ * compilers do not keep a carry in the flags across loop iterations, let
+ * alone two of them. The vector kernels are compiled for their instruction
+ * sets with target attributes, so the rest of the library still runs on
+ * any x86-64 CPU; they are only called once CPUID has shown the
+ * extensions to be there.
+*/
+
+#if defined(__x86_64__)
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+namespace BigIntKernels
+{
+    namespace X86
+    {
+        namespace
+        {
+            struct Features
+            {
+                bool adx;
+                bool avx2;
+                bool avx512;
+            };
+
+            /*
+             * Read the extensions from CPUID. The vector ones also need
+             * the operating system to save their registers, which XGETBV
+             * reports.
+            */
+
+            Features detectFeatures()
+            {
+                Features features = {false, false, false};
+                unsigned int eax, ebx, ecx, edx;
+                if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+                    return features;
+                bool osxsave = (ecx & bit_OSXSAVE) != 0;
+
+                if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+                    return features;
+                features.adx = (ebx & bit_ADX) && (ebx & bit_BMI2);
+
+                if (!osxsave)
+                    return features;
+                unsigned int xcrLow, xcrHigh;
+                __asm__("xgetbv" : "=a"(xcrLow), "=d"(xcrHigh) : "c"(0));
+                bool avxState = (xcrLow & 0x6) == 0x6;
+                bool avx512State = (xcrLow & 0xe6) == 0xe6;
+
+                features.avx2 = avxState && (ebx & bit_AVX2);
+                features.avx512 = avx512State && (ebx & bit_AVX512F);
+                return features;
+            }
+
+            const Features& features()
+            {
+                static const Features detected = detectFeatures();
+                return detected;
+            }
+        }
+
+        bool hasAdx()
+        {
+            return features().adx;
+        }
+
+        bool hasAvx2()
+        {
+            return features().avx2;
+        }
+
+        bool hasAvx512()
+        {
+            return features().avx512;
+        }
+
+        /*
+         * The assembly loops below handle four limbs per iteration and
+         * finish the rest in C, passing the carry on. Loop counters are
+         * stepped with lea and tested with jrcxz, or with dec where only
+         * the carry flag matters, so the carries stay in the flags.
+        */
+
+        Limb addLimbs(Limb* result, const Limb* a, std::size_t aSize,
+                const Limb* b, std::size_t bSize)
+        {
+            std::size_t blocks = bSize / 4;
+            std::size_t done = 4 * blocks;
+            Limb carry = 0;
+            if (blocks > 0)
+            {
+                Limb* r = result;
+                const Limb* x = a;
+                const Limb* y = b;
+                __asm__ volatile(
+                    "xor %k[carry], %k[carry]\n\t"
+                    "1:\n\t"
+                    "movq (%[x]), %%r8\n\t"
+                    "adcq (%[y]), %%r8\n\t"
+                    "movq %%r8, (%[r])\n\t"
+                    "movq 8(%[x]), %%r8\n\t"
+                    "adcq 8(%[y]), %%r8\n\t"
+                    "movq %%r8, 8(%[r])\n\t"
+                    "movq 16(%[x]), %%r8\n\t"
+                    "adcq 16(%[y]), %%r8\n\t"
+                    "movq %%r8, 16(%[r])\n\t"
+                    "movq 24(%[x]), %%r8\n\t"
+                    "adcq 24(%[y]), %%r8\n\t"
+                    "movq %%r8, 24(%[r])\n\t"
+                    "leaq 32(%[x]), %[x]\n\t"
+                    "leaq 32(%[y]), %[y]\n\t"
+                    "leaq 32(%[r]), %[r]\n\t"
+                    "decq %[blocks]\n\t"
+                    "jnz 1b\n\t"
+                    "setc %b[carry]"
+                    : [carry] "=&r"(carry), [r] "+r"(r), [x] "+r"(x),
+                      [y] "+r"(y), [blocks] "+r"(blocks)
+                    :
+                    : "r8", "cc", "memory");
+            }
+
+            std::size_t i = done;
+            for (; i < bSize; i++)
+            {
+                DoubleLimb sum = static_cast<DoubleLimb>(a[i]) + b[i] + carry;
+                result[i] = static_cast<Limb>(sum);
+                carry = static_cast<Limb>(sum >> 64);
+            }
+            for (; i < aSize; i++)
+            {
+                Limb sum = a[i] + carry;
+                carry = (sum < carry);
+                result[i] = sum;
+            }
+            return carry;
+        }
+
+        Limb subtractLimbs(Limb* result, const Limb* a, std::size_t aSize,
+                const Limb* b, std::size_t bSize)
+        {
+            std::size_t blocks = bSize / 4;
+            std::size_t done = 4 * blocks;
+            Limb borrow = 0;
+            if (blocks > 0)
+            {
+                Limb* r = result;
+                const Limb* x = a;
+                const Limb* y = b;
+                __asm__ volatile(
+                    "xor %k[borrow], %k[borrow]\n\t"
+                    "1:\n\t"
+                    "movq (%[x]), %%r8\n\t"
+                    "sbbq (%[y]), %%r8\n\t"
+                    "movq %%r8, (%[r])\n\t"
+                    "movq 8(%[x]), %%r8\n\t"
+                    "sbbq 8(%[y]), %%r8\n\t"
+                    "movq %%r8, 8(%[r])\n\t"
+                    "movq 16(%[x]), %%r8\n\t"
+                    "sbbq 16(%[y]), %%r8\n\t"
+                    "movq %%r8, 16(%[r])\n\t"
+                    "movq 24(%[x]), %%r8\n\t"
+                    "sbbq 24(%[y]), %%r8\n\t"
+                    "movq %%r8, 24(%[r])\n\t"
+                    "leaq 32(%[x]), %[x]\n\t"
+                    "leaq 32(%[y]), %[y]\n\t"
+                    "leaq 32(%[r]), %[r]\n\t"
+                    "decq %[blocks]\n\t"
+                    "jnz 1b\n\t"
+                    "setc %b[borrow]"
+                    : [borrow] "=&r"(borrow), [r] "+r"(r), [x] "+r"(x),
+                      [y] "+r"(y), [blocks] "+r"(blocks)
+                    :
+                    : "r8", "cc", "memory");
+            }
+
+            std::size_t i = done;
+            for (; i < bSize; i++)
+            {
+                DoubleLimb difference = static_cast<DoubleLimb>(a[i]) - b[i]
+                    - borrow;
+                result[i] = static_cast<Limb>(difference);
+                borrow = static_cast<Limb>(difference >> 64) & 1;
+            }
+            for (; i < aSize; i++)
+            {
+                Limb difference = a[i] - borrow;
+                borrow = (a[i] < borrow);
+                result[i] = difference;
+            }
+            return borrow;
+        }
+
+        /*
+         * mulx takes its multiplier in rdx and leaves the flags alone, so
+         * one adc chain adds each high limb to the next low one.
+        */
+
+        Limb multiplyByLimb(Limb* result, const Limb* a, std::size_t size,
+                Limb factor)
+        {
+            std::size_t blocks = size / 4;
+            std::size_t done = 4 * blocks;
+            Limb carry = 0;
+            if (blocks > 0)
+            {
+                Limb* r = result;
+                const Limb* x = a;
+                __asm__ volatile(
+                    "xor %k[carry], %k[carry]\n\t"
+                    "1:\n\t"
+                    "mulxq (%[x]), %%r8, %%r9\n\t"
+                    "adcq %[carry], %%r8\n\t"
+                    "movq %%r8, (%[r])\n\t"
+                    "mulxq 8(%[x]), %%r8, %[carry]\n\t"
+                    "adcq %%r9, %%r8\n\t"
+                    "movq %%r8, 8(%[r])\n\t"
+                    "mulxq 16(%[x]), %%r8, %%r9\n\t"
+                    "adcq %[carry], %%r8\n\t"
+                    "movq %%r8, 16(%[r])\n\t"
+                    "mulxq 24(%[x]), %%r8, %[carry]\n\t"
+                    "adcq %%r9, %%r8\n\t"
+                    "movq %%r8, 24(%[r])\n\t"
+                    "leaq 32(%[x]), %[x]\n\t"
+                    "leaq 32(%[r]), %[r]\n\t"
+                    "decq %[blocks]\n\t"
+                    "jnz 1b\n\t"
+                    "adcq $0, %[carry]"
+                    : [carry] "=&r"(carry), [r] "+r"(r), [x] "+r"(x),
+                      [blocks] "+r"(blocks)
+                    : "d"(factor)
+                    : "r8", "r9", "cc", "memory");
+            }
+
+            for (std::size_t i = done; i < size; i++)
+            {
+                DoubleLimb product = static_cast<DoubleLimb>(a[i]) * factor
+                    + carry;
+                result[i] = static_cast<Limb>(product);
+                carry = static_cast<Limb>(product >> 64);
+            }
+            return carry;
+        }
+
+        /*
+         * The low halves of the products are added to result on the
+         * adcx chain, and the high halves to the next limb on the adox
+         * chain, so neither addition waits for the other.
+        */
+
+        Limb addMultiplyByLimb(Limb* result, const Limb* a,
+                std::size_t size, Limb factor)
+        {
+            std::size_t blocks = size / 4;
+            std::size_t done = 4 * blocks;
+            Limb carry = 0;
+            if (blocks > 0)
+            {
+                Limb* r = result;
+                const Limb* x = a;
+                __asm__ volatile(
+                    "xor %k[carry], %k[carry]\n\t"
+                    "1:\n\t"
+                    "mulxq (%[x]), %%r8, %%r9\n\t"
+                    "adcxq (%[r]), %%r8\n\t"
+                    "adoxq %[carry], %%r8\n\t"
+                    "movq %%r8, (%[r])\n\t"
+                    "mulxq 8(%[x]), %%r8, %[carry]\n\t"
+                    "adcxq 8(%[r]), %%r8\n\t"
+                    "adoxq %%r9, %%r8\n\t"
+                    "movq %%r8, 8(%[r])\n\t"
+                    "mulxq 16(%[x]), %%r8, %%r9\n\t"
+                    "adcxq 16(%[r]), %%r8\n\t"
+                    "adoxq %[carry], %%r8\n\t"
+                    "movq %%r8, 16(%[r])\n\t"
+                    "mulxq 24(%[x]), %%r8, %[carry]\n\t"
+                    "adcxq 24(%[r]), %%r8\n\t"
+                    "adoxq %%r9, %%r8\n\t"
+                    "movq %%r8, 24(%[r])\n\t"
+                    "leaq 32(%[x]), %[x]\n\t"
+                    "leaq 32(%[r]), %[r]\n\t"
+                    "leaq -1(%%rcx), %%rcx\n\t"
+                    "jrcxz 2f\n\t"
+                    "jmp 1b\n\t"
+                    "2:\n\t"
+                    "movl $0, %%r8d\n\t"
+                    "adcxq %%r8, %[carry]\n\t"
+                    "adoxq %%r8, %[carry]"
+                    : [carry] "=&r"(carry), [r] "+r"(r), [x] "+r"(x),
+                      "+c"(blocks)
+                    : "d"(factor)
+                    : "r8", "r9", "cc", "memory");
+            }
+
+            for (std::size_t i = done; i < size; i++)
+            {
+                DoubleLimb product = static_cast<DoubleLimb>(a[i]) * factor
+                    + result[i] + carry;
+                result[i] = static_cast<Limb>(product);
+                carry = static_cast<Limb>(product >> 64);
+            }
+            return carry;
+        }
+
+        /*
+         * The products are summed on the adox chain and subtracted on the
+         * adcx chain, which has no borrowing form; r - t is computed as
+         * ~(~r + t) instead, and not leaves the flags alone.
+        */
+
+        Limb subtractMultiplyByLimb(Limb* result, const Limb* a,
+                std::size_t size, Limb factor)
+        {
+            std::size_t blocks = size / 4;
+            std::size_t done = 4 * blocks;
+            Limb borrow = 0;
+            if (blocks > 0)
+            {
+                Limb* r = result;
+                const Limb* x = a;
+                __asm__ volatile(
+                    "xor %k[borrow], %k[borrow]\n\t"
+                    "1:\n\t"
+                    "mulxq (%[x]), %%r8, %%r9\n\t"
+                    "adoxq %[borrow], %%r8\n\t"
+                    "movq (%[r]), %%r10\n\t"
+                    "notq %%r10\n\t"
+                    "adcxq %%r8, %%r10\n\t"
+                    "notq %%r10\n\t"
+                    "movq %%r10, (%[r])\n\t"
+                    "mulxq 8(%[x]), %%r8, %[borrow]\n\t"
+                    "adoxq %%r9, %%r8\n\t"
+                    "movq 8(%[r]), %%r10\n\t"
+                    "notq %%r10\n\t"
+                    "adcxq %%r8, %%r10\n\t"
+                    "notq %%r10\n\t"
+                    "movq %%r10, 8(%[r])\n\t"
+                    "mulxq 16(%[x]), %%r8, %%r9\n\t"
+                    "adoxq %[borrow], %%r8\n\t"
+                    "movq 16(%[r]), %%r10\n\t"
+                    "notq %%r10\n\t"
+                    "adcxq %%r8, %%r10\n\t"
+                    "notq %%r10\n\t"
+                    "movq %%r10, 16(%[r])\n\t"
+                    "mulxq 24(%[x]), %%r8, %[borrow]\n\t"
+                    "adoxq %%r9, %%r8\n\t"
+                    "movq 24(%[r]), %%r10\n\t"
+                    "notq %%r10\n\t"
+                    "adcxq %%r8, %%r10\n\t"
+                    "notq %%r10\n\t"
+                    "movq %%r10, 24(%[r])\n\t"
+                    "leaq 32(%[x]), %[x]\n\t"
+                    "leaq 32(%[r]), %[r]\n\t"
+                    "leaq -1(%%rcx), %%rcx\n\t"
+                    "jrcxz 2f\n\t"
+                    "jmp 1b\n\t"
+                    "2:\n\t"
+                    "movl $0, %%r8d\n\t"
+                    "adcxq %%r8, %[borrow]\n\t"
+                    "adoxq %%r8, %[borrow]"
+                    : [borrow] "=&r"(borrow), [r] "+r"(r), [x] "+r"(x),
+                      "+c"(blocks)
+                    : "d"(factor)
+                    : "r8", "r9", "r10", "cc", "memory");
+            }
+
+            for (std::size_t i = done; i < size; i++)
+            {
+                DoubleLimb product = static_cast<DoubleLimb>(a[i]) * factor
+                    + borrow;
+                Limb low = static_cast<Limb>(product);
+                borrow = static_cast<Limb>(product >> 64) + (result[i] < low);
+                result[i] -= low;
+            }
+            return borrow;
+        }
+
+        /*
+         * Each vector of the result combines a vector of a with the one a
+         * limb below or above it, both loaded before anything is stored,
+         * which keeps the overlaps the portable shifts allow.
+        */
+
+        __attribute__((target("avx2")))
+        Limb shiftLeftLimbsAvx2(Limb* result, const Limb* a,
+                std::size_t size, unsigned int bits)
+        {
+            if (size == 0)
+                return 0;
+
+            Limb shiftedOut = a[size - 1] >> (64 - bits);
+            __m128i up = _mm_cvtsi32_si128(bits);
+            __m128i down = _mm_cvtsi32_si128(64 - bits);
+
+            std::size_t i = size;
+            for (; i >= 5; i -= 4)
+            {
+                __m256i limbs = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i*>(a + i - 4));
+                __m256i below = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i*>(a + i - 5));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(result + i - 4),
+                        _mm256_or_si256(_mm256_sll_epi64(limbs, up),
+                            _mm256_srl_epi64(below, down)));
+            }
+
+            for (; i-- > 1;)
+                result[i] = (a[i] << bits) | (a[i - 1] >> (64 - bits));
+            result[0] = a[0] << bits;
+            return shiftedOut;
+        }
+
+        __attribute__((target("avx2")))
+        Limb shiftRightLimbsAvx2(Limb* result, const Limb* a,
+                std::size_t size, unsigned int bits)
+        {
+            if (size == 0)
+                return 0;
+
+            Limb shiftedOut = a[0] << (64 - bits);
+            __m128i down = _mm_cvtsi32_si128(bits);
+            __m128i up = _mm_cvtsi32_si128(64 - bits);
+
+            std::size_t i = 0;
+            for (; i + 4 < size; i += 4)
+            {
+                __m256i limbs = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i*>(a + i));
+                __m256i above = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i*>(a + i + 1));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(result + i),
+                        _mm256_or_si256(_mm256_srl_epi64(limbs, down),
+                            _mm256_sll_epi64(above, up)));
+            }
+
+            for (; i + 1 < size; i++)
+                result[i] = (a[i] >> bits) | (a[i + 1] << (64 - bits));
+            result[size - 1] = a[size - 1] >> bits;
+            return shiftedOut;
+        }
+
+        __attribute__((target("avx2")))
+        int compareLimbsAvx2(const Limb* a, const Limb* b, std::size_t size)
+        {
+            // Skip equal vectors from the top, then let the scalar loop
+            // find the differing limb
+            while (size >= 4)
+            {
+                __m256i x = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i*>(a + size - 4));
+                __m256i y = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i*>(b + size - 4));
+                if (_mm256_movemask_epi8(_mm256_cmpeq_epi64(x, y)) != -1)
+                    break;
+                size -= 4;
+            }
+
+            return Portable::compareLimbs(a, b, size);
+        }
+
+        __attribute__((target("avx2")))
+        std::size_t normalizedSizeAvx2(const Limb* a, std::size_t size)
+        {
+            while (size >= 4)
+            {
+                __m256i x = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i*>(a + size - 4));
+                if (!_mm256_testz_si256(x, x))
+                    break;
+                size -= 4;
+            }
+
+            return Portable::normalizedSize(a, size);
+        }
+
+        __attribute__((target("avx2")))
+        void combineLimbsAvx2(Limb* result, const Limb* a, const Limb* b,
+                std::size_t size, BitOperation operation)
+        {
+            std::size_t i = 0;
+            for (; i + 4 <= size; i += 4)
+            {
+                __m256i x = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i*>(a + i));
+                __m256i y = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i*>(b + i));
+                __m256i combined =
+                    operation == BIT_AND ? _mm256_and_si256(x, y) :
+                    operation == BIT_OR ? _mm256_or_si256(x, y) :
+                    operation == BIT_XOR ? _mm256_xor_si256(x, y) :
+                    _mm256_andnot_si256(y, x);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(result + i),
+                        combined);
+            }
+
+            Portable::combineLimbs(result + i, a + i, b + i, size - i,
+                    operation);
+        }
+
+        // The shifts and the and-not are masked with every lane set, since
+        // the unmasked forms trip -Wmaybe-uninitialized inside GCC's own
+        // headers
+        const __mmask8 ALL_LANES = 0xff;
+
+        __attribute__((target("avx512f")))
+        Limb shiftLeftLimbsAvx512(Limb* result, const Limb* a,
+                std::size_t size, unsigned int bits)
+        {
+            if (size == 0)
+                return 0;
+
+            Limb shiftedOut = a[size - 1] >> (64 - bits);
+            __m128i up = _mm_cvtsi32_si128(bits);
+            __m128i down = _mm_cvtsi32_si128(64 - bits);
+
+            std::size_t i = size;
+            for (; i >= 9; i -= 8)
+            {
+                __m512i limbs = _mm512_loadu_si512(a + i - 8);
+                __m512i below = _mm512_loadu_si512(a + i - 9);
+                limbs = _mm512_maskz_sll_epi64(ALL_LANES, limbs, up);
+                below = _mm512_maskz_srl_epi64(ALL_LANES, below, down);
+                _mm512_storeu_si512(result + i - 8,
+                        _mm512_or_si512(limbs, below));
+            }
+
+            for (; i-- > 1;)
+                result[i] = (a[i] << bits) | (a[i - 1] >> (64 - bits));
+            result[0] = a[0] << bits;
+            return shiftedOut;
+        }
+
+        __attribute__((target("avx512f")))
+        Limb shiftRightLimbsAvx512(Limb* result, const Limb* a,
+                std::size_t size, unsigned int bits)
+        {
+            if (size == 0)
+                return 0;
+
+            Limb shiftedOut = a[0] << (64 - bits);
+            __m128i down = _mm_cvtsi32_si128(bits);
+            __m128i up = _mm_cvtsi32_si128(64 - bits);
+
+            std::size_t i = 0;
+            for (; i + 8 < size; i += 8)
+            {
+                __m512i limbs = _mm512_loadu_si512(a + i);
+                __m512i above = _mm512_loadu_si512(a + i + 1);
+                limbs = _mm512_maskz_srl_epi64(ALL_LANES, limbs, down);
+                above = _mm512_maskz_sll_epi64(ALL_LANES, above, up);
+                _mm512_storeu_si512(result + i,
+                        _mm512_or_si512(limbs, above));
+            }
+
+            for (; i + 1 < size; i++)
+                result[i] = (a[i] >> bits) | (a[i + 1] << (64 - bits));
+            result[size - 1] = a[size - 1] >> bits;
+            return shiftedOut;
+        }
+
+        __attribute__((target("avx512f")))
+        int compareLimbsAvx512(const Limb* a, const Limb* b,
+                std::size_t size)
+        {
+            while (size >= 8)
+            {
+                __m512i x = _mm512_loadu_si512(a + size - 8);
+                __m512i y = _mm512_loadu_si512(b + size - 8);
+                if (_mm512_cmpneq_epu64_mask(x, y) != 0)
+                    break;
+                size -= 8;
+            }
+
+            return Portable::compareLimbs(a, b, size);
+        }
+
+        __attribute__((target("avx512f")))
+        std::size_t normalizedSizeAvx512(const Limb* a, std::size_t size)
+        {
+            while (size >= 8)
+            {
+                __m512i x = _mm512_loadu_si512(a + size - 8);
+                if (_mm512_test_epi64_mask(x, x) != 0)
+                    break;
+                size -= 8;
+            }
+
+            return Portable::normalizedSize(a, size);
+        }
+
+        __attribute__((target("avx512f")))
+        void combineLimbsAvx512(Limb* result, const Limb* a,
+                const Limb* b, std::size_t size, BitOperation operation)
+        {
+            std::size_t i = 0;
+            for (; i + 8 <= size; i += 8)
+            {
+                __m512i x = _mm512_loadu_si512(a + i);
+                __m512i y = _mm512_loadu_si512(b + i);
+                __m512i combined =
+                    operation == BIT_AND ? _mm512_and_si512(x, y) :
+                    operation == BIT_OR ? _mm512_or_si512(x, y) :
+                    operation == BIT_XOR ? _mm512_xor_si512(x, y) :
+                    _mm512_maskz_andnot_epi64(ALL_LANES, y, x);
+                _mm512_storeu_si512(result + i, combined);
+            }
+
+            Portable::combineLimbs(result + i, a + i, b + i, size - i,
+                    operation);
+        }
+    }
+}
+
+#endif
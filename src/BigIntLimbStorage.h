@@ -0,0 +1,208 @@
+#ifndef BIGINT_LIMB_STORAGE_H
+#define BIGINT_LIMB_STORAGE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "BigIntMemory.h"
+
+/*!
+ * \class LimbStorage
+ *
+ * \brief The limbs of a BigInt, kept inline while there are at most two.
+ *
+ * Values up to 128 bits therefore never allocate. Once a value needs more
+ * limbs they move to a std::vector, and they stay there if the value
+ * shrinks again, so that a BigInt which is reused as an accumulator does
+ * not go back and forth between the two. Heap buffers are given one limb
+ * more than they need, so that a carry out of the top limb does not
+ * reallocate them.
+ *
+ * Heap buffers come from the BigIntMemoryResource that was current when
+ * the storage was constructed. The interface is the part of std::vector
+ * that BigInt uses, with pointers for iterators.
+*/
+
+class LimbStorage
+{
+    public:
+        typedef std::uint64_t Limb;
+        typedef std::vector<Limb, BigIntAllocator<Limb>> Vector;
+        static const std::size_t INLINE_LIMBS = 2;
+
+        LimbStorage() : count(0), onHeap(false), inlineLimbs() {}
+
+        LimbStorage(const LimbStorage& other) :
+            count(0), onHeap(false), inlineLimbs()
+        {
+            assign(other.begin(), other.end());
+        }
+
+        LimbStorage(LimbStorage&& other) noexcept :
+            count(0), onHeap(false), inlineLimbs()
+        {
+            swap(other);
+        }
+
+        LimbStorage& operator=(const LimbStorage& other)
+        {
+            if (this != &other)
+                assign(other.begin(), other.end());
+            return *this;
+        }
+
+        LimbStorage& operator=(LimbStorage&& other) noexcept
+        {
+            swap(other);
+            return *this;
+        }
+
+        LimbStorage& operator=(const Vector& limbs)
+        {
+            assign(limbs.data(), limbs.data() + limbs.size());
+            return *this;
+        }
+
+        /*!
+         * Take over the buffer of \a limbs, along with its allocator, if
+         * the value does not fit inline, so that results computed in a
+         * vector are not copied.
+        */
+        LimbStorage& operator=(Vector&& limbs)
+        {
+            if (limbs.size() <= INLINE_LIMBS)
+                return *this = static_cast<const Vector&>(limbs);
+
+            heap = std::move(limbs);
+            count = heap.size();
+            onHeap = true;
+            return *this;
+        }
+
+        void assign(const Limb* first, const Limb* last)
+        {
+            std::size_t newSize = last - first;
+            if (!onHeap && newSize <= INLINE_LIMBS)
+            {
+                std::copy(first, last, inlineLimbs);
+                count = newSize;
+                return;
+            }
+
+            if (!onHeap)
+                moveToHeap(newSize);
+            else if (heap.capacity() < newSize)
+            {
+                heap.clear();
+                heap.reserve(newSize + 1);
+            }
+            heap.assign(first, last);
+            count = newSize;
+        }
+
+        // The resource that heap buffers come from
+        BigIntMemoryResource* getResource() const
+        {
+            return heap.get_allocator().getResource();
+        }
+
+        std::size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+
+        Limb* data() { return onHeap ? heap.data() : inlineLimbs; }
+        const Limb* data() const
+        {
+            return onHeap ? heap.data() : inlineLimbs;
+        }
+
+        Limb* begin() { return data(); }
+        Limb* end() { return data() + count; }
+        const Limb* begin() const { return data(); }
+        const Limb* end() const { return data() + count; }
+
+        Limb& operator[](std::size_t i) { return data()[i]; }
+        const Limb& operator[](std::size_t i) const { return data()[i]; }
+        Limb& back() { return data()[count - 1]; }
+        const Limb& back() const { return data()[count - 1]; }
+
+        /*!
+         * Change the number of limbs, setting any new ones to zero.
+        */
+        void resize(std::size_t newSize)
+        {
+            if (onHeap)
+                heap.resize(newSize);
+            else if (newSize <= INLINE_LIMBS)
+            {
+                if (newSize > count)
+                    std::fill(inlineLimbs + count, inlineLimbs + newSize, 0);
+            }
+            else
+            {
+                moveToHeap(newSize);
+                heap.resize(newSize);
+            }
+            count = newSize;
+        }
+
+        void push_back(Limb limb)
+        {
+            if (onHeap)
+                heap.push_back(limb);
+            else if (count < INLINE_LIMBS)
+                inlineLimbs[count] = limb;
+            else
+            {
+                moveToHeap(count + 1);
+                heap.push_back(limb);
+            }
+            count++;
+        }
+
+        void pop_back()
+        {
+            if (onHeap)
+                heap.pop_back();
+            count--;
+        }
+
+        void clear() { resize(0); }
+
+        void swap(LimbStorage& other) noexcept
+        {
+            std::swap(count, other.count);
+            std::swap(onHeap, other.onHeap);
+            std::swap(inlineLimbs[0], other.inlineLimbs[0]);
+            std::swap(inlineLimbs[1], other.inlineLimbs[1]);
+            heap.swap(other.heap);
+        }
+
+        bool operator==(const LimbStorage& other) const
+        {
+            return count == other.count &&
+                std::equal(begin(), end(), other.begin());
+        }
+
+        bool operator!=(const LimbStorage& other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+        void moveToHeap(std::size_t size)
+        {
+            heap.reserve(std::max(size + 1, 2 * INLINE_LIMBS));
+            heap.assign(inlineLimbs, inlineLimbs + count);
+            onHeap = true;
+        }
+
+        std::size_t count;
+        bool onHeap;
+        Limb inlineLimbs[INLINE_LIMBS];
+        Vector heap;
+};
+
+#endif
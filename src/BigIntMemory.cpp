@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <new>
+
+#include "BigIntKernels.h"
+#include "BigIntMemory.h"
+
+namespace
+{
+    class NewDeleteResource : public BigIntMemoryResource
+    {
+        protected:
+            void* doAllocate(std::size_t bytes) override
+            {
+                return ::operator new(bytes);
+            }
+
+            void doDeallocate(void* memory, std::size_t) override
+            {
+                ::operator delete(memory);
+            }
+    };
+
+    // Every allocation is rounded up to this, which keeps the arena's
+    // blocks aligned for any scalar type
+    const std::size_t ALIGNMENT = alignof(std::max_align_t);
+
+    std::size_t alignUp(std::size_t bytes)
+    {
+        return (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+
+    // Size classes of the pool run from 64 bytes upwards in powers of two
+    const std::size_t SMALLEST_CLASS_BYTES = 64;
+
+    int sizeClass(std::size_t bytes)
+    {
+        if (bytes <= SMALLEST_CLASS_BYTES)
+            return 0;
+        return 64 - __builtin_clzll((bytes - 1) / SMALLEST_CLASS_BYTES);
+    }
+}
+
+thread_local BigIntMemoryResource* BigIntMemoryResource::current = nullptr;
+
+/*!
+ * Return the resource that allocates with the global operator new. It is
+ * never destroyed, so BigInts with static storage may use it until the
+ * very end of the program.
+*/
+
+BigIntMemoryResource* BigIntMemoryResource::getDefault()
+{
+    static BigIntMemoryResource* resource = new NewDeleteResource;
+    return resource;
+}
+
+/*!
+ * Return the resource that BigInts constructed on this thread use.
+*/
+
+BigIntMemoryResource* BigIntMemoryResource::getCurrent()
+{
+    return current ? current : getDefault();
+}
+
+/*!
+ * Make \a resource current on this thread and return the one it replaces.
+*/
+
+BigIntMemoryResource* BigIntMemoryResource::setCurrent(
+        BigIntMemoryResource* resource)
+{
+    BigIntMemoryResource* previous = getCurrent();
+    current = (resource == getDefault()) ? nullptr : resource;
+    return previous;
+}
+
+struct BigIntArena::Chunk
+{
+    Chunk* previous;
+};
+
+/*!
+ * Create an arena that takes memory from operator new \a chunkBytes at a
+ * time, or more for a single larger allocation.
+*/
+
+BigIntArena::BigIntArena(std::size_t chunkBytes) :
+    chunks(nullptr), next(nullptr), end(nullptr),
+    chunkBytes(chunkBytes), used(0)
+{
+}
+
+BigIntArena::~BigIntArena()
+{
+    release();
+}
+
+/*!
+ * Free every chunk at once. Nothing allocated from the arena may be used
+ * afterwards.
+*/
+
+void BigIntArena::release()
+{
+    while (chunks)
+    {
+        Chunk* previous = chunks->previous;
+        ::operator delete(chunks);
+        chunks = previous;
+    }
+
+    next = nullptr;
+    end = nullptr;
+    used = 0;
+}
+
+/*!
+ * Return the number of bytes handed out since the arena was created or
+ * last released.
+*/
+
+std::size_t BigIntArena::bytesInUse() const
+{
+    return used;
+}
+
+void* BigIntArena::doAllocate(std::size_t bytes)
+{
+    bytes = alignUp(bytes);
+    if (static_cast<std::size_t>(end - next) < bytes)
+    {
+        std::size_t header = alignUp(sizeof(Chunk));
+        std::size_t size = std::max(chunkBytes, bytes);
+        char* memory = static_cast<char*>(::operator new(header + size));
+
+        Chunk* chunk = reinterpret_cast<Chunk*>(memory);
+        chunk->previous = chunks;
+        chunks = chunk;
+        next = memory + header;
+        end = next + size;
+    }
+
+    void* memory = next;
+    next += bytes;
+    used += bytes;
+    return memory;
+}
+
+void BigIntArena::doDeallocate(void*, std::size_t)
+{
+}
+
+struct BigIntPool::Block
+{
+    Block* next;
+};
+
+/*!
+ * Create a pool that keeps up to \a maxCached freed blocks in each size
+ * class of up to \a largestCachedBytes.
+*/
+
+BigIntPool::BigIntPool(std::size_t maxCached,
+        std::size_t largestCachedBytes) :
+    maxCached(maxCached), largestCachedBytes(largestCachedBytes), inUse(0),
+    peak(0)
+{
+    std::fill(freeBlocks, freeBlocks + CLASSES, nullptr);
+    std::fill(cached, cached + CLASSES, 0);
+}
+
+BigIntPool::~BigIntPool()
+{
+    release();
+}
+
+/*!
+ * Give every cached block back to operator new.
+*/
+
+void BigIntPool::release()
+{
+    for (int i = 0; i < CLASSES; i++)
+    {
+        while (freeBlocks[i])
+        {
+            Block* next = freeBlocks[i]->next;
+            ::operator delete(freeBlocks[i]);
+            freeBlocks[i] = next;
+        }
+        cached[i] = 0;
+    }
+}
+
+/*!
+ * Return the number of bytes, rounded up to their size classes, that the
+ * pool has handed out and not yet been given back.
+*/
+
+std::size_t BigIntPool::bytesInUse() const
+{
+    return inUse;
+}
+
+/*!
+ * Return the largest value bytesInUse() has had since the pool was
+ * created or resetPeak() was last called.
+*/
+
+std::size_t BigIntPool::peakBytesInUse() const
+{
+    return peak;
+}
+
+void BigIntPool::resetPeak()
+{
+    peak = inUse;
+}
+
+void* BigIntPool::doAllocate(std::size_t bytes)
+{
+    int i = sizeClass(bytes);
+    std::size_t blockBytes = SMALLEST_CLASS_BYTES << i;
+    inUse += blockBytes;
+    peak = std::max(peak, inUse);
+
+    if (Block* block = freeBlocks[i])
+    {
+        freeBlocks[i] = block->next;
+        cached[i]--;
+        return block;
+    }
+
+    try
+    {
+        return ::operator new(blockBytes);
+    }
+    catch (...)
+    {
+        inUse -= blockBytes;
+        throw;
+    }
+}
+
+void BigIntPool::doDeallocate(void* memory, std::size_t bytes)
+{
+    int i = sizeClass(bytes);
+    std::size_t blockBytes = SMALLEST_CLASS_BYTES << i;
+
+    // Blocks from another pool may bring this one below zero
+    inUse -= std::min(inUse, blockBytes);
+
+    if (blockBytes > largestCachedBytes || cached[i] >= maxCached)
+    {
+        ::operator delete(memory);
+        return;
+    }
+
+    Block* block = static_cast<Block*>(memory);
+    block->next = freeBlocks[i];
+    freeBlocks[i] = block;
+    cached[i]++;
+}
+
+namespace BigIntKernels
+{
+    namespace
+    {
+        /*
+         * The pool behind each thread's scratch space. Blocks are rounded
+         * to their class, so one freed on a thread other than the one that
+         * allocated it joins the freeing thread's pool. Once the pool has
+         * been destroyed at thread exit, scratch space goes straight to
+         * operator new.
+        */
+
+        thread_local BigIntPool* scratchPool = nullptr;
+        thread_local bool scratchPoolDestroyed = false;
+
+        struct ScratchPoolOwner
+        {
+            ScratchPoolOwner() { scratchPool = &pool; }
+
+            ~ScratchPoolOwner()
+            {
+                scratchPool = nullptr;
+                scratchPoolDestroyed = true;
+            }
+
+            BigIntPool pool;
+        };
+
+        BigIntPool* getScratchPool()
+        {
+            if (!scratchPool && !scratchPoolDestroyed)
+            {
+                thread_local ScratchPoolOwner owner;
+            }
+            return scratchPool;
+        }
+    }
+
+    void* allocateScratch(std::size_t bytes)
+    {
+        // Without a pool the block is still rounded up to its class, in
+        // case it is freed into one
+        BigIntPool* pool = getScratchPool();
+        return pool ? pool->allocate(bytes) :
+            ::operator new(SMALLEST_CLASS_BYTES << sizeClass(bytes));
+    }
+
+    void deallocateScratch(void* memory, std::size_t bytes)
+    {
+        if (scratchPool)
+            scratchPool->deallocate(memory, bytes);
+        else
+            ::operator delete(memory);
+    }
+
+    ScratchScope::ScratchScope(BigIntPool& pool) : previous(scratchPool)
+    {
+        scratchPool = &pool;
+    }
+
+    ScratchScope::~ScratchScope()
+    {
+        scratchPool = previous;
+    }
+}
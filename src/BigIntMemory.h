@@ -0,0 +1,266 @@
+#ifndef BIGINT_MEMORY_H
+#define BIGINT_MEMORY_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+template <typename T>
+class BigIntAllocator;
+
+/*!
+ * \class BigIntMemoryResource
+ *
+ * \brief A source of memory for the limbs of BigInts.
+ *
+ * This follows std::pmr::memory_resource, which is not available before
+ * C++17: subclasses override doAllocate and doDeallocate. Every thread has
+ * a current resource, which starts out as the default one (the global
+ * operator new); a BigInt takes its memory from the resource that was
+ * current on its thread when it was constructed, and keeps using it for
+ * as long as it lives, wherever it is moved. Use BigIntMemoryScope to
+ * change the current resource for a block of code.
+ *
+ * Memory handed out must be suitably aligned for any scalar type.
+*/
+
+class BigIntMemoryResource
+{
+    public:
+        virtual ~BigIntMemoryResource() {}
+
+        void* allocate(std::size_t bytes)
+        {
+            return doAllocate(bytes);
+        }
+
+        void deallocate(void* memory, std::size_t bytes)
+        {
+            doDeallocate(memory, bytes);
+        }
+
+        static BigIntMemoryResource* getDefault();
+        static BigIntMemoryResource* getCurrent();
+        static BigIntMemoryResource* setCurrent(
+                BigIntMemoryResource* resource);
+
+    protected:
+        virtual void* doAllocate(std::size_t bytes) = 0;
+        virtual void doDeallocate(void* memory, std::size_t bytes) = 0;
+
+    private:
+        template <typename T>
+        friend class BigIntAllocator;
+
+        // Null while the default resource is current, so that allocators
+        // for it can call operator new directly
+        static thread_local BigIntMemoryResource* current;
+};
+
+/*!
+ * \class BigIntMemoryScope
+ *
+ * \brief Makes a resource current on this thread until the end of the
+ * enclosing scope.
+*/
+
+class BigIntMemoryScope
+{
+    public:
+        explicit BigIntMemoryScope(BigIntMemoryResource& resource) :
+            previous(BigIntMemoryResource::setCurrent(&resource))
+        {
+        }
+
+        ~BigIntMemoryScope()
+        {
+            BigIntMemoryResource::setCurrent(previous);
+        }
+
+        BigIntMemoryScope(const BigIntMemoryScope&) = delete;
+        BigIntMemoryScope& operator=(const BigIntMemoryScope&) = delete;
+
+    private:
+        BigIntMemoryResource* previous;
+};
+
+/*!
+ * \class BigIntArena
+ *
+ * \brief A bump allocator that frees everything at once.
+ *
+ * Allocation takes the next bytes of the current chunk, and deallocation
+ * does nothing; release() or the destructor give back every chunk. This
+ * suits a computation whose intermediate values all die together, such
+ * as the handling of one request:
+ *
+ * \code
+ * BigIntArena arena;
+ * {
+ *     BigIntMemoryScope scope(arena);
+ *     ...
+ * }
+ * \endcode
+ *
+ * Every BigInt built inside the scope must be gone before the arena is
+ * released; copy a result out after the scope ends to keep it. An arena
+ * is not safe to use from several threads at once.
+*/
+
+class BigIntArena : public BigIntMemoryResource
+{
+    public:
+        explicit BigIntArena(std::size_t chunkBytes = 64 * 1024);
+        ~BigIntArena();
+
+        BigIntArena(const BigIntArena&) = delete;
+        BigIntArena& operator=(const BigIntArena&) = delete;
+
+        void release();
+        std::size_t bytesInUse() const;
+
+    protected:
+        void* doAllocate(std::size_t bytes) override;
+        void doDeallocate(void* memory, std::size_t bytes) override;
+
+    private:
+        struct Chunk;
+
+        Chunk* chunks;
+        char* next;
+        char* end;
+        std::size_t chunkBytes;
+        std::size_t used;
+};
+
+/*!
+ * \class BigIntPool
+ *
+ * \brief Keeps freed blocks for reuse, sorted into power-of-two size
+ * classes.
+ *
+ * Each class holds up to \a maxCached freed blocks of up to
+ * \a largestCachedBytes, so that a loop which frees and allocates buffers
+ * of similar sizes stops reaching the global heap. Every block is rounded
+ * up to its class, so any pool can take back a block that another pool
+ * handed out. Scratch space inside multiplication and division comes from
+ * a pool kept by each thread. A pool is not safe to use from several
+ * threads at once.
+*/
+
+class BigIntPool : public BigIntMemoryResource
+{
+    public:
+        explicit BigIntPool(std::size_t maxCached = 8,
+                std::size_t largestCachedBytes = 1 << 20);
+        ~BigIntPool();
+
+        BigIntPool(const BigIntPool&) = delete;
+        BigIntPool& operator=(const BigIntPool&) = delete;
+
+        void release();
+        std::size_t bytesInUse() const;
+        std::size_t peakBytesInUse() const;
+        void resetPeak();
+
+    protected:
+        void* doAllocate(std::size_t bytes) override;
+        void doDeallocate(void* memory, std::size_t bytes) override;
+
+    private:
+        struct Block;
+
+        static const int CLASSES = 58;
+
+        Block* freeBlocks[CLASSES];
+        std::size_t cached[CLASSES];
+        std::size_t maxCached;
+        std::size_t largestCachedBytes;
+        std::size_t inUse;
+        std::size_t peak;
+};
+
+/*!
+ * \class BigIntAllocator
+ *
+ * \brief A standard allocator that draws on a BigIntMemoryResource.
+ *
+ * A default-constructed allocator uses the resource current on this
+ * thread. Moves and swaps take the allocator with the memory, and copies
+ * get the resource current where they are made. The default resource is
+ * held as a null pointer and bypassed.
+*/
+
+template <typename T>
+class BigIntAllocator
+{
+    public:
+        typedef T value_type;
+        typedef std::true_type propagate_on_container_move_assignment;
+        typedef std::true_type propagate_on_container_swap;
+
+        BigIntAllocator() : resource(BigIntMemoryResource::current)
+        {
+        }
+
+        explicit BigIntAllocator(BigIntMemoryResource* resource) :
+            resource(resource == BigIntMemoryResource::getDefault() ?
+                    nullptr : resource)
+        {
+        }
+
+        template <typename U>
+        BigIntAllocator(const BigIntAllocator<U>& other) :
+            resource(other.resource)
+        {
+        }
+
+        T* allocate(std::size_t count)
+        {
+            std::size_t bytes = count * sizeof(T);
+            return static_cast<T*>(resource ? resource->allocate(bytes) :
+                    ::operator new(bytes));
+        }
+
+        void deallocate(T* memory, std::size_t count)
+        {
+            if (resource)
+                resource->deallocate(memory, count * sizeof(T));
+            else
+                ::operator delete(memory);
+        }
+
+        BigIntAllocator select_on_container_copy_construction() const
+        {
+            return BigIntAllocator();
+        }
+
+        BigIntMemoryResource* getResource() const
+        {
+            return resource ? resource : BigIntMemoryResource::getDefault();
+        }
+
+    private:
+        template <typename U>
+        friend class BigIntAllocator;
+
+        template <typename T1, typename T2>
+        friend bool operator==(const BigIntAllocator<T1>& a,
+                const BigIntAllocator<T2>& b);
+
+        BigIntMemoryResource* resource;
+};
+
+template <typename T, typename U>
+bool operator==(const BigIntAllocator<T>& a, const BigIntAllocator<U>& b)
+{
+    return a.resource == b.resource;
+}
+
+template <typename T, typename U>
+bool operator!=(const BigIntAllocator<T>& a, const BigIntAllocator<U>& b)
+{
+    return !(a == b);
+}
+
+#endif
@@ -0,0 +1,604 @@
+#include <algorithm>
+
+#include "BigIntKernels.h"
+#include "BigIntModContext.h"
+
+using namespace BigIntKernels;
+
+/*
+ * Modular arithmetic with a fixed modulus. Odd moduli are handled with
+ * Montgomery multiplication and even ones with Barrett reduction, so once
+ * a context is built nothing divides; every intermediate value stays
+ * within twice the size of the modulus.
+*/
+
+namespace
+{
+    /*
+     * Return the inverse of the odd \a a modulo 2^64. Each Newton step
+     * doubles the number of correct low bits, starting from the three
+     * that a itself gets right.
+    */
+
+    Limb inverseLimb(Limb a)
+    {
+        Limb inverse = a;
+        for (int i = 0; i < 5; i++)
+            inverse *= 2 - a * inverse;
+        return inverse;
+    }
+
+    /*
+     * Store a * b in the 2 * size limbs of result with schoolbook
+     * multiplication, whose sequence of operations does not depend on the
+     * values of the limbs.
+    */
+
+    void multiplyFixed(Limb* result, const Limb* a, const Limb* b,
+            std::size_t size)
+    {
+        result[size] = multiplyByLimb(result, a, size, b[0]);
+        for (std::size_t j = 1; j < size; j++)
+            result[size + j] = addMultiplyByLimb(result + j, a, size, b[j]);
+    }
+
+    /*
+     * Replace the size-limb \a value, together with the carry above it, by
+     * value - modulus when that is not negative. With \a constantTime set
+     * the choice is made with masks instead of a branch.
+    */
+
+    void subtractIfAbove(Limb* value, Limb carry, const Limb* modulus,
+            std::size_t size, bool constantTime)
+    {
+        if (!constantTime)
+        {
+            if (carry != 0 || compareLimbs(value, modulus, size) >= 0)
+                subtractLimbs(value, value, size, modulus, size);
+            return;
+        }
+
+        ScratchVector difference(size);
+        Limb borrow = subtractLimbs(difference.data(), value, size, modulus,
+                size);
+        Limb keep = static_cast<Limb>(0) - (borrow & (carry ^ 1));
+        for (std::size_t i = 0; i < size; i++)
+            value[i] = (value[i] & keep) | (difference[i] & ~keep);
+    }
+
+    /*
+     * Store the size-limb remainder of a by the size-limb modulus in
+     * result.
+    */
+
+    void remainderLimbs(Limb* result, const Limb* a, std::size_t aSize,
+            const Limb* modulus, std::size_t size)
+    {
+        if (size == 1)
+            result[0] = divideByLimb(nullptr, a, aSize, modulus[0]);
+        else
+            divideLimbs(nullptr, result, a, aSize, modulus, size);
+    }
+}
+
+/*
+ * The limb-level arithmetic behind a context. Values are size-limb arrays
+ * below the modulus, in Montgomery form when the modulus is odd.
+*/
+
+class BigIntModContext::Reducer
+{
+    public:
+        Reducer(const std::vector<Limb>& modulus);
+        std::size_t size() const;
+        bool isMontgomery() const;
+        const std::vector<Limb>& one() const;
+        void toForm(Limb* result, const Limb* a) const;
+        void fromForm(Limb* result, const Limb* a) const;
+        void add(Limb* result, const Limb* a, const Limb* b) const;
+        void subtract(Limb* result, const Limb* a, const Limb* b) const;
+        void multiply(Limb* result, const Limb* a, const Limb* b,
+                bool constantTime = false) const;
+        void power(Limb* result, const Limb* base, const Limb* exponent,
+                std::size_t exponentSize, bool constantTime) const;
+
+    private:
+        void reduceMontgomery(Limb* result, Limb* product,
+                bool constantTime) const;
+        void reduceBarrett(Limb* result, const Limb* product) const;
+
+        std::vector<Limb> modulus;
+        bool montgomery;
+        // 1 in form: R mod n for Montgomery, 1 for Barrett
+        std::vector<Limb> unit;
+        // -n^-1 mod 2^64, for REDC one limb at a time
+        Limb limbInverse;
+        // -n^-1 mod R, for REDC by multiplication on large moduli
+        std::vector<Limb> inverse;
+        // R^2 mod n, to bring values into Montgomery form
+        std::vector<Limb> rSquared;
+        // floor(2^(128 size) / n), for Barrett reduction
+        std::vector<Limb> reciprocal;
+};
+
+BigIntModContext::Reducer::Reducer(const std::vector<Limb>& modulus) :
+    modulus(modulus), montgomery((modulus[0] & 1) != 0)
+{
+    std::size_t size = modulus.size();
+    unit.resize(size);
+
+    if (!montgomery)
+    {
+        unit[0] = 1;
+
+        ScratchVector power(2 * size + 1);
+        power[2 * size] = 1;
+        reciprocal.resize(size + 2);
+        if (size == 1)
+            divideByLimb(reciprocal.data(), power.data(), power.size(),
+                    modulus[0]);
+        else
+            divideLimbs(reciprocal.data(), nullptr, power.data(),
+                    power.size(), modulus.data(), size);
+        return;
+    }
+
+    limbInverse = 0 - inverseLimb(modulus[0]);
+
+    ScratchVector power(2 * size + 1);
+    power[size] = 1;
+    remainderLimbs(unit.data(), power.data(), size + 1, modulus.data(),
+            size);
+    power[size] = 0;
+    power[2 * size] = 1;
+    rSquared.resize(size);
+    remainderLimbs(rSquared.data(), power.data(), 2 * size + 1,
+            modulus.data(), size);
+
+    // Row-by-row REDC costs about one schoolbook product, while REDC by
+    // multiplication takes two full products, which only pays off once
+    // those use Toom-Cook
+    if (size < BigInt::getThresholds().toom3)
+        return;
+
+    // Lift n^-1 from one limb to size limbs with the Newton step
+    // x = x (2 - n x), which doubles the number of correct limbs
+    std::vector<Limb> x(size);
+    x[0] = inverseLimb(modulus[0]);
+    ScratchVector product(2 * size);
+    ScratchVector correction(size);
+    for (std::size_t known = 1; known < size;)
+    {
+        std::size_t next = std::min(2 * known, size);
+
+        multiplyLimbs(product.data(), modulus.data(), next, x.data(), known);
+        // 2 - n x = ~(n x) + 3
+        for (std::size_t i = 0; i < next; i++)
+            correction[i] = ~product[i];
+        const Limb three = 3;
+        addLimbs(correction.data(), correction.data(), next, &three, 1);
+
+        multiplyLimbs(product.data(), correction.data(), next, x.data(),
+                known);
+        std::copy(product.begin(), product.begin() + next, x.begin());
+        known = next;
+    }
+
+    // Negate to get -n^-1
+    inverse.resize(size);
+    for (std::size_t i = 0; i < size; i++)
+        inverse[i] = ~x[i];
+    const Limb one = 1;
+    addLimbs(inverse.data(), inverse.data(), size, &one, 1);
+}
+
+std::size_t BigIntModContext::Reducer::size() const
+{
+    return modulus.size();
+}
+
+bool BigIntModContext::Reducer::isMontgomery() const
+{
+    return montgomery;
+}
+
+const std::vector<Limb>& BigIntModContext::Reducer::one() const
+{
+    return unit;
+}
+
+void BigIntModContext::Reducer::toForm(Limb* result, const Limb* a) const
+{
+    if (montgomery)
+        multiply(result, a, rSquared.data());
+    else
+        std::copy(a, a + modulus.size(), result);
+}
+
+void BigIntModContext::Reducer::fromForm(Limb* result, const Limb* a) const
+{
+    std::size_t size = modulus.size();
+    if (!montgomery)
+    {
+        std::copy(a, a + size, result);
+        return;
+    }
+
+    ScratchVector product(2 * size);
+    std::copy(a, a + size, product.begin());
+    reduceMontgomery(result, product.data(), false);
+}
+
+void BigIntModContext::Reducer::add(Limb* result, const Limb* a,
+        const Limb* b) const
+{
+    std::size_t size = modulus.size();
+    Limb carry = addLimbs(result, a, size, b, size);
+    subtractIfAbove(result, carry, modulus.data(), size, false);
+}
+
+void BigIntModContext::Reducer::subtract(Limb* result, const Limb* a,
+        const Limb* b) const
+{
+    std::size_t size = modulus.size();
+    if (subtractLimbs(result, a, size, b, size) != 0)
+        addLimbs(result, result, size, modulus.data(), size);
+}
+
+/*
+ * Store a * b in result, which may alias either operand. With
+ * \a constantTime set, the sequence of operations and memory accesses
+ * does not depend on the values; that is only available for Montgomery
+ * reduction.
+*/
+
+void BigIntModContext::Reducer::multiply(Limb* result, const Limb* a,
+        const Limb* b, bool constantTime) const
+{
+    std::size_t size = modulus.size();
+    ScratchVector product(2 * size);
+    if (constantTime)
+        multiplyFixed(product.data(), a, b, size);
+    else
+        multiplyLimbs(product.data(), a, size, b, size);
+
+    if (montgomery)
+        reduceMontgomery(result, product.data(), constantTime);
+    else
+        reduceBarrett(result, product.data());
+}
+
+/*
+ * REDC: store product / R mod n in result, for a 2 * size limb product
+ * below n R. The product is overwritten.
+*/
+
+void BigIntModContext::Reducer::reduceMontgomery(Limb* result, Limb* product,
+        bool constantTime) const
+{
+    std::size_t size = modulus.size();
+    const Limb* n = modulus.data();
+    Limb carry;
+
+    if (constantTime || inverse.empty())
+    {
+        // Clear one limb at a time by adding a multiple of n, keeping each
+        // row's carry in the limb it has just cleared
+        for (std::size_t i = 0; i < size; i++)
+            product[i] = addMultiplyByLimb(product + i, n, size,
+                    product[i] * limbInverse);
+        carry = addLimbs(result, product + size, size, product, size);
+    }
+    else
+    {
+        // Clear all the low limbs at once by adding m n, where
+        // m = (product mod R) (-n^-1) mod R
+        ScratchVector m(2 * size);
+        multiplyLimbs(m.data(), product, size, inverse.data(), size);
+        ScratchVector mn(2 * size);
+        multiplyLimbs(mn.data(), m.data(), size, n, size);
+        Limb low = addLimbs(mn.data(), mn.data(), size, product, size);
+        carry = addLimbs(result, product + size, size, mn.data() + size,
+                size);
+        carry += addLimbs(result, result, size, &low, 1);
+    }
+
+    subtractIfAbove(result, carry, n, size, constantTime);
+}
+
+/*
+ * Store product mod n in result, for a 2 * size limb product.
+*/
+
+void BigIntModContext::Reducer::reduceBarrett(Limb* result,
+        const Limb* product) const
+{
+    std::size_t size = modulus.size();
+
+    // Estimate the quotient from the top size + 1 limbs of the product; it
+    // falls short by at most two
+    const Limb* top = product + size - 1;
+    ScratchVector estimate(2 * size + 3);
+    multiplyLimbs(estimate.data(), reciprocal.data(), size + 2, top,
+            size + 1);
+    const Limb* quotient = estimate.data() + size + 1;
+
+    ScratchVector multiple(2 * size + 2);
+    multiplyLimbs(multiple.data(), quotient, size + 1, modulus.data(), size);
+
+    // The remainder is below 3n, so size + 1 limbs hold it
+    ScratchVector remainder(size + 1);
+    subtractLimbs(remainder.data(), product, size + 1, multiple.data(),
+            size + 1);
+    while (remainder[size] != 0 ||
+            compareLimbs(remainder.data(), modulus.data(), size) >= 0)
+        remainder[size] -= subtractLimbs(remainder.data(), remainder.data(),
+                size, modulus.data(), size);
+
+    std::copy(remainder.begin(), remainder.begin() + size, result);
+}
+
+/*
+ * Store base^exponent in result, by left-to-right fixed-window
+ * exponentiation of a base in form. The exponent is read windowBits bits
+ * at a time; each window costs windowBits squarings and one
+ * multiplication by a precomputed power of the base.
+ *
+ * With \a constantTime set, every bit of every exponent limb is processed,
+ * the multiplication is made even for zero windows, and table entries are
+ * read by scanning the whole table with masks, so neither timing nor
+ * memory access depends on the exponent's value.
+*/
+
+void BigIntModContext::Reducer::power(Limb* result, const Limb* base,
+        const Limb* exponent, std::size_t exponentSize,
+        bool constantTime) const
+{
+    std::size_t size = modulus.size();
+    std::size_t bits = 64 * exponentSize;
+    if (!constantTime)
+        bits -= __builtin_clzll(exponent[exponentSize - 1]);
+
+    int windowBits = bits <= 16 ? 2 : bits <= 128 ? 4 : bits <= 1024 ? 5 : 6;
+    std::size_t entries = static_cast<std::size_t>(1) << windowBits;
+
+    // table holds base^i at i * size
+    ScratchVector table(entries * size);
+    std::copy(unit.begin(), unit.end(), table.begin());
+    std::copy(base, base + size, table.begin() + size);
+    for (std::size_t i = 2; i < entries; i++)
+        multiply(table.data() + i * size, table.data() + (i - 1) * size,
+                base, constantTime);
+
+    std::copy(unit.begin(), unit.end(), result);
+    ScratchVector entry(size);
+
+    std::size_t windows = (bits + windowBits - 1) / windowBits;
+    for (std::size_t window = windows; window-- > 0;)
+    {
+        std::size_t low = window * windowBits;
+        Limb digit = 0;
+        for (std::size_t bit = std::min(low + windowBits, bits); bit-- > low;)
+            digit = (digit << 1) | ((exponent[bit / 64] >> (bit % 64)) & 1);
+
+        if (window + 1 != windows)
+            for (int i = 0; i < windowBits; i++)
+                multiply(result, result, result, constantTime);
+
+        if (constantTime)
+        {
+            std::fill(entry.begin(), entry.end(), 0);
+            for (std::size_t i = 0; i < entries; i++)
+            {
+                Limb mask = static_cast<Limb>(0) - (i == digit);
+                for (std::size_t j = 0; j < size; j++)
+                    entry[j] |= table[i * size + j] & mask;
+            }
+            multiply(result, result, entry.data(), true);
+        }
+        else if (digit != 0)
+            multiply(result, result, table.data() + digit * size);
+    }
+}
+
+/*!
+ * Construct a context for arithmetic modulo the positive \a modulus.
+*/
+
+BigIntModContext::BigIntModContext(const BigInt& modulus) : modulus(modulus)
+{
+    if (!modulus.nonNegative || modulus.limbs.empty())
+        throw ("BigIntModContext requires a positive modulus");
+
+    reducer = std::shared_ptr<const Reducer>(new Reducer(
+                std::vector<Limb>(modulus.limbs.begin(), modulus.limbs.end())));
+}
+
+const BigInt& BigIntModContext::getModulus() const
+{
+    return modulus;
+}
+
+/*!
+ * Convert any BigInt into the context's form, reducing it first.
+*/
+
+BigInt BigIntModContext::toForm(const BigInt& value) const
+{
+    BigInt residue = value % modulus;
+    if (!residue.nonNegative)
+        residue += modulus;
+
+    LimbVector limbs(residue.limbs.begin(), residue.limbs.end());
+    limbs.resize(reducer->size());
+    reducer->toForm(limbs.data(), limbs.data());
+    return fromLimbs(limbs);
+}
+
+/*!
+ * Convert a value in form back into its residue in [0, modulus).
+*/
+
+BigInt BigIntModContext::fromForm(const BigInt& value) const
+{
+    LimbVector limbs = limbsInForm(value);
+    reducer->fromForm(limbs.data(), limbs.data());
+    return fromLimbs(limbs);
+}
+
+BigInt BigIntModContext::add(const BigInt& a, const BigInt& b) const
+{
+    LimbVector limbs = limbsInForm(a);
+    reducer->add(limbs.data(), limbs.data(), limbsInForm(b).data());
+    return fromLimbs(limbs);
+}
+
+BigInt BigIntModContext::sub(const BigInt& a, const BigInt& b) const
+{
+    LimbVector limbs = limbsInForm(a);
+    reducer->subtract(limbs.data(), limbs.data(), limbsInForm(b).data());
+    return fromLimbs(limbs);
+}
+
+BigInt BigIntModContext::mul(const BigInt& a, const BigInt& b) const
+{
+    LimbVector limbs = limbsInForm(a);
+    reducer->multiply(limbs.data(), limbs.data(), limbsInForm(b).data());
+    return fromLimbs(limbs);
+}
+
+BigInt BigIntModContext::sqr(const BigInt& a) const
+{
+    LimbVector limbs = limbsInForm(a);
+    reducer->multiply(limbs.data(), limbs.data(), limbs.data());
+    return fromLimbs(limbs);
+}
+
+/*!
+ * Raise \a base, in form, to the non-negative \a exponent.
+ *
+ * @param constantTime Make the running time and memory accesses
+ *  independent of the exponent's value (though not of its size in limbs),
+ *  for use with secret exponents. This is slower and requires an odd
+ *  modulus.
+*/
+
+BigInt BigIntModContext::pow(const BigInt& base, const BigInt& exponent,
+        bool constantTime) const
+{
+    if (!exponent.nonNegative)
+        throw ("pow only accepts non-negative exponents");
+    if (constantTime && !reducer->isMontgomery())
+        throw ("Constant-time pow requires an odd modulus");
+
+    LimbVector baseLimbs = limbsInForm(base);
+    if (exponent.limbs.empty())
+        return fromLimbs(LimbVector(reducer->one().begin(),
+                    reducer->one().end()));
+
+    LimbVector limbs(reducer->size());
+    reducer->power(limbs.data(), baseLimbs.data(), exponent.limbs.data(),
+            exponent.limbs.size(), constantTime);
+    return fromLimbs(limbs);
+}
+
+/*!
+ * Return the multiplicative inverse of \a a, in form. Throws if \a a
+ * shares a factor with the modulus.
+*/
+
+BigInt BigIntModContext::inverse(const BigInt& a) const
+{
+    return toForm(BigInt::modinv(fromForm(a), modulus));
+}
+
+/*
+ * Return the limbs of \a value padded to the modulus size, checking that
+ * it is a reduced value.
+*/
+
+LimbVector BigIntModContext::limbsInForm(const BigInt& value) const
+{
+    if (!value.nonNegative || BigInt::compareMagnitudes(value, modulus) >= 0)
+        throw ("Value is not reduced modulo the BigIntModContext modulus");
+
+    LimbVector limbs(value.limbs.begin(), value.limbs.end());
+    limbs.resize(reducer->size());
+    return limbs;
+}
+
+BigInt BigIntModContext::fromLimbs(LimbVector limbs)
+{
+    BigInt result;
+    result.limbs = std::move(limbs);
+    result.normalize();
+    return result;
+}
+
+/*!
+ * Return \a base raised to \a exponent, reduced modulo \a modulus into
+ * the range [0, modulus).
+ *
+ * @param constantTime Make the running time and memory accesses
+ *  independent of the exponent's value (though not of its size in limbs),
+ *  for use with secret exponents. This is slower and requires an odd
+ *  modulus.
+*/
+
+BigInt BigInt::powmod(const BigInt& base, const BigInt& exponent,
+        const BigInt& modulus, bool constantTime)
+{
+    if (!modulus.nonNegative || modulus.limbs.empty())
+        throw ("powmod requires a positive modulus");
+    if (!exponent.nonNegative)
+        throw ("powmod only accepts non-negative exponents");
+    if (constantTime && (modulus.limbs[0] & 1) == 0)
+        throw ("Constant-time powmod requires an odd modulus");
+
+    BigIntModContext context(modulus);
+    BigInt result;
+    context.powResidue(result, base, exponent, constantTime);
+    return result;
+}
+
+/*
+ * Store base^exponent mod the modulus in \a result, reusing its storage.
+ * Unlike pow, this takes and returns plain values rather than values in
+ * form, and all the work is done in scratch space.
+*/
+
+void BigIntModContext::powResidue(BigInt& result, const BigInt& base,
+        const BigInt& exponent, bool constantTime) const
+{
+    if (!exponent.nonNegative)
+        throw ("pow only accepts non-negative exponents");
+    if (constantTime && !reducer->isMontgomery())
+        throw ("Constant-time pow requires an odd modulus");
+
+    std::size_t size = reducer->size();
+    const Limb* n = modulus.limbs.data();
+    std::size_t baseSize = base.limbs.size();
+
+    // Reduce the base into [0, modulus)
+    ScratchVector residue(size);
+    if (BigInt::compareMagnitudes(base.limbs, modulus.limbs) < 0)
+        std::copy(base.limbs.begin(), base.limbs.end(), residue.begin());
+    else
+        remainderLimbs(residue.data(), base.limbs.data(), baseSize, n, size);
+    if (!base.nonNegative && normalizedSize(residue.data(), size) != 0)
+        subtractLimbs(residue.data(), n, size, residue.data(), size);
+
+    ScratchVector power(size);
+    reducer->toForm(residue.data(), residue.data());
+    if (exponent.limbs.empty())
+        std::copy(reducer->one().begin(), reducer->one().end(),
+                power.begin());
+    else
+        reducer->power(power.data(), residue.data(), exponent.limbs.data(),
+                exponent.limbs.size(), constantTime);
+    reducer->fromForm(power.data(), power.data());
+
+    result.limbs.assign(power.data(),
+            power.data() + normalizedSize(power.data(), size));
+    result.nonNegative = true;
+}
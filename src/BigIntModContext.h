@@ -0,0 +1,53 @@
+#ifndef BIGINT_MOD_CONTEXT_H
+#define BIGINT_MOD_CONTEXT_H
+
+#include <memory>
+
+#include "BigInt.h"
+
+/*!
+ * \class BigIntModContext
+ *
+ * \brief Arithmetic modulo a fixed BigInt modulus.
+ *
+ * Everything that depends only on the modulus is computed once, when the
+ * context is built: R mod n, R^2 mod n and -n^-1 for Montgomery
+ * multiplication when the modulus is odd, and the Barrett reciprocal when
+ * it is even. Copies of a context share those constants.
+ *
+ * The operations work on values in the context's form, which is
+ * Montgomery form (a R mod n) for odd moduli and the plain residue for
+ * even ones. Convert with toForm on the way in and fromForm on the way
+ * out; in between, values stay in form and are never divided.
+*/
+
+class BigIntModContext
+{
+    public:
+        BigIntModContext(const BigInt& modulus);
+        const BigInt& getModulus() const;
+        BigInt toForm(const BigInt& value) const;
+        BigInt fromForm(const BigInt& value) const;
+        BigInt add(const BigInt& a, const BigInt& b) const;
+        BigInt sub(const BigInt& a, const BigInt& b) const;
+        BigInt mul(const BigInt& a, const BigInt& b) const;
+        BigInt sqr(const BigInt& a) const;
+        BigInt pow(const BigInt& base, const BigInt& exponent,
+                bool constantTime = false) const;
+        BigInt inverse(const BigInt& a) const;
+
+    private:
+        friend class BigInt;
+        friend class BigIntWorkspace;
+        class Reducer;
+
+        void powResidue(BigInt& result, const BigInt& base,
+                const BigInt& exponent, bool constantTime) const;
+        LimbStorage::Vector limbsInForm(const BigInt& value) const;
+        static BigInt fromLimbs(LimbStorage::Vector limbs);
+
+        BigInt modulus;
+        std::shared_ptr<const Reducer> reducer;
+};
+
+#endif
@@ -0,0 +1,463 @@
+#include <algorithm>
+#include <climits>
+
+#include "BigInt.h"
+#include "BigIntKernels.h"
+
+/*
+ * The multiplication engine. multiplyLimbs picks between schoolbook,
+ * Karatsuba, Toom-3, Toom-4 and NTT multiplication based on the size of
+ * the smaller operand and the thresholds in BigInt::getThresholds().
+ * Squares take the squareLimbs path, which shares the products that a
+ * general multiplication would compute twice.
+*/
+
+namespace BigIntKernels
+{
+    namespace
+    {
+        // Stands for the point at infinity in a Toom evaluation scheme,
+        // where a polynomial evaluates to its leading coefficient.
+        const int POINT_AT_INFINITY = INT_MIN;
+
+        /*
+         * A Toom-Cook scheme splitting each operand into \a pieces parts.
+         * The product polynomial is recovered from its values at
+         * \a points by multiplying by the inverse of the Vandermonde
+         * matrix, stored row by row as integers in \a matrix with each
+         * row divided by the matching entry of \a denominators.
+        */
+
+        struct ToomScheme
+        {
+            int pieces;
+            const int* points;
+            const int* matrix;
+            const Limb* denominators;
+        };
+
+        const int TOOM3_POINTS[] = {0, 1, -1, 2, POINT_AT_INFINITY};
+        const int TOOM3_MATRIX[] =
+        {
+             1,  0,  0,  0,   0,
+            -3,  6, -2, -1,  12,
+            -2,  1,  1,  0,  -2,
+             3, -3, -1,  1, -12,
+             0,  0,  0,  0,   1
+        };
+        const Limb TOOM3_DENOMINATORS[] = {1, 6, 2, 6, 1};
+        const ToomScheme TOOM3 =
+            {3, TOOM3_POINTS, TOOM3_MATRIX, TOOM3_DENOMINATORS};
+
+        const int TOOM4_POINTS[] =
+            {0, 1, -1, 2, -2, 3, POINT_AT_INFINITY};
+        const int TOOM4_MATRIX[] =
+        {
+              1,   0,   0,   0,  0,  0,    0,
+            -20,  60, -30, -15,  3,  2, -720,
+            -30,  16,  16,  -1, -1,  0,   96,
+             10, -14,  -1,   7, -1, -1,  360,
+              6,  -4,  -4,   1,  1,  0, -120,
+            -10,  10,   5,  -5, -1,  1, -360,
+              0,   0,   0,   0,  0,  0,    1
+        };
+        const Limb TOOM4_DENOMINATORS[] = {1, 60, 24, 24, 24, 120, 1};
+        const ToomScheme TOOM4 =
+            {4, TOOM4_POINTS, TOOM4_MATRIX, TOOM4_DENOMINATORS};
+
+        /*
+         * A signed value used while evaluating and interpolating. The
+         * magnitude never has high zero limbs.
+        */
+
+        struct SignedLimbs
+        {
+            ScratchVector magnitude;
+            bool negative = false;
+        };
+
+        void multiplyAny(Limb* result, const Limb* a, std::size_t aSize,
+                const Limb* b, std::size_t bSize);
+
+        /*
+         * Add the value of sign * \a term to \a accumulator.
+        */
+
+        void addSigned(SignedLimbs& accumulator, const Limb* term,
+                std::size_t termSize, bool negative)
+        {
+            termSize = normalizedSize(term, termSize);
+            if (termSize == 0)
+                return;
+
+            ScratchVector& magnitude = accumulator.magnitude;
+            std::size_t size = magnitude.size();
+
+            if (size == 0 || accumulator.negative == negative)
+            {
+                std::size_t longSize = std::max(size, termSize);
+                magnitude.resize(longSize + 1);
+                Limb* r = magnitude.data();
+                if (size >= termSize)
+                    r[longSize] = addLimbs(r, r, size, term, termSize);
+                else
+                    r[longSize] = addLimbs(r, term, termSize, r, size);
+                accumulator.negative = negative;
+            }
+            else
+            {
+                int comparison = (size != termSize)
+                    ? (size < termSize ? -1 : 1)
+                    : compareLimbs(magnitude.data(), term, size);
+
+                if (comparison >= 0)
+                    subtractLimbs(magnitude.data(), magnitude.data(), size,
+                            term, termSize);
+                else
+                {
+                    magnitude.resize(termSize);
+                    subtractLimbs(magnitude.data(), term, termSize,
+                            magnitude.data(), size);
+                    accumulator.negative = negative;
+                }
+            }
+
+            magnitude.resize(normalizedSize(magnitude.data(),
+                        magnitude.size()));
+            if (magnitude.empty())
+                accumulator.negative = false;
+        }
+
+        /*
+         * Add sign * \a term * \a factor to \a accumulator.
+        */
+
+        void addScaled(SignedLimbs& accumulator, const Limb* term,
+                std::size_t termSize, Limb factor, bool negative)
+        {
+            termSize = normalizedSize(term, termSize);
+            if (termSize == 0 || factor == 0)
+                return;
+
+            if (factor == 1)
+            {
+                addSigned(accumulator, term, termSize, negative);
+                return;
+            }
+
+            ScratchVector scaled(termSize + 1);
+            scaled[termSize] = multiplyByLimb(scaled.data(), term, termSize,
+                    factor);
+            addSigned(accumulator, scaled.data(), scaled.size(), negative);
+        }
+
+        /*
+         * Evaluate the polynomial whose coefficients are the pieces of
+         * \a a, each \a pieceSize limbs long, at \a point.
+        */
+
+        SignedLimbs evaluate(const Limb* a, std::size_t aSize,
+                std::size_t pieceSize, int pieces, int point)
+        {
+            SignedLimbs value;
+
+            for (int i = 0; i < pieces; i++)
+            {
+                std::size_t offset = i * pieceSize;
+                if (offset >= aSize)
+                    break;
+                std::size_t size = std::min(pieceSize, aSize - offset);
+
+                if (point == POINT_AT_INFINITY)
+                {
+                    if (i == pieces - 1)
+                        addSigned(value, a + offset, size, false);
+                    continue;
+                }
+
+                Limb factor = 1;
+                Limb base = point < 0 ? -point : point;
+                for (int j = 0; j < i; j++)
+                    factor *= base;
+
+                addScaled(value, a + offset, size, factor,
+                        point < 0 && i % 2 == 1);
+            }
+
+            return value;
+        }
+
+        void multiplyToom(Limb* result, const Limb* a, std::size_t aSize,
+                const Limb* b, std::size_t bSize, const ToomScheme& scheme)
+        {
+            int pieces = scheme.pieces;
+            int points = 2 * pieces - 1;
+            std::size_t pieceSize = (aSize + pieces - 1) / pieces;
+            bool squaring = (a == b && aSize == bSize);
+
+            // Multiply the operands' values at each point. A square only
+            // evaluates once, so that the values are squared in turn.
+            std::vector<SignedLimbs, ScratchAllocator<SignedLimbs>> values(
+                    points);
+            for (int j = 0; j < points; j++)
+            {
+                SignedLimbs aValue = evaluate(a, aSize, pieceSize, pieces,
+                        scheme.points[j]);
+                SignedLimbs bValue;
+                if (!squaring)
+                    bValue = evaluate(b, bSize, pieceSize, pieces,
+                            scheme.points[j]);
+                const SignedLimbs& factor = squaring ? aValue : bValue;
+
+                std::size_t aValueSize = aValue.magnitude.size();
+                std::size_t bValueSize = factor.magnitude.size();
+                if (aValueSize == 0 || bValueSize == 0)
+                    continue;
+
+                values[j].magnitude.resize(aValueSize + bValueSize);
+                multiplyAny(values[j].magnitude.data(),
+                        aValue.magnitude.data(), aValueSize,
+                        factor.magnitude.data(), bValueSize);
+                values[j].magnitude.resize(normalizedSize(
+                            values[j].magnitude.data(),
+                            aValueSize + bValueSize));
+                values[j].negative = aValue.negative != factor.negative;
+            }
+
+            // Interpolate each coefficient of the product and add it in
+            // at its offset
+            std::size_t resultSize = aSize + bSize;
+            std::fill(result, result + resultSize, 0);
+
+            for (int i = 0; i < points; i++)
+            {
+                SignedLimbs coefficient;
+                for (int j = 0; j < points; j++)
+                {
+                    int entry = scheme.matrix[i * points + j];
+                    if (entry == 0)
+                        continue;
+
+                    const SignedLimbs& value = values[j];
+                    addScaled(coefficient, value.magnitude.data(),
+                            value.magnitude.size(),
+                            entry < 0 ? -entry : entry,
+                            value.negative != (entry < 0));
+                }
+
+                ScratchVector& magnitude = coefficient.magnitude;
+                if (scheme.denominators[i] != 1)
+                    divideByLimb(magnitude.data(), magnitude.data(),
+                            magnitude.size(), scheme.denominators[i]);
+
+                std::size_t size = normalizedSize(magnitude.data(),
+                        magnitude.size());
+                if (size == 0)
+                    continue;
+
+                std::size_t offset = i * pieceSize;
+                addLimbs(result + offset, result + offset,
+                        resultSize - offset, magnitude.data(), size);
+            }
+        }
+
+        void multiplyKaratsuba(Limb* result, const Limb* a,
+                std::size_t aSize, const Limb* b, std::size_t bSize)
+        {
+            // Split both operands at h limbs; the caller guarantees that
+            // b has limbs above the split
+            std::size_t h = (aSize + 1) / 2;
+            std::size_t aHighSize = aSize - h;
+            std::size_t bHighSize = bSize - h;
+
+            // The low and high products go straight into the result
+            multiplyAny(result, a, h, b, h);
+            multiplyAny(result + 2 * h, a + h, aHighSize, b + h, bHighSize);
+
+            ScratchVector sums(2 * (h + 1));
+            Limb* aSum = sums.data();
+            Limb* bSum = aSum + h + 1;
+            aSum[h] = addLimbs(aSum, a, h, a + h, aHighSize);
+            bSum[h] = addLimbs(bSum, b, h, b + h, bHighSize);
+
+            // (a0 + a1)(b0 + b1) - a0 b0 - a1 b1 = a0 b1 + a1 b0
+            std::size_t middleSize = 2 * (h + 1);
+            ScratchVector middle(middleSize);
+            multiplyAny(middle.data(), aSum, h + 1, bSum, h + 1);
+            subtractLimbs(middle.data(), middle.data(), middleSize,
+                    result, 2 * h);
+            subtractLimbs(middle.data(), middle.data(), middleSize,
+                    result + 2 * h, aHighSize + bHighSize);
+
+            addLimbs(result + h, result + h, aSize + bSize - h,
+                    middle.data(), normalizedSize(middle.data(), middleSize));
+        }
+
+        /*
+         * Square by Karatsuba's method, using
+         * 2 a0 a1 = a0^2 + a1^2 - (a0 - a1)^2 so that all three
+         * half-size products are squares too.
+        */
+
+        void squareKaratsuba(Limb* result, const Limb* a, std::size_t size)
+        {
+            std::size_t h = (size + 1) / 2;
+            std::size_t highSize = size - h;
+
+            multiplyAny(result, a, h, a, h);
+            multiplyAny(result + 2 * h, a + h, highSize, a + h, highSize);
+
+            // |a0 - a1|, with a1 padded to h limbs
+            ScratchVector difference(h);
+            ScratchVector high(a + h, a + size);
+            high.resize(h);
+            if (compareLimbs(a, high.data(), h) >= 0)
+                subtractLimbs(difference.data(), a, h, high.data(), h);
+            else
+                subtractLimbs(difference.data(), high.data(), h, a, h);
+
+            std::size_t middleSize = 2 * h + 1;
+            ScratchVector middle(middleSize);
+            ScratchVector differenceSquare(2 * h);
+            middle[2 * h] = addLimbs(middle.data(), result, 2 * h,
+                    result + 2 * h, 2 * highSize);
+            multiplyAny(differenceSquare.data(), difference.data(), h,
+                    difference.data(), h);
+            subtractLimbs(middle.data(), middle.data(), middleSize,
+                    differenceSquare.data(), 2 * h);
+
+            addLimbs(result + h, result + h, 2 * size - h, middle.data(),
+                    normalizedSize(middle.data(), middleSize));
+        }
+
+        /*
+         * Square by adding up each product a[i] a[j] with i < j once,
+         * doubling the total and adding in the squares of the limbs.
+        */
+
+        void squareSchoolbook(Limb* result, const Limb* a, std::size_t size)
+        {
+            std::fill(result, result + 2 * size, 0);
+            for (std::size_t i = 0; i < size; i++)
+                result[i + size] = addMultiplyByLimb(result + 2 * i + 1,
+                        a + i + 1, size - i - 1, a[i]);
+
+            shiftLeftLimbs(result, result, 2 * size, 1);
+
+            Limb carry = 0;
+            for (std::size_t i = 0; i < size; i++)
+            {
+                DoubleLimb square = static_cast<DoubleLimb>(a[i]) * a[i];
+                DoubleLimb low = static_cast<DoubleLimb>(result[2 * i]) +
+                    static_cast<Limb>(square) + carry;
+                DoubleLimb high = static_cast<DoubleLimb>(result[2 * i + 1])
+                    + static_cast<Limb>(square >> 64)
+                    + static_cast<Limb>(low >> 64);
+                result[2 * i] = static_cast<Limb>(low);
+                result[2 * i + 1] = static_cast<Limb>(high);
+                carry = static_cast<Limb>(high >> 64);
+            }
+        }
+
+        void multiplySchoolbook(Limb* result, const Limb* a,
+                std::size_t aSize, const Limb* b, std::size_t bSize)
+        {
+            result[aSize] = multiplyByLimb(result, a, aSize, b[0]);
+            for (std::size_t j = 1; j < bSize; j++)
+                result[aSize + j] = addMultiplyByLimb(result + j, a, aSize,
+                        b[j]);
+        }
+
+        /*
+         * Multiply an operand by one less than half its size, one
+         * bSize-limb chunk of a at a time.
+        */
+
+        void multiplyUnbalanced(Limb* result, const Limb* a,
+                std::size_t aSize, const Limb* b, std::size_t bSize)
+        {
+            std::size_t resultSize = aSize + bSize;
+            std::fill(result, result + resultSize, 0);
+
+            ScratchVector chunkProduct(2 * bSize);
+            for (std::size_t offset = 0; offset < aSize; offset += bSize)
+            {
+                std::size_t chunkSize = std::min(bSize, aSize - offset);
+                multiplyAny(chunkProduct.data(), a + offset, chunkSize,
+                        b, bSize);
+                addLimbs(result + offset, result + offset,
+                        resultSize - offset, chunkProduct.data(),
+                        chunkSize + bSize);
+            }
+        }
+
+        /*
+         * Multiply operands of any sizes, ignoring high zero limbs.
+         * result has room for aSize + bSize limbs and is filled entirely.
+        */
+
+        void multiplyAny(Limb* result, const Limb* a, std::size_t aSize,
+                const Limb* b, std::size_t bSize)
+        {
+            std::size_t resultSize = aSize + bSize;
+            aSize = normalizedSize(a, aSize);
+            bSize = normalizedSize(b, bSize);
+
+            if (aSize == 0 || bSize == 0)
+            {
+                std::fill(result, result + resultSize, 0);
+                return;
+            }
+
+            if (aSize < bSize)
+            {
+                std::swap(a, b);
+                std::swap(aSize, bSize);
+            }
+
+            multiplyLimbs(result, a, aSize, b, bSize);
+            std::fill(result + aSize + bSize, result + resultSize, 0);
+        }
+    }
+
+    void multiplyLimbs(Limb* result, const Limb* a, std::size_t aSize,
+            const Limb* b, std::size_t bSize)
+    {
+        if (a == b && aSize == bSize)
+        {
+            squareLimbs(result, a, aSize);
+            return;
+        }
+
+        const BigInt::Thresholds& thresholds = BigInt::getThresholds();
+
+        if (bSize < thresholds.karatsuba)
+            multiplySchoolbook(result, a, aSize, b, bSize);
+        else if (bSize <= (aSize + 1) / 2)
+            multiplyUnbalanced(result, a, aSize, b, bSize);
+        else if (bSize >= thresholds.ntt)
+            multiplyNtt(result, a, aSize, b, bSize);
+        else if (bSize < thresholds.toom3)
+            multiplyKaratsuba(result, a, aSize, b, bSize);
+        else if (bSize < thresholds.toom4)
+            multiplyToom(result, a, aSize, b, bSize, TOOM3);
+        else
+            multiplyToom(result, a, aSize, b, bSize, TOOM4);
+    }
+
+    void squareLimbs(Limb* result, const Limb* a, std::size_t size)
+    {
+        const BigInt::Thresholds& thresholds = BigInt::getThresholds();
+
+        if (size < thresholds.karatsuba)
+            squareSchoolbook(result, a, size);
+        else if (size >= thresholds.ntt)
+            multiplyNtt(result, a, size, a, size);
+        else if (size < thresholds.toom3)
+            squareKaratsuba(result, a, size);
+        else if (size < thresholds.toom4)
+            multiplyToom(result, a, size, a, size, TOOM3);
+        else
+            multiplyToom(result, a, size, a, size, TOOM4);
+    }
+}
@@ -0,0 +1,620 @@
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+#include "BigIntKernels.h"
+
+/*
+ * Multiplication by number-theoretic transform.
+ *
+ * Each operand limb is a coefficient of a polynomial, and the polynomials
+ * are multiplied by cyclic convolution modulo three NTT-friendly primes
+ * just below 2^62. A coefficient of the product is less than
+ * n * 2^128 for a transform of length n, and the three primes multiply
+ * to more than 2^183, so the Chinese remainder theorem recovers every
+ * coefficient exactly for any length up to 2^55.
+ *
+ * Butterflies multiply by precomputed twiddle factors with Shoup's method
+ * and keep values lazily reduced, while pointwise products use Montgomery
+ * multiplication. The stray factor of 2^-64 from the latter is folded into
+ * the final scaling by 1 / length.
+ *
+ * Large products are split across the worker threads: the three primes
+ * and the two operands are transformed independently, long transforms
+ * split into halves after their first stage (or before their last), and
+ * the element-wise loops and the recombination run in chunks. Every value
+ * is computed exactly as on one thread, so the result does not depend on
+ * the number of threads.
+*/
+
+namespace BigIntKernels
+{
+    namespace
+    {
+        const std::size_t MAX_TRANSFORM_LENGTH =
+            static_cast<std::size_t>(1) << 55;
+
+        // Element-wise loops are split into chunks of this many values,
+        // and transforms at least this long are split into halves
+        const std::size_t PARALLEL_CHUNK = 4096;
+        const std::size_t PARALLEL_TRANSFORM_LENGTH =
+            static_cast<std::size_t>(1) << 14;
+
+        struct NttPrime
+        {
+            Limb modulus;
+            Limb generator;
+            // -modulus^-1 mod 2^64
+            Limb negativeInverse;
+            // 2^128 mod modulus, to move values into Montgomery form
+            Limb rSquared;
+        };
+
+        NttPrime makePrime(Limb modulus, Limb generator)
+        {
+            NttPrime prime;
+            prime.modulus = modulus;
+            prime.generator = generator;
+
+            // Newton's iteration doubles the number of correct low bits
+            Limb inverse = modulus;
+            for (int i = 0; i < 5; i++)
+                inverse *= 2 - modulus * inverse;
+            prime.negativeInverse = -inverse;
+
+            DoubleLimb r = (static_cast<DoubleLimb>(1) << 64) % modulus;
+            prime.rSquared = static_cast<Limb>(r * r % modulus);
+
+            return prime;
+        }
+
+        // 29 * 2^57 + 1, 69 * 2^55 + 1 and 27 * 2^56 + 1
+        const NttPrime PRIMES[3] =
+        {
+            makePrime(4179340454199820289ULL, 3),
+            makePrime(2485986994308513793ULL, 5),
+            makePrime(1945555039024054273ULL, 5)
+        };
+
+        inline Limb montgomeryMultiply(Limb a, Limb b, const NttPrime& prime)
+        {
+            DoubleLimb product = static_cast<DoubleLimb>(a) * b;
+            Limb m = static_cast<Limb>(product) * prime.negativeInverse;
+            Limb reduced = static_cast<Limb>((product +
+                        static_cast<DoubleLimb>(m) * prime.modulus) >> 64);
+
+            return reduced >= prime.modulus ? reduced - prime.modulus
+                : reduced;
+        }
+
+        inline Limb toMontgomery(Limb a, const NttPrime& prime)
+        {
+            return montgomeryMultiply(a, prime.rSquared, prime);
+        }
+
+        inline Limb addModulo(Limb a, Limb b, const NttPrime& prime)
+        {
+            Limb sum = a + b;
+            return sum >= prime.modulus ? sum - prime.modulus : sum;
+        }
+
+        inline Limb subtractModulo(Limb a, Limb b, const NttPrime& prime)
+        {
+            return a >= b ? a - b : a + prime.modulus - b;
+        }
+
+        Limb powerModulo(Limb base, Limb exponent, const NttPrime& prime)
+        {
+            Limb result = toMontgomery(1, prime);
+            Limb power = toMontgomery(base % prime.modulus, prime);
+
+            while (exponent != 0)
+            {
+                if (exponent & 1)
+                    result = montgomeryMultiply(result, power, prime);
+                power = montgomeryMultiply(power, power, prime);
+                exponent >>= 1;
+            }
+
+            // Multiplying by a plain 1 leaves Montgomery form
+            return montgomeryMultiply(result, 1, prime);
+        }
+
+        /*
+         * Return x * w modulo the prime, in [0, 2 * modulus), for any x and
+         * a w below the modulus with wShoup = floor(w * 2^64 / modulus).
+        */
+
+        inline Limb shoupMultiply(Limb x, Limb w, Limb wShoup,
+                const NttPrime& prime)
+        {
+            Limb quotient = static_cast<Limb>(
+                    (static_cast<DoubleLimb>(x) * wShoup) >> 64);
+            return x * w - quotient * prime.modulus;
+        }
+
+        inline Limb shoupFactor(Limb w, const NttPrime& prime)
+        {
+            return static_cast<Limb>((static_cast<DoubleLimb>(w) << 64) /
+                    prime.modulus);
+        }
+
+        /*
+         * Twiddle factors for one prime. Entry half + j of each table is
+         * w^j for the primitive (2 * half)-th root of unity w, or for its
+         * inverse. The entries do not depend on the transform length, so a
+         * table serves every length up to its own. Each factor is stored
+         * with its Shoup precomputation.
+         *
+         * Tables are shared between calls, so they use std::vector rather
+         * than scratch storage.
+        */
+
+        struct RootTable
+        {
+            std::size_t length;
+            std::vector<Limb> roots;
+            std::vector<Limb> rootsShoup;
+            std::vector<Limb> inverseRoots;
+            std::vector<Limb> inverseRootsShoup;
+        };
+
+        void fillPowers(std::vector<Limb>& powers, std::vector<Limb>& shoup,
+                std::size_t half, Limb w, const NttPrime& prime)
+        {
+            Limb wShoup = shoupFactor(w, prime);
+            Limb power = 1;
+            for (std::size_t j = 0; j < half; j++)
+            {
+                powers[half + j] = power;
+                shoup[half + j] = shoupFactor(power, prime);
+
+                power = shoupMultiply(power, w, wShoup, prime);
+                if (power >= prime.modulus)
+                    power -= prime.modulus;
+            }
+        }
+
+        std::shared_ptr<const RootTable> makeRootTable(std::size_t length,
+                const NttPrime& prime)
+        {
+            std::shared_ptr<RootTable> table = std::make_shared<RootTable>();
+            table->length = length;
+            table->roots.resize(length);
+            table->rootsShoup.resize(length);
+            table->inverseRoots.resize(length);
+            table->inverseRootsShoup.resize(length);
+
+            for (std::size_t half = length / 2; half >= 1; half /= 2)
+            {
+                Limb w = powerModulo(prime.generator,
+                        (prime.modulus - 1) / (2 * half), prime);
+                Limb inverse = powerModulo(w, prime.modulus - 2, prime);
+
+                fillPowers(table->roots, table->rootsShoup, half, w, prime);
+                fillPowers(table->inverseRoots, table->inverseRootsShoup,
+                        half, inverse, prime);
+            }
+
+            return table;
+        }
+
+        /*
+         * Return a root table for the prime at \a index that covers
+         * transforms of \a length, growing the shared table if needed.
+        */
+
+        std::shared_ptr<const RootTable> getRootTable(int index,
+                std::size_t length)
+        {
+            static std::mutex tablesMutex;
+            static std::shared_ptr<const RootTable> tables[3];
+
+            std::lock_guard<std::mutex> lock(tablesMutex);
+            if (!tables[index] || tables[index]->length < length)
+                tables[index] = makeRootTable(length, PRIMES[index]);
+
+            return tables[index];
+        }
+
+        /*
+         * Call body(begin, end) on ranges that together cover [0, size),
+         * in chunks of PARALLEL_CHUNK if \a parallel is set and all at once
+         * otherwise.
+        */
+
+        void forChunks(std::size_t size, bool parallel,
+                const std::function<void(std::size_t, std::size_t)>& body)
+        {
+            if (!parallel || size <= PARALLEL_CHUNK)
+            {
+                body(0, size);
+                return;
+            }
+
+            std::size_t chunks = (size + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK;
+            runParallel(chunks, [&](std::size_t chunk)
+            {
+                std::size_t begin = chunk * PARALLEL_CHUNK;
+                body(begin, std::min(size, begin + PARALLEL_CHUNK));
+            });
+        }
+
+        /*
+         * Apply count forward butterflies to the pairs low[j], high[j],
+         * with twiddle factors roots[j]. Values stay in [0, 2 * modulus).
+        */
+
+        inline void forwardButterflies(Limb* low, Limb* high,
+                const Limb* roots, const Limb* rootsShoup, std::size_t count,
+                const NttPrime& prime)
+        {
+            const Limb twiceModulus = 2 * prime.modulus;
+            for (std::size_t j = 0; j < count; j++)
+            {
+                Limb u = low[j];
+                Limb v = high[j];
+
+                Limb sum = u + v;
+                low[j] = sum >= twiceModulus ? sum - twiceModulus : sum;
+                high[j] = shoupMultiply(u - v + twiceModulus, roots[j],
+                        rootsShoup[j], prime);
+            }
+        }
+
+        /*
+         * Apply count inverse butterflies to the pairs low[j], high[j],
+         * taking values in [0, 4 * modulus) for low and [0, 2 * modulus)
+         * for high, and leaving both in [0, 4 * modulus).
+        */
+
+        inline void inverseButterflies(Limb* low, Limb* high,
+                const Limb* roots, const Limb* rootsShoup, std::size_t count,
+                const NttPrime& prime)
+        {
+            const Limb twiceModulus = 2 * prime.modulus;
+            for (std::size_t j = 0; j < count; j++)
+            {
+                Limb u = low[j];
+                if (u >= twiceModulus)
+                    u -= twiceModulus;
+                Limb v = shoupMultiply(high[j], roots[j], rootsShoup[j],
+                        prime);
+
+                low[j] = u + v;
+                high[j] = u - v + twiceModulus;
+            }
+        }
+
+        /*
+         * Decimation-in-frequency transform, with the output in
+         * bit-reversed order. Values are kept lazily reduced: the input
+         * and output are in [0, 2 * modulus).
+         *
+         * Since the twiddle factors do not depend on the length, each half
+         * of the array is transformed on its own once the first stage is
+         * done, which is how long transforms are split across threads.
+        */
+
+        void forwardTransform(Limb* values, std::size_t length,
+                const RootTable& table, const NttPrime& prime, bool parallel)
+        {
+            const Limb* roots = table.roots.data();
+            const Limb* rootsShoup = table.rootsShoup.data();
+
+            if (parallel && length >= PARALLEL_TRANSFORM_LENGTH)
+            {
+                std::size_t half = length / 2;
+                forChunks(half, true, [&](std::size_t begin, std::size_t end)
+                {
+                    forwardButterflies(values + begin, values + half + begin,
+                            roots + half + begin, rootsShoup + half + begin,
+                            end - begin, prime);
+                });
+                runParallel(2, [&](std::size_t k)
+                {
+                    forwardTransform(values + k * half, half, table, prime,
+                            true);
+                });
+                return;
+            }
+
+            for (std::size_t half = length / 2; half >= 1; half /= 2)
+            {
+                for (std::size_t i = 0; i < length; i += 2 * half)
+                    forwardButterflies(values + i, values + i + half,
+                            roots + half, rootsShoup + half, half, prime);
+            }
+        }
+
+        /*
+         * Decimation-in-time transform taking bit-reversed input, which
+         * undoes forwardTransform up to a factor of the length. The input
+         * is in [0, 2 * modulus) and the output in [0, 4 * modulus). Long
+         * transforms do the two halves on their own before the last stage.
+        */
+
+        void inverseTransform(Limb* values, std::size_t length,
+                const RootTable& table, const NttPrime& prime, bool parallel)
+        {
+            const Limb* roots = table.inverseRoots.data();
+            const Limb* rootsShoup = table.inverseRootsShoup.data();
+
+            if (parallel && length >= PARALLEL_TRANSFORM_LENGTH)
+            {
+                std::size_t half = length / 2;
+                runParallel(2, [&](std::size_t k)
+                {
+                    inverseTransform(values + k * half, half, table, prime,
+                            true);
+                });
+                forChunks(half, true, [&](std::size_t begin, std::size_t end)
+                {
+                    inverseButterflies(values + begin, values + half + begin,
+                            roots + half + begin, rootsShoup + half + begin,
+                            end - begin, prime);
+                });
+                return;
+            }
+
+            for (std::size_t half = 1; half < length; half *= 2)
+            {
+                for (std::size_t i = 0; i < length; i += 2 * half)
+                    inverseButterflies(values + i, values + i + half,
+                            roots + half, rootsShoup + half, half, prime);
+            }
+        }
+
+        inline Limb reduceOnce(Limb a, Limb bound)
+        {
+            return a >= bound ? a - bound : a;
+        }
+
+        /*
+         * Load a, padded with zeros to \a length, into \a values and
+         * transform it, leaving fully reduced residues.
+        */
+
+        void loadAndTransform(ScratchVector& values, const Limb* a,
+                std::size_t size, std::size_t length, const RootTable& table,
+                const NttPrime& prime, bool parallel)
+        {
+            values.assign(length, 0);
+            forChunks(size, parallel, [&](std::size_t begin, std::size_t end)
+            {
+                for (std::size_t i = begin; i < end; i++)
+                    values[i] = a[i] % prime.modulus;
+            });
+
+            forwardTransform(values.data(), length, table, prime, parallel);
+            forChunks(length, parallel, [&](std::size_t begin,
+                        std::size_t end)
+            {
+                for (std::size_t i = begin; i < end; i++)
+                    values[i] = reduceOnce(values[i], prime.modulus);
+            });
+        }
+
+        /*
+         * Compute the cyclic convolution of a and b modulo the prime at
+         * \a index, as fully reduced residues, using \a other for the
+         * transform of b. When \a squaring is set b is ignored and a is
+         * transformed only once.
+        */
+
+        void convolve(ScratchVector& values, ScratchVector& other,
+                const Limb* a, std::size_t aSize, const Limb* b,
+                std::size_t bSize, std::size_t length, bool squaring,
+                int index, bool parallel)
+        {
+            const NttPrime& prime = PRIMES[index];
+            std::shared_ptr<const RootTable> table = getRootTable(index,
+                    length);
+
+            runTasks(squaring ? 1 : 2, parallel, [&](std::size_t k)
+            {
+                if (k == 0)
+                    loadAndTransform(values, a, aSize, length, *table,
+                            prime, parallel);
+                else
+                    loadAndTransform(other, b, bSize, length, *table,
+                            prime, parallel);
+            });
+
+            // Each Montgomery product leaves a factor of 2^-64, which the
+            // final scaling removes along with the factor of length
+            const ScratchVector& factors = squaring ? values : other;
+            forChunks(length, parallel, [&](std::size_t begin,
+                        std::size_t end)
+            {
+                for (std::size_t i = begin; i < end; i++)
+                    values[i] = montgomeryMultiply(values[i], factors[i],
+                            prime);
+            });
+
+            inverseTransform(values.data(), length, *table, prime,
+                    parallel);
+
+            // 2^64 / length, as a plain residue
+            Limb scale = montgomeryMultiply(prime.rSquared,
+                    powerModulo(length, prime.modulus - 2, prime), prime);
+            Limb scaleShoup = shoupFactor(scale, prime);
+            forChunks(length, parallel, [&](std::size_t begin,
+                        std::size_t end)
+            {
+                for (std::size_t i = begin; i < end; i++)
+                {
+                    Limb value = shoupMultiply(values[i], scale, scaleShoup,
+                            prime);
+                    values[i] = reduceOnce(value, prime.modulus);
+                }
+            });
+        }
+
+        /*
+         * Constants for Garner's algorithm, in Montgomery form where they
+         * are used as multipliers.
+        */
+
+        struct GarnerConstants
+        {
+            Limb inverse01;
+            Limb inverse02;
+            Limb inverse12;
+            DoubleLimb modulus01;
+        };
+
+        GarnerConstants makeGarnerConstants()
+        {
+            GarnerConstants constants;
+            const NttPrime& p0 = PRIMES[0];
+            const NttPrime& p1 = PRIMES[1];
+            const NttPrime& p2 = PRIMES[2];
+
+            constants.inverse01 = toMontgomery(powerModulo(p0.modulus,
+                        p1.modulus - 2, p1), p1);
+            constants.inverse02 = toMontgomery(powerModulo(p0.modulus,
+                        p2.modulus - 2, p2), p2);
+            constants.inverse12 = toMontgomery(powerModulo(p1.modulus,
+                        p2.modulus - 2, p2), p2);
+            constants.modulus01 = static_cast<DoubleLimb>(p0.modulus) *
+                p1.modulus;
+
+            return constants;
+        }
+
+        /*
+         * Recombine coefficients [begin, end) with Garner's algorithm as
+         * x = r0 + p0 * y1 + p0 * p1 * y2, adding each into a running
+         * three-limb accumulator that is shifted out into result one limb
+         * at a time. What is left in the accumulator is stored in carry.
+        */
+
+        void recombine(Limb* result, std::size_t begin, std::size_t end,
+                std::size_t coefficients, const ScratchVector* residues,
+                Limb* carry)
+        {
+            static const GarnerConstants garner = makeGarnerConstants();
+
+            const NttPrime& p0 = PRIMES[0];
+            const NttPrime& p1 = PRIMES[1];
+            const NttPrime& p2 = PRIMES[2];
+
+            Limb accumulator[3] = {0, 0, 0};
+            for (std::size_t i = begin; i < end; i++)
+            {
+                if (i < coefficients)
+                {
+                    Limb r0 = residues[0][i];
+                    Limb r1 = residues[1][i];
+                    Limb r2 = residues[2][i];
+
+                    Limb y1 = montgomeryMultiply(subtractModulo(r1,
+                                r0 % p1.modulus, p1), garner.inverse01, p1);
+                    Limb y2 = montgomeryMultiply(subtractModulo(r2,
+                                r0 % p2.modulus, p2), garner.inverse02, p2);
+                    y2 = montgomeryMultiply(subtractModulo(y2,
+                                y1 % p2.modulus, p2), garner.inverse12, p2);
+
+                    DoubleLimb low = static_cast<DoubleLimb>(p0.modulus) *
+                        y1 + r0;
+                    DoubleLimb highLow = static_cast<DoubleLimb>(
+                            static_cast<Limb>(garner.modulus01)) * y2;
+                    DoubleLimb highHigh = static_cast<DoubleLimb>(
+                            static_cast<Limb>(garner.modulus01 >> 64)) * y2;
+
+                    // x = low + highLow + (highHigh << 64), spread over
+                    // three limbs
+                    Limb x[3];
+                    DoubleLimb sum = static_cast<DoubleLimb>(
+                            static_cast<Limb>(low)) +
+                        static_cast<Limb>(highLow);
+                    x[0] = static_cast<Limb>(sum);
+                    sum = (sum >> 64) + static_cast<Limb>(low >> 64) +
+                        static_cast<Limb>(highLow >> 64) +
+                        static_cast<Limb>(highHigh);
+                    x[1] = static_cast<Limb>(sum);
+                    x[2] = static_cast<Limb>(sum >> 64) +
+                        static_cast<Limb>(highHigh >> 64);
+
+                    addLimbs(accumulator, accumulator, 3, x, 3);
+                }
+
+                result[i] = accumulator[0];
+                accumulator[0] = accumulator[1];
+                accumulator[1] = accumulator[2];
+                accumulator[2] = 0;
+            }
+
+            std::copy(accumulator, accumulator + 3, carry);
+        }
+    }
+
+    void multiplyNtt(Limb* result, const Limb* a, std::size_t aSize,
+            const Limb* b, std::size_t bSize)
+    {
+        std::size_t resultSize = aSize + bSize;
+        std::size_t coefficients = aSize + bSize - 1;
+        std::size_t length = 1;
+        while (length < coefficients)
+            length <<= 1;
+
+        if (length > MAX_TRANSFORM_LENGTH)
+            throw("Operands too large for NTT multiplication");
+
+        bool squaring = (a == b && aSize == bSize);
+        bool parallel = useParallel(std::min(aSize, bSize));
+
+        // Buffers are reserved here rather than on the worker threads, so
+        // they come from the caller's scratch space. One thread transforms
+        // b into the same buffer for each prime in turn.
+        ScratchVector residues[3];
+        ScratchVector others[3];
+        for (int k = 0; k < 3; k++)
+        {
+            residues[k].reserve(length);
+            if (!squaring && (parallel || k == 0))
+                others[k].reserve(length);
+        }
+
+        runTasks(3, parallel, [&](std::size_t k)
+        {
+            convolve(residues[k], others[parallel ? k : 0], a, aSize, b,
+                    bSize, length, squaring, static_cast<int>(k), parallel);
+        });
+
+        if (!parallel || resultSize <= PARALLEL_CHUNK)
+        {
+            // The product fits in resultSize limbs, so nothing is left
+            Limb carry[3];
+            recombine(result, 0, resultSize, coefficients, residues, carry);
+            return;
+        }
+
+        // Each chunk starts from an empty accumulator, and what is left
+        // at its end is then added in where the next chunk begins
+        std::size_t chunks = (resultSize + PARALLEL_CHUNK - 1) /
+            PARALLEL_CHUNK;
+        ScratchVector carries(3 * chunks);
+        runParallel(chunks, [&](std::size_t chunk)
+        {
+            std::size_t begin = chunk * PARALLEL_CHUNK;
+            recombine(result, begin, std::min(resultSize,
+                        begin + PARALLEL_CHUNK), coefficients, residues,
+                    &carries[3 * chunk]);
+        });
+
+        // Limbs of a carry past the end of the result are zero, as are
+        // carries out of its top limb
+        for (std::size_t chunk = 0; chunk + 1 < chunks; chunk++)
+        {
+            std::size_t begin = (chunk + 1) * PARALLEL_CHUNK;
+            std::size_t size = std::min<std::size_t>(3, resultSize - begin);
+            Limb carry = addLimbs(result + begin, result + begin, size,
+                    &carries[3 * chunk], size);
+            for (std::size_t i = begin + size; carry != 0 && i < resultSize;
+                    i++)
+                carry = (++result[i] == 0);
+        }
+    }
+}
@@ -0,0 +1,374 @@
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "BigInt.h"
+#include "BigIntKernels.h"
+#include "BigIntModContext.h"
+
+using namespace BigIntKernels;
+
+/*
+ * Primality testing and prime search.
+ *
+ * isProbablePrime is the Baillie-PSW test: trial division by the primes
+ * below 1024, a strong Fermat (Miller-Rabin) test to base 2, and a strong
+ * Lucas test with Selfridge's parameters. No composite is known to pass
+ * both tests, and there are none below 2^64. Both run in a
+ * BigIntModContext, so their products use Montgomery multiplication.
+ *
+ * nextPrime sieves a window of odd candidates by the primes below 2^16,
+ * and only the ones that survive are tested, as many at a time as
+ * getParallelism() allows. Sieving that deep costs little next to a
+ * single test, and leaves about a third fewer candidates than the primes
+ * below 1024 would.
+*/
+
+namespace
+{
+    // Trial division uses the primes below this
+    const Limb SMALL_PRIME_LIMIT = 1024;
+
+    // nextPrime sieves with the primes below this
+    const Limb SIEVE_PRIME_LIMIT = 65536;
+
+    // Selfridge's search for D gives up on non-squares well before this
+    // many tries, so a perfect square is checked for after it
+    const int SQUARE_CHECK_TRIES = 8;
+
+    /*
+     * The primes below SIEVE_PRIME_LIMIT, and runs of them grouped into
+     * products that fit in a limb.
+    */
+
+    struct SmallPrimes
+    {
+        struct Group
+        {
+            Limb product;
+            std::size_t first;
+            std::size_t last;
+        };
+
+        SmallPrimes()
+        {
+            std::vector<bool> composite(SIEVE_PRIME_LIMIT, false);
+            for (Limb p = 2; p < SIEVE_PRIME_LIMIT; p++)
+            {
+                if (composite[p])
+                    continue;
+
+                primes.push_back(p);
+                for (Limb multiple = p * p; multiple < SIEVE_PRIME_LIMIT;
+                        multiple += p)
+                    composite[multiple] = true;
+            }
+
+            Group group = {1, 0, 0};
+            for (std::size_t i = 0; i < primes.size(); i++)
+            {
+                if (group.product >
+                        std::numeric_limits<Limb>::max() / primes[i])
+                {
+                    group.last = i;
+                    groups.push_back(group);
+                    group = {1, i, 0};
+                }
+                group.product *= primes[i];
+            }
+            group.last = primes.size();
+            groups.push_back(group);
+        }
+
+        std::vector<Limb> primes;
+        std::vector<Group> groups;
+    };
+
+    const SmallPrimes& smallPrimes()
+    {
+        static const SmallPrimes table;
+        return table;
+    }
+
+    /*
+     * Return the non-negative \a n modulo each prime below \a limit, and
+     * possibly a few more, taking one remainder for each group of them.
+     * The other entries are left as zeros.
+    */
+
+    std::vector<Limb> smallResidues(const BigInt& n, Limb limit)
+    {
+        const SmallPrimes& table = smallPrimes();
+        std::vector<Limb> residues(table.primes.size());
+        for (const SmallPrimes::Group& group : table.groups)
+        {
+            if (table.primes[group.first] >= limit)
+                break;
+
+            Limb residue = static_cast<Limb>(n % group.product);
+            for (std::size_t i = group.first; i < group.last; i++)
+                residues[i] = residue % table.primes[i];
+        }
+        return residues;
+    }
+
+    /*
+     * Return the Jacobi symbol (a / m) for an odd m.
+    */
+
+    int jacobiSymbol(Limb a, Limb m)
+    {
+        int result = 1;
+        a %= m;
+        while (a != 0)
+        {
+            while (a % 2 == 0)
+            {
+                a /= 2;
+                if (m % 8 == 3 || m % 8 == 5)
+                    result = -result;
+            }
+
+            std::swap(a, m);
+            if (a % 4 == 3 && m % 4 == 3)
+                result = -result;
+            a %= m;
+        }
+        return m == 1 ? result : 0;
+    }
+
+    /*
+     * Return the Jacobi symbol (d / n) for a small odd d and an odd
+     * n > |d|, by quadratic reciprocity.
+    */
+
+    int jacobiSymbol(long long d, const BigInt& n)
+    {
+        Limb magnitude = static_cast<Limb>(d < 0 ? -d : d);
+        Limb low = static_cast<Limb>(n % 4);
+
+        int result = 1;
+        if (d < 0 && low == 3)
+            result = -result;
+        if (magnitude % 4 == 3 && low == 3)
+            result = -result;
+        return result * jacobiSymbol(static_cast<Limb>(n % magnitude),
+                magnitude);
+    }
+}
+
+/*!
+ * Return whether \a n is prime, by the Baillie-PSW test. A composite that
+ * passes would be the first one known; below 2^64 the answer is exact.
+ * Values below 2 are not prime.
+*/
+
+bool BigInt::isProbablePrime(const BigInt& n)
+{
+    if (!n.nonNegative || n.limbs.empty())
+        return false;
+
+    const SmallPrimes& table = smallPrimes();
+    if (n.limbs.size() == 1 && n.limbs[0] < SMALL_PRIME_LIMIT)
+        return std::binary_search(table.primes.begin(), table.primes.end(),
+                n.limbs[0]);
+
+    std::vector<Limb> residues = smallResidues(n, SMALL_PRIME_LIMIT);
+    for (std::size_t i = 0; table.primes[i] < SMALL_PRIME_LIMIT; i++)
+    {
+        if (residues[i] == 0)
+            return false;
+    }
+    if (n.limbs.size() == 1 &&
+            n.limbs[0] < SMALL_PRIME_LIMIT * SMALL_PRIME_LIMIT)
+        return true;
+
+    BigIntModContext context(n);
+    return isStrongProbablePrime(context) &&
+        isStrongLucasProbablePrime(context);
+}
+
+/*!
+ * Return whether each of \a candidates is prime, as isProbablePrime does.
+ * The candidates are tested side by side when getParallelism() allows
+ * more than one thread.
+*/
+
+std::vector<bool> BigInt::isProbablePrime(
+        const std::vector<BigInt>& candidates)
+{
+    // Threads cannot write neighbouring elements of a std::vector<bool>
+    std::vector<char> results(candidates.size());
+    runTasks(candidates.size(), getParallelism().threads > 1,
+            [&](std::size_t i)
+    {
+        results[i] = isProbablePrime(candidates[i]);
+    });
+
+    return std::vector<bool>(results.begin(), results.end());
+}
+
+/*!
+ * Return the smallest probable prime greater than \a n.
+*/
+
+BigInt BigInt::nextPrime(const BigInt& n)
+{
+    if (n < 2)
+        return BigInt(2);
+
+    // The first odd value above n
+    BigInt start = n + ((n.limbs[0] & 1) != 0 ? 2 : 1);
+    if (start < SMALL_PRIME_LIMIT * SMALL_PRIME_LIMIT)
+    {
+        while (!isProbablePrime(start))
+            start += 2;
+        return start;
+    }
+
+    // Candidates are start + 2i for i in a window that usually holds a
+    // few primes, since their gaps average about 0.7 times the bit length
+    const SmallPrimes& table = smallPrimes();
+    std::size_t window = std::max<std::size_t>(
+            64 * start.limbs.size(), 256);
+    std::size_t batch = getParallelism().threads;
+    while (true)
+    {
+        std::vector<bool> composite(window, false);
+        std::vector<Limb> residues = smallResidues(start,
+                SIEVE_PRIME_LIMIT);
+        for (std::size_t j = 1; j < table.primes.size(); j++)
+        {
+            // start + 2i = 0 (mod p) when i = -start / 2 (mod p)
+            Limb p = table.primes[j];
+            Limb i = (p - residues[j]) % p * ((p + 1) / 2) % p;
+            for (; i < window; i += p)
+                composite[i] = true;
+        }
+
+        std::vector<BigInt> candidates;
+        for (std::size_t i = 0; i < window; i++)
+        {
+            if (!composite[i])
+                candidates.push_back(start + 2 * i);
+            if (candidates.size() < batch && i + 1 < window)
+                continue;
+
+            std::vector<bool> prime = isProbablePrime(candidates);
+            for (std::size_t j = 0; j < candidates.size(); j++)
+            {
+                if (prime[j])
+                    return candidates[j];
+            }
+            candidates.clear();
+        }
+
+        start += 2 * window;
+    }
+}
+
+/*
+ * The strong Fermat test to base 2 for the odd modulus n of \a context:
+ * with n - 1 = d 2^s for an odd d, either 2^d = 1 or 2^(d 2^r) = -1 for
+ * some r < s.
+*/
+
+bool BigInt::isStrongProbablePrime(const BigIntModContext& context)
+{
+    const BigInt& n = context.getModulus();
+    BigInt d = n - 1;
+    std::size_t s = 0;
+    while (d.limbs[s / 64] == 0)
+        s += 64;
+    s += __builtin_ctzll(d.limbs[s / 64]);
+    d >>= s;
+
+    BigInt one = context.toForm(1);
+    BigInt minusOne = context.toForm(-1);
+    BigInt x = context.pow(context.toForm(2), d);
+    if (x == one || x == minusOne)
+        return true;
+
+    for (std::size_t r = 1; r < s; r++)
+    {
+        x = context.sqr(x);
+        if (x == minusOne)
+            return true;
+        if (x == one)
+            return false;
+    }
+    return false;
+}
+
+/*
+ * The strong Lucas test for the odd modulus n of \a context, which must
+ * be above SMALL_PRIME_LIMIT.
+ *
+ * D is the first of 5, -7, 9, -11, ... with Jacobi symbol (D / n) = -1,
+ * P = 1 and Q = (1 - D) / 4. With n + 1 = d 2^s for an odd d, the test
+ * passes if U_d = 0 or V_(d 2^r) = 0 for some r < s. Only V is stepped,
+ * with V_2k = V_k^2 - 2 Q^k and V_(2k+1) = V_k V_(k+1) - P Q^k, and U_d
+ * comes from D U_d = 2 V_(d+1) - P V_d.
+*/
+
+bool BigInt::isStrongLucasProbablePrime(const BigIntModContext& context)
+{
+    const BigInt& n = context.getModulus();
+
+    long long d = 5;
+    for (int tries = 1;; tries++)
+    {
+        int symbol = jacobiSymbol(d, n);
+        if (symbol == -1)
+            break;
+        if (symbol == 0)
+            return false;
+        // The symbol is never -1 for a square
+        if (tries == SQUARE_CHECK_TRIES && isPerfectSquare(n))
+            return false;
+        d = d > 0 ? -(d + 2) : 2 - d;
+    }
+
+    BigInt exponent = n + 1;
+    std::size_t s = 0;
+    while (exponent.limbs[s / 64] == 0)
+        s += 64;
+    s += __builtin_ctzll(exponent.limbs[s / 64]);
+    exponent >>= s;
+
+    BigInt q = context.toForm((1 - d) / 4);
+    BigInt v = context.toForm(2);
+    BigInt next = context.toForm(1);
+    BigInt qPower = next;
+
+    for (std::size_t bit = exponent.bitLength(); bit-- > 0;)
+    {
+        if ((exponent.limbs[bit / 64] >> (bit % 64)) & 1)
+        {
+            // (V_k, V_(k+1)) to (V_(2k+1), V_(2k+2))
+            BigInt qNext = context.mul(qPower, q);
+            v = context.sub(context.mul(v, next), qPower);
+            next = context.sub(context.sqr(next), context.add(qNext, qNext));
+            qPower = context.mul(qPower, qNext);
+        }
+        else
+        {
+            // (V_k, V_(k+1)) to (V_2k, V_(2k+1))
+            next = context.sub(context.mul(v, next), qPower);
+            v = context.sub(context.sqr(v), context.add(qPower, qPower));
+            qPower = context.sqr(qPower);
+        }
+    }
+
+    if (context.add(next, next) == v || v.limbs.empty())
+        return true;
+
+    for (std::size_t r = 1; r < s; r++)
+    {
+        v = context.sub(context.sqr(v), context.add(qPower, qPower));
+        if (v.limbs.empty())
+            return true;
+        qPower = context.sqr(qPower);
+    }
+    return false;
+}
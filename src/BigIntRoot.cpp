@@ -0,0 +1,380 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "BigInt.h"
+#include "BigIntKernels.h"
+
+using namespace BigIntKernels;
+
+/*
+ * Integer roots and perfect powers.
+ *
+ * The k-th root of a large n comes from the root of its top bits. If r is
+ * the root of n >> ks, then (r + 1) << s is above the root of n, and when
+ * r has about half of the root's bits it is close enough that one or two
+ * Newton steps, x -> ((k - 1) x + n / x^(k - 1)) / k, reach it. Newton
+ * steps from above never go below the root, so they can stop as soon as
+ * x^k <= n. The precision doubles at each level, starting from a root of
+ * at most 128 bits found natively, so a root costs a few multiplications
+ * and a division at the full size, plus as much again for the levels
+ * below.
+ *
+ * Squares are first checked against the quadratic residues modulo 64 and
+ * a dozen small odd moduli, which only about 1 in 45000 non-squares pass.
+ * Odd prime powers p are checked modulo primes q = 1 (mod p), where only
+ * 1 in p of the nonzero residues are p-th powers. When the p-th root
+ * would be small, it is instead estimated from the logarithm of n and
+ * checked against the low limb of n, without a pass over all of n.
+*/
+
+namespace
+{
+    // Odd moduli for the square filter. Their product fits in a limb, so
+    // a single remainder gives all of their residues.
+    const unsigned int SQUARE_MODULI[] = {63, 5, 13, 11, 17, 19, 23, 29, 31,
+        37, 41, 43, 47};
+    const Limb SQUARE_MODULI_PRODUCT = 922334673882737115ULL;
+
+    // The number of moduli checked for each odd prime exponent
+    const std::size_t POWER_FILTERS = 4;
+
+    // Roots of up to this many bits are estimated from a logarithm, which
+    // is accurate to well under one for them
+    const long double SMALL_ROOT_BITS = 48;
+
+    /*
+     * For each square modulus, and then for 64, the set of squares as a
+     * mask of bits.
+    */
+
+    struct SquareMasks
+    {
+        static const std::size_t COUNT = sizeof(SQUARE_MODULI) /
+            sizeof(SQUARE_MODULI[0]);
+
+        SquareMasks() : masks()
+        {
+            for (std::size_t i = 0; i < COUNT; i++)
+            {
+                for (Limb x = 0; x < SQUARE_MODULI[i]; x++)
+                    masks[i] |= 1ULL << (x * x % SQUARE_MODULI[i]);
+            }
+            for (Limb x = 0; x < 64; x++)
+                masks[COUNT] |= 1ULL << (x * x % 64);
+        }
+
+        Limb masks[COUNT + 1];
+    };
+
+    const SquareMasks& squareMasks()
+    {
+        static const SquareMasks masks;
+        return masks;
+    }
+
+    long double logarithm(const LimbStorage& x)
+    {
+        std::size_t size = x.size();
+        if (size == 1)
+            return std::log2(static_cast<long double>(x[0]));
+
+        long double top = std::ldexp(static_cast<long double>(x[size - 1]),
+                64) + static_cast<long double>(x[size - 2]);
+        return std::log2(top) + 64.0L * (size - 2);
+    }
+
+    bool isSmallPrime(Limb n)
+    {
+        if (n < 2)
+            return false;
+        for (Limb d = 2; d * d <= n; d++)
+        {
+            if (n % d == 0)
+                return false;
+        }
+        return true;
+    }
+
+    Limb powerModulo(Limb base, Limb exponent, Limb modulus)
+    {
+        DoubleLimb result = 1;
+        DoubleLimb square = base % modulus;
+        for (; exponent != 0; exponent >>= 1)
+        {
+            if (exponent & 1)
+                result = result * square % modulus;
+            square = square * square % modulus;
+        }
+        return static_cast<Limb>(result);
+    }
+
+    /*
+     * Return x^k modulo 2^64.
+    */
+
+    Limb wrappingPower(Limb x, unsigned int k)
+    {
+        Limb result = 1;
+        for (; k != 0; k >>= 1)
+        {
+            if (k & 1)
+                result *= x;
+            x *= x;
+        }
+        return result;
+    }
+
+    /*
+     * Return whether x^k is greater than n.
+    */
+
+    bool powerExceeds(DoubleLimb x, unsigned int k, DoubleLimb n)
+    {
+        if (x <= 1)
+            return x > n;
+
+        DoubleLimb power = 1;
+        for (unsigned int i = 0; i < k; i++)
+        {
+            if (__builtin_mul_overflow(power, x, &power) || power > n)
+                return true;
+        }
+        return false;
+    }
+
+    /*
+     * Return the k-th root of a value of up to 128 bits, correcting a
+     * floating-point estimate.
+    */
+
+    DoubleLimb nativeRoot(DoubleLimb n, unsigned int k)
+    {
+        if (n < 2 || k == 1)
+            return n;
+        if (k >= 128)
+            return 1;
+
+        DoubleLimb x = static_cast<DoubleLimb>(std::pow(
+                    static_cast<long double>(n), 1.0L / k));
+        while (powerExceeds(x, k, n))
+            x--;
+        while (!powerExceeds(x + 1, k, n))
+            x++;
+        return x;
+    }
+
+    /*
+     * Return the k-th root of \a n by Newton steps from \a x, which is at
+     * least the root.
+    */
+
+    BigInt newtonRoot(const BigInt& n, BigInt x, unsigned int k)
+    {
+        while (true)
+        {
+            BigInt power = x.expt(k - 1);
+            if (power * x <= n)
+                return x;
+            x = ((k - 1) * x + n / power) / k;
+        }
+    }
+
+    /*
+     * Return whether the non-negative \a n has a square residue modulo
+     * 64 and each of the square moduli.
+    */
+
+    bool passesSquareFilters(const BigInt& n, Limb low)
+    {
+        const SquareMasks& squares = squareMasks();
+        if (!((squares.masks[SquareMasks::COUNT] >> (low % 64)) & 1))
+            return false;
+
+        Limb residue = static_cast<Limb>(n % SQUARE_MODULI_PRODUCT);
+        for (std::size_t i = 0; i < SquareMasks::COUNT; i++)
+        {
+            if (!((squares.masks[i] >> (residue % SQUARE_MODULI[i])) & 1))
+                return false;
+        }
+        return true;
+    }
+
+    /*
+     * Return whether the positive \a n, whose low limb is \a low and whose
+     * base-2 logarithm is \a bitsLog, is the p-th power of an integer of
+     * at most SMALL_ROOT_BITS bits.
+    */
+
+    bool isSmallPower(const BigInt& n, Limb low, unsigned int p,
+            long double bitsLog)
+    {
+        Limb estimate = static_cast<Limb>(std::exp2(bitsLog / p));
+        for (Limb root = estimate > 0 ? estimate - 1 : 0;
+                root <= estimate + 1; root++)
+        {
+            if (wrappingPower(root, p) == low && BigInt(root).expt(p) == n)
+                return true;
+        }
+        return false;
+    }
+
+    /*
+     * Return whether the non-negative \a n is a p-th power residue modulo
+     * the first few primes q = 1 (mod p), for an odd prime p.
+    */
+
+    bool passesPowerFilters(const BigInt& n, unsigned int p)
+    {
+        std::vector<Limb> moduli;
+        Limb product = 1;
+        for (Limb q = 2 * static_cast<Limb>(p) + 1;
+                moduli.size() < POWER_FILTERS; q += 2 * p)
+        {
+            if (!isSmallPrime(q))
+                continue;
+            if (product > std::numeric_limits<Limb>::max() / q)
+                break;
+            moduli.push_back(q);
+            product *= q;
+        }
+
+        Limb residue = static_cast<Limb>(n % product);
+        for (Limb q : moduli)
+        {
+            Limb r = residue % q;
+            if (r != 0 && powerModulo(r, (q - 1) / p, q) != 1)
+                return false;
+        }
+        return true;
+    }
+}
+
+/*!
+ * Return the integer square root of \a n, the largest r with r^2 <= n.
+ * Throws if \a n is negative.
+*/
+
+BigInt BigInt::isqrt(const BigInt& n)
+{
+    if (!n.nonNegative)
+        throw ("isqrt requires a non-negative value");
+
+    return iroot(n, 2);
+}
+
+/*!
+ * Return the integer \a k-th root of \a n, rounded towards zero. Throws if
+ * \a k is zero, or if \a k is even and \a n is negative.
+*/
+
+BigInt BigInt::iroot(const BigInt& n, unsigned int k)
+{
+    if (k == 0)
+        throw ("iroot requires a positive degree");
+    if (!n.nonNegative && k % 2 == 0)
+        throw ("Even roots require a non-negative value");
+
+    std::size_t bits = n.bitLength();
+    if (k == 1 || bits <= 1)
+        return n;
+    // n < 2^k, so the root is 1
+    if (bits <= k)
+        return BigInt(n.nonNegative ? 1 : -1);
+
+    // Each level drops k * s bits, leaving a root of about half as many
+    // bits as the one above it
+    std::vector<std::size_t> shifts;
+    std::size_t dropped = 0;
+    while (bits > 128 && bits > k)
+    {
+        std::size_t s = std::max<std::size_t>(bits / k / 2, 1);
+        shifts.push_back(s);
+        dropped += k * s;
+        bits -= k * s;
+    }
+
+    BigInt magnitude = abs(n);
+    BigInt top = magnitude >> dropped;
+    BigInt root;
+    if (bits <= k)
+        root = BigInt(top.limbs.empty() ? 0 : 1);
+    else
+        root = BigInt(nativeRoot(static_cast<UInt128>(top), k));
+
+    for (std::size_t i = shifts.size(); i-- > 0;)
+    {
+        dropped -= k * shifts[i];
+        root = newtonRoot(magnitude >> dropped, (root + 1) << shifts[i], k);
+    }
+
+    return n.nonNegative ? root : negate(std::move(root));
+}
+
+/*!
+ * Return whether \a n is the square of an integer.
+*/
+
+bool BigInt::isPerfectSquare(const BigInt& n)
+{
+    if (!n.nonNegative)
+        return false;
+    if (n.limbs.empty())
+        return true;
+    if (!passesSquareFilters(n, n.limbs[0]))
+        return false;
+
+    BigInt root = isqrt(n);
+    return root * root == n;
+}
+
+/*!
+ * Return whether \a n is m^k for some integers m and k >= 2. This
+ * includes 0, 1 and -1, while other negative values only count as odd
+ * powers.
+*/
+
+bool BigInt::isPerfectPower(const BigInt& n)
+{
+    std::size_t bits = n.bitLength();
+    if (bits <= 1)
+        return true;
+    if (isPerfectSquare(n))
+        return true;
+
+    // Only prime exponents need to be tried, and every one of them must
+    // divide the number of trailing zeros
+    std::size_t zeros = 0;
+    while (n.limbs[zeros / 64] == 0)
+        zeros += 64;
+    zeros += __builtin_ctzll(n.limbs[zeros / 64]);
+
+    // |m| >= 2, so m^p has more than p bits
+    std::vector<bool> composite(bits, false);
+    BigInt magnitude = abs(n);
+    long double bitsLog = logarithm(n.limbs);
+    for (std::size_t p = 3; p < bits; p += 2)
+    {
+        if (composite[p])
+            continue;
+        for (std::size_t multiple = p * p; multiple < bits;
+                multiple += 2 * p)
+            composite[multiple] = true;
+
+        if (zeros != 0 && zeros % p != 0)
+            continue;
+
+        unsigned int exponent = static_cast<unsigned int>(p);
+        if (bitsLog / p <= SMALL_ROOT_BITS)
+        {
+            if (isSmallPower(magnitude, n.limbs[0], exponent, bitsLog))
+                return true;
+        }
+        else if (passesPowerFilters(magnitude, exponent) &&
+                iroot(magnitude, exponent).expt(exponent) == magnitude)
+            return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,262 @@
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "BigInt.h"
+#include "BigIntKernels.h"
+
+/*
+ * A work-stealing thread pool for the parallel parts of multiplication.
+ *
+ * Each worker has its own queue of jobs. A thread that runs a batch of
+ * tasks pushes them onto its own queue, or onto a shared one if it is not
+ * a worker, and then works through jobs until the whole batch is done:
+ * its own newest first, and otherwise the oldest of another queue. Idle
+ * workers steal the same way, and sleep once every queue is empty. Since
+ * a waiting thread keeps running jobs, tasks may run batches of their own.
+*/
+
+namespace BigIntKernels
+{
+    namespace
+    {
+        struct Batch
+        {
+            const std::function<void(std::size_t)>* task;
+            std::atomic<std::size_t> pending;
+            std::mutex errorMutex;
+            std::exception_ptr error;
+        };
+
+        struct Job
+        {
+            Batch* batch;
+            std::size_t index;
+        };
+
+        class ThreadPool
+        {
+            public:
+                explicit ThreadPool(std::size_t workers);
+                ~ThreadPool();
+
+                ThreadPool(const ThreadPool&) = delete;
+                ThreadPool& operator=(const ThreadPool&) = delete;
+
+                void run(std::size_t count,
+                        const std::function<void(std::size_t)>& task);
+
+            private:
+                struct Queue
+                {
+                    std::mutex mutex;
+                    std::deque<Job> jobs;
+                };
+
+                std::size_t homeQueue() const;
+                bool runOne(std::size_t home);
+                void work(std::size_t index);
+
+                // One queue per worker, then the one other threads share
+                std::vector<std::unique_ptr<Queue>> queues;
+                std::vector<std::thread> threads;
+                std::atomic<std::size_t> queued;
+
+                std::mutex sleepMutex;
+                std::condition_variable wake;
+                bool stopping;
+        };
+
+        // The pool that the current thread works for, and its queue
+        thread_local const ThreadPool* workerPool = nullptr;
+        thread_local std::size_t workerQueue = 0;
+
+        void execute(const Job& job)
+        {
+            Batch* batch = job.batch;
+            try
+            {
+                (*batch->task)(job.index);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(batch->errorMutex);
+                if (!batch->error)
+                    batch->error = std::current_exception();
+            }
+
+            // The batch may be gone as soon as this reaches zero
+            batch->pending.fetch_sub(1, std::memory_order_acq_rel);
+        }
+
+        ThreadPool::ThreadPool(std::size_t workers) : queued(0),
+            stopping(false)
+        {
+            for (std::size_t i = 0; i <= workers; i++)
+                queues.emplace_back(new Queue);
+            for (std::size_t i = 0; i < workers; i++)
+                threads.emplace_back(&ThreadPool::work, this, i);
+        }
+
+        ThreadPool::~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (std::thread& thread : threads)
+                thread.join();
+        }
+
+        /*
+         * Run task(i) for every i below count, taking part until they have
+         * all finished.
+        */
+
+        void ThreadPool::run(std::size_t count,
+                const std::function<void(std::size_t)>& task)
+        {
+            Batch batch;
+            batch.task = &task;
+            batch.pending.store(count, std::memory_order_relaxed);
+
+            std::size_t home = homeQueue();
+            {
+                std::lock_guard<std::mutex> lock(queues[home]->mutex);
+                for (std::size_t i = count; i-- > 1;)
+                    queues[home]->jobs.push_back({&batch, i});
+            }
+            queued.fetch_add(count - 1, std::memory_order_release);
+            {
+                // Taking the lock keeps a worker from missing the wake-up
+                // between checking for jobs and going to sleep
+                std::lock_guard<std::mutex> lock(sleepMutex);
+            }
+            wake.notify_all();
+
+            execute({&batch, 0});
+            while (batch.pending.load(std::memory_order_acquire) != 0)
+            {
+                if (!runOne(home))
+                    std::this_thread::yield();
+            }
+
+            if (batch.error)
+                std::rethrow_exception(batch.error);
+        }
+
+        std::size_t ThreadPool::homeQueue() const
+        {
+            return workerPool == this ? workerQueue : queues.size() - 1;
+        }
+
+        /*
+         * Run one job, preferring the newest on the \a home queue and
+         * otherwise stealing the oldest from another. Return false if
+         * every queue was empty.
+        */
+
+        bool ThreadPool::runOne(std::size_t home)
+        {
+            std::size_t count = queues.size();
+            for (std::size_t offset = 0; offset < count; offset++)
+            {
+                Queue& queue = *queues[(home + offset) % count];
+                Job job;
+                {
+                    std::lock_guard<std::mutex> lock(queue.mutex);
+                    if (queue.jobs.empty())
+                        continue;
+                    if (offset == 0)
+                    {
+                        job = queue.jobs.back();
+                        queue.jobs.pop_back();
+                    }
+                    else
+                    {
+                        job = queue.jobs.front();
+                        queue.jobs.pop_front();
+                    }
+                }
+
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                execute(job);
+                return true;
+            }
+
+            return false;
+        }
+
+        void ThreadPool::work(std::size_t index)
+        {
+            workerPool = this;
+            workerQueue = index;
+
+            while (true)
+            {
+                if (runOne(index))
+                    continue;
+
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                wake.wait(lock, [this]()
+                {
+                    return stopping ||
+                        queued.load(std::memory_order_acquire) != 0;
+                });
+                if (stopping)
+                    return;
+            }
+        }
+
+        std::unique_ptr<ThreadPool>& pool()
+        {
+            static std::unique_ptr<ThreadPool> instance;
+            return instance;
+        }
+    }
+
+    void setWorkerThreads(std::size_t threads)
+    {
+        // The calling thread is one of them
+        std::size_t workers = threads > 1 ? threads - 1 : 0;
+        pool().reset(workers > 0 ? new ThreadPool(workers) : nullptr);
+    }
+
+    void runParallel(std::size_t count,
+            const std::function<void(std::size_t)>& task)
+    {
+        ThreadPool* threads = pool().get();
+        if (!threads || count <= 1)
+        {
+            for (std::size_t i = 0; i < count; i++)
+                task(i);
+            return;
+        }
+
+        threads->run(count, task);
+    }
+
+    void runTasks(std::size_t count, bool parallel,
+            const std::function<void(std::size_t)>& task)
+    {
+        if (parallel)
+            runParallel(count, task);
+        else
+        {
+            for (std::size_t i = 0; i < count; i++)
+                task(i);
+        }
+    }
+
+    bool useParallel(std::size_t size)
+    {
+        const BigInt::Parallelism& parallelism = BigInt::getParallelism();
+        return parallelism.threads > 1 && size >= parallelism.threshold;
+    }
+}
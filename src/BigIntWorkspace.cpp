@@ -0,0 +1,243 @@
+#include <limits>
+
+#include "BigIntKernels.h"
+#include "BigIntWorkspace.h"
+
+namespace
+{
+    /*
+     * Return the largest value of the given number of limbs, the operand
+     * that the reserve functions try each operation on.
+    */
+
+    BigInt allOnes(std::size_t limbs)
+    {
+        return (BigInt(1) << (64 * limbs)) - BigInt(1);
+    }
+}
+
+/*!
+ * Create an empty workspace. Its pool keeps every block, of any size,
+ * until release() or the destructor.
+*/
+
+BigIntWorkspace::BigIntWorkspace() :
+    resource(BigIntMemoryResource::getCurrent()),
+    pool(std::numeric_limits<std::size_t>::max(),
+            std::numeric_limits<std::size_t>::max())
+{
+}
+
+/*!
+ * Store \a a * \a b in \a result.
+*/
+
+void BigIntWorkspace::mul(BigInt& result, const BigInt& a, const BigInt& b)
+{
+    BigIntKernels::ScratchScope scope(pool);
+    bool productNonNegative = (a.nonNegative == b.nonNegative);
+
+    if (&result == &a || &result == &b)
+    {
+        BigInt::multiplyMagnitudes(product.limbs, a.limbs, b.limbs);
+        result.limbs = product.limbs;
+    }
+    else
+        BigInt::multiplyMagnitudes(result.limbs, a.limbs, b.limbs);
+
+    result.nonNegative = productNonNegative;
+    result.normalize();
+}
+
+/*!
+ * Store the quotient and remainder of \a dividend by \a divisor in
+ * \a quotient and \a remainder, rounded as BigInt::divmod rounds them.
+*/
+
+void BigIntWorkspace::divmod(BigInt& quotient, BigInt& remainder,
+        const BigInt& dividend, const BigInt& divisor)
+{
+    if (&quotient == &remainder)
+        throw ("divmod needs different BigInts for quotient and remainder");
+    if (divisor.limbs.empty())
+        throw ("Attempt to divide by zero");
+
+    BigIntKernels::ScratchScope scope(pool);
+    bool quotientNonNegative = (dividend.nonNegative == divisor.nonNegative);
+    bool remainderNonNegative = dividend.nonNegative;
+
+    if (&quotient == &dividend || &quotient == &divisor ||
+            &remainder == &dividend || &remainder == &divisor)
+    {
+        BigInt::divideMagnitudes(dividend, divisor, &quotientAside,
+                &remainderAside);
+        quotient.limbs = quotientAside.limbs;
+        remainder.limbs = remainderAside.limbs;
+    }
+    else
+        BigInt::divideMagnitudes(dividend, divisor, &quotient, &remainder);
+
+    quotient.nonNegative = quotientNonNegative;
+    quotient.normalize();
+    remainder.nonNegative = remainderNonNegative;
+    remainder.normalize();
+}
+
+/*!
+ * Store \a base raised to \a exponent, reduced modulo \a modulus into
+ * the range [0, modulus), in \a result. See BigInt::powmod.
+*/
+
+void BigIntWorkspace::powmod(BigInt& result, const BigInt& base,
+        const BigInt& exponent, const BigInt& modulus, bool constantTime)
+{
+    if (!modulus.nonNegative || modulus.limbs.empty())
+        throw ("powmod requires a positive modulus");
+    if (!exponent.nonNegative)
+        throw ("powmod only accepts non-negative exponents");
+    if (constantTime && (modulus.limbs[0] & 1) == 0)
+        throw ("Constant-time powmod requires an odd modulus");
+
+    BigIntKernels::ScratchScope scope(pool);
+    contextFor(modulus).powResidue(result, base, exponent, constantTime);
+}
+
+/*!
+ * Warm the workspace up for multiplying an \a aLimbs limb value by a
+ * \a bLimbs limb one.
+*/
+
+void BigIntWorkspace::reserveMul(std::size_t aLimbs, std::size_t bLimbs)
+{
+    BigInt a = allOnes(aLimbs);
+    BigInt b = allOnes(bLimbs);
+    mul(product, a, b);
+}
+
+/*!
+ * Warm the workspace up for dividing a \a dividendLimbs limb value by a
+ * \a divisorLimbs limb one.
+*/
+
+void BigIntWorkspace::reserveDivmod(std::size_t dividendLimbs,
+        std::size_t divisorLimbs)
+{
+    if (divisorLimbs == 0)
+        return;
+
+    BigInt dividend = allOnes(dividendLimbs);
+    BigInt divisor = allOnes(divisorLimbs);
+    divmod(quotientAside, remainderAside, dividend, divisor);
+}
+
+/*!
+ * Warm the workspace up for powmod with a \a modulusLimbs limb modulus and
+ * an \a exponentLimbs limb exponent. Both odd and even moduli are tried,
+ * since they are reduced differently, but the context that powmod keeps is
+ * left alone.
+*/
+
+void BigIntWorkspace::reservePowmod(std::size_t modulusLimbs,
+        std::size_t exponentLimbs)
+{
+    if (modulusLimbs == 0)
+        return;
+
+    BigIntKernels::ScratchScope scope(pool);
+    BigInt odd = allOnes(modulusLimbs);
+    BigInt even = odd - BigInt(1);
+    BigInt exponent = allOnes(exponentLimbs);
+
+    BigIntModContext(odd).powResidue(product, odd, exponent, false);
+    if (even.limbs.size() == modulusLimbs)
+        BigIntModContext(even).powResidue(product, odd, exponent, false);
+}
+
+/*!
+ * Return the peak scratch space, in bytes, of multiplying an \a aLimbs
+ * limb value by a \a bLimbs limb one. This does not count the product.
+*/
+
+std::size_t BigIntWorkspace::mulScratchBytes(std::size_t aLimbs,
+        std::size_t bLimbs)
+{
+    BigIntWorkspace workspace;
+    workspace.reserveMul(aLimbs, bLimbs);
+    return workspace.peakBytes();
+}
+
+/*!
+ * Return the peak scratch space, in bytes, of dividing a \a dividendLimbs
+ * limb value by a \a divisorLimbs limb one.
+*/
+
+std::size_t BigIntWorkspace::divmodScratchBytes(std::size_t dividendLimbs,
+        std::size_t divisorLimbs)
+{
+    BigIntWorkspace workspace;
+    workspace.reserveDivmod(dividendLimbs, divisorLimbs);
+    return workspace.peakBytes();
+}
+
+/*!
+ * Return the peak scratch space, in bytes, of powmod with a
+ * \a modulusLimbs limb modulus and an \a exponentLimbs limb exponent,
+ * including setting up the modulus.
+*/
+
+std::size_t BigIntWorkspace::powmodScratchBytes(std::size_t modulusLimbs,
+        std::size_t exponentLimbs)
+{
+    BigIntWorkspace workspace;
+    workspace.reservePowmod(modulusLimbs, exponentLimbs);
+    return workspace.peakBytes();
+}
+
+/*!
+ * Return the most scratch space, in bytes, that any one call has used at
+ * once so far.
+*/
+
+std::size_t BigIntWorkspace::peakBytes() const
+{
+    return pool.peakBytesInUse();
+}
+
+/*!
+ * Give back the scratch blocks and the powmod context. The result buffers
+ * kept for aliased calls stay.
+*/
+
+void BigIntWorkspace::release()
+{
+    pool.release();
+    context.reset();
+}
+
+/*!
+ * Return this thread's own workspace. It uses the default memory resource,
+ * whatever is current when it is first used.
+*/
+
+BigIntWorkspace& BigIntWorkspace::forThread()
+{
+    BigIntMemoryScope scope(*BigIntMemoryResource::getDefault());
+    thread_local BigIntWorkspace workspace;
+    return workspace;
+}
+
+/*
+ * Return the context for \a modulus, building it if the one kept is for
+ * another modulus. It is built from the workspace's own resource, since it
+ * may outlive the one current now.
+*/
+
+const BigIntModContext& BigIntWorkspace::contextFor(const BigInt& modulus)
+{
+    if (!context || !(context->getModulus() == modulus))
+    {
+        BigIntMemoryScope scope(*resource);
+        context.reset(new BigIntModContext(modulus));
+    }
+    return *context;
+}
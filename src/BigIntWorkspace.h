@@ -0,0 +1,90 @@
+#ifndef BIGINT_WORKSPACE_H
+#define BIGINT_WORKSPACE_H
+
+#include <cstddef>
+#include <memory>
+
+#include "BigInt.h"
+#include "BigIntMemory.h"
+#include "BigIntModContext.h"
+
+/*!
+ * \class BigIntWorkspace
+ *
+ * \brief Scratch space that multiplication, division and modular
+ * exponentiation keep between calls.
+ *
+ * The operators take their temporaries from a pool shared by the whole
+ * thread, which only keeps a few blocks of each size. A workspace has a
+ * pool of its own that keeps every block it is given back, and writes
+ * results into BigInts the caller already owns, so a loop that repeats
+ * operations on operands of similar sizes reaches the heap only while the
+ * workspace is warming up:
+ *
+ * \code
+ * BigIntWorkspace workspace;
+ * workspace.reserveMul(64, 64);
+ * for (...)
+ *     workspace.mul(product, a, b);
+ * \endcode
+ *
+ * The reserve functions do that warming up in advance, by running an
+ * operation on operands of the given sizes in 64-bit limbs, and the
+ * scratch functions report how much scratch space such an operation
+ * takes at its peak.
+ * powmod keeps the context for the last modulus it was given, so changing
+ * the modulus rebuilds it.
+ *
+ * A result passed in may be one of the operands. Buffers that outlive a
+ * call come from the memory resource that was current when the workspace
+ * was constructed. A workspace is not safe to use from several threads at
+ * once; forThread() gives each thread its own.
+*/
+
+class BigIntWorkspace
+{
+    public:
+        BigIntWorkspace();
+
+        BigIntWorkspace(const BigIntWorkspace&) = delete;
+        BigIntWorkspace& operator=(const BigIntWorkspace&) = delete;
+
+        void mul(BigInt& result, const BigInt& a, const BigInt& b);
+        void divmod(BigInt& quotient, BigInt& remainder,
+                const BigInt& dividend, const BigInt& divisor);
+        void powmod(BigInt& result, const BigInt& base,
+                const BigInt& exponent, const BigInt& modulus,
+                bool constantTime = false);
+
+        void reserveMul(std::size_t aLimbs, std::size_t bLimbs);
+        void reserveDivmod(std::size_t dividendLimbs,
+                std::size_t divisorLimbs);
+        void reservePowmod(std::size_t modulusLimbs,
+                std::size_t exponentLimbs);
+
+        static std::size_t mulScratchBytes(std::size_t aLimbs,
+                std::size_t bLimbs);
+        static std::size_t divmodScratchBytes(std::size_t dividendLimbs,
+                std::size_t divisorLimbs);
+        static std::size_t powmodScratchBytes(std::size_t modulusLimbs,
+                std::size_t exponentLimbs);
+
+        std::size_t peakBytes() const;
+        void release();
+
+        static BigIntWorkspace& forThread();
+
+    private:
+        const BigIntModContext& contextFor(const BigInt& modulus);
+
+        BigIntMemoryResource* resource;
+        BigIntPool pool;
+        std::unique_ptr<BigIntModContext> context;
+
+        // Results are formed here when they are also operands
+        BigInt product;
+        BigInt quotientAside;
+        BigInt remainderAside;
+};
+
+#endif
@@ -1,7 +1,44 @@
+#include <algorithm>
+#include <atomic>
 #include <catch.hpp>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
 #include "../src/BigInt.h"
+#include "../src/BigIntExpr.h"
+#include "../src/BigIntMemory.h"
+#include "../src/BigIntModContext.h"
+#include "../src/BigIntWorkspace.h"
+
+namespace
+{
+    // Every call to the global operator new, so that tests can check how
+    // many allocations an operation makes. Worker threads count too.
+    std::atomic<std::size_t> allocations(0);
+}
+
+void* operator new(std::size_t size)
+{
+    allocations++;
+    if (void* memory = std::malloc(size == 0 ? 1 : size))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
 
 TEST_CASE("Constructor tests")
 {
@@ -53,7 +90,7 @@ TEST_CASE("Constructor tests")
 
     SECTION("Constructor with non-integer string fails")
     {
-        CHECK_THROWS(BigInt test("123abc"));
+        CHECK_THROWS(BigInt("123abc"));
     }
 }
 
@@ -587,6 +624,145 @@ TEST_CASE("Exponentiation tests")
     SECTION("Invalid exponents")
     {
         CHECK_THROWS(BigInt("100").expt(BigInt(-3)));
+        CHECK_THROWS(BigInt("100").expt(-3));
+        CHECK_THROWS(BigInt("2").expt(BigInt("100000000000000000000")));
+    }
+
+    SECTION("Native exponents")
+    {
+        CHECK(BigInt("12").expt(37) ==
+                BigInt("8505622499821102144576131684114829934592"));
+        CHECK(BigInt("-3").expt(5) == BigInt("-243"));
+        CHECK(BigInt("-3").expt(4) == BigInt("81"));
+        CHECK(BigInt("0").expt(0) == BigInt("1"));
+        CHECK(BigInt("0").expt(7) == BigInt("0"));
+        CHECK(BigInt("18446744073709551617").expt(7) ==
+                BigInt("7268387242956068908251378512627658888844503691426"
+                    "6246865139655302676407603573745516144342188473776"
+                    "1627744027405531496844460985231081473"));
+    }
+
+    SECTION("Powers of two and ten")
+    {
+        CHECK(BigInt("2").expt(200) ==
+                BigInt("1606938044258990275541962092341162602522202993782"
+                    "792835301376"));
+        CHECK(BigInt("-2").expt(BigInt("3")) == BigInt("-8"));
+        CHECK(BigInt("6").expt(100) ==
+                BigInt("6533186235000709060966902671580578205371437104729"
+                    "54871543071966369497141477376"));
+        CHECK(BigInt("10").expt(100) == BigInt("1" + std::string(100, '0')));
+        CHECK(BigInt("1000").expt(33) == BigInt("1" + std::string(99, '0')));
+    }
+
+    SECTION("Exponents too large for native integers")
+    {
+        BigInt huge("100000000000000000000000000001");
+        CHECK(BigInt("1").expt(huge) == BigInt("1"));
+        CHECK(BigInt("-1").expt(huge) == BigInt("-1"));
+        CHECK(BigInt("0").expt(huge) == BigInt("0"));
+    }
+}
+
+TEST_CASE("Modular exponentiation tests")
+{
+    BigInt mersenne127 = BigInt("2").expt(127) - BigInt("1");
+    BigInt mersenne521 = BigInt("2").expt(521) - BigInt("1");
+
+    SECTION("Odd moduli")
+    {
+        CHECK(BigInt::powmod(BigInt("4"), BigInt("13"), BigInt("497")) ==
+                BigInt("445"));
+        CHECK(BigInt::powmod(mersenne127, BigInt("65537"), mersenne521) ==
+                BigInt("66923595637005185243013944266007915850711189884013"
+                    "51975047721893035084857132896712140820533380039442"
+                    "21900061461706087741460074477513076857941117057279"
+                    "2837083"));
+        CHECK(BigInt::powmod(BigInt("3"), BigInt("1" + std::string(40, '0')),
+                    BigInt("1" + std::string(50, '0')) + BigInt("1")) ==
+                BigInt("87766838510922399331825624435911156285018420120109"));
+    }
+
+    SECTION("Even moduli")
+    {
+        CHECK(BigInt::powmod(BigInt("-7"), BigInt("3"), BigInt("10")) ==
+                BigInt("7"));
+        CHECK(BigInt::powmod(BigInt("123456789123456789"),
+                    BigInt("1" + std::string(30, '0')) + BigInt("7"),
+                    BigInt("2").expt(200)) ==
+                BigInt("39741902369874298267969619842231989088271062036244"
+                    "637134621"));
+    }
+
+    SECTION("Constant-time mode")
+    {
+        CHECK(BigInt::powmod(mersenne127, BigInt("65537"), mersenne521,
+                    true) ==
+                BigInt::powmod(mersenne127, BigInt("65537"), mersenne521));
+        CHECK(BigInt::powmod(BigInt("4"), BigInt("13"), BigInt("497"),
+                    true) == BigInt("445"));
+        CHECK_THROWS(BigInt::powmod(BigInt("4"), BigInt("13"), BigInt("498"),
+                    true));
+    }
+
+    SECTION("Edge cases")
+    {
+        CHECK(BigInt::powmod(BigInt("5"), BigInt("0"), BigInt("7")) ==
+                BigInt("1"));
+        CHECK(BigInt::powmod(BigInt("5"), BigInt("3"), BigInt("1")) ==
+                BigInt("0"));
+        CHECK(BigInt::powmod(BigInt("0"), BigInt("3"), BigInt("7")) ==
+                BigInt("0"));
+        CHECK_THROWS(BigInt::powmod(BigInt("5"), BigInt("3"), BigInt("0")));
+        CHECK_THROWS(BigInt::powmod(BigInt("5"), BigInt("3"), BigInt("-7")));
+        CHECK_THROWS(BigInt::powmod(BigInt("5"), BigInt("-3"), BigInt("7")));
+    }
+}
+
+TEST_CASE("Modular context tests")
+{
+    BigInt prime = BigInt("2").expt(127) - BigInt("1");
+
+    SECTION("Values stay in form between operations")
+    {
+        BigIntModContext context(prime);
+        BigInt a = context.toForm(BigInt("-5"));
+        BigInt b = context.toForm(BigInt("12345678901234567890123"));
+
+        CHECK(context.fromForm(context.add(a, b)) ==
+                BigInt("12345678901234567890118"));
+        CHECK(context.fromForm(context.sub(a, b)) ==
+                prime - BigInt("12345678901234567890128"));
+        CHECK(context.fromForm(context.mul(a, b)) ==
+                prime - BigInt("61728394506172839450615"));
+        CHECK(context.fromForm(context.sqr(a)) == BigInt("25"));
+        CHECK(context.fromForm(context.pow(a, BigInt("3"))) ==
+                prime - BigInt("125"));
+        CHECK(context.fromForm(context.pow(a, BigInt("3"), true)) ==
+                prime - BigInt("125"));
+        CHECK(context.mul(a, context.inverse(a)) ==
+                context.toForm(BigInt("1")));
+    }
+
+    SECTION("Even moduli")
+    {
+        BigIntModContext context(BigInt("1000"));
+        BigInt a = context.toForm(BigInt("1234"));
+        BigInt b = context.toForm(BigInt("999"));
+
+        CHECK(context.fromForm(context.mul(a, b)) == BigInt("766"));
+        CHECK(context.fromForm(context.inverse(b)) == BigInt("999"));
+        CHECK_THROWS(context.inverse(context.toForm(BigInt("2"))));
+        CHECK_THROWS(context.pow(a, BigInt("3"), true));
+    }
+
+    SECTION("Values must be reduced")
+    {
+        BigIntModContext context(BigInt("97"));
+        CHECK_THROWS(context.mul(BigInt("97"), BigInt("1")));
+        CHECK_THROWS(context.add(BigInt("-1"), BigInt("1")));
+        CHECK_THROWS(BigIntModContext(BigInt("0")));
+        CHECK_THROWS(BigIntModContext(BigInt("-97")));
     }
 }
 
@@ -678,3 +854,1517 @@ TEST_CASE("Division tests")
         }
     }
 }
+
+TEST_CASE("Multi-limb tests")
+{
+    SECTION("String conversion round trips")
+    {
+        std::string big = "115792089237316195423570985008687916254841623943611"
+            "226950176641498270422887601";
+        CHECK(static_cast<std::string>(BigInt(big)) == big);
+        CHECK(static_cast<std::string>(BigInt("-" + big)) == "-" + big);
+        CHECK(static_cast<std::string>(BigInt("000000000000000000000000123"))
+                == "123");
+        CHECK(static_cast<std::string>(BigInt("-0")) == "0");
+    }
+
+    SECTION("Carries and borrows cross limb boundaries")
+    {
+        CHECK(BigInt("18446744073709551615") + 1 ==
+                BigInt("18446744073709551616"));
+        CHECK(BigInt("18446744073709551616") - 1 ==
+                BigInt("18446744073709551615"));
+        CHECK(BigInt("9999999999999999999999999999999999999999") + 1 ==
+                BigInt("10000000000000000000000000000000000000000"));
+        CHECK(BigInt("-9999999999999999999999999999999999999999") -
+                BigInt("18446744073709551616") ==
+                BigInt("-10000000000000000000018446744073709551615"));
+    }
+
+    SECTION("Multiplication and division across limbs")
+    {
+        BigInt b("340282366920938463463374607431768223801");
+        BigInt square("1157920892373161954235709850086879162548416239436112"
+                "26950176641498270422887601");
+        CHECK(b * b == square);
+        CHECK(square / BigInt("18446744073709551615") ==
+                BigInt("6277101735386680764176071790128605335034287975858"
+                    "341699699"));
+        CHECK(square / b == b);
+    }
+}
+
+TEST_CASE("Small value tests")
+{
+    BigInt maxTwoLimbs("340282366920938463463374607431768211455");
+    BigInt twoTo128("340282366920938463463374607431768211456");
+
+    SECTION("Results crossing 128 bits")
+    {
+        CHECK(maxTwoLimbs + 1 == twoTo128);
+        CHECK(twoTo128 - 1 == maxTwoLimbs);
+        CHECK(BigInt("18446744073709551615") * BigInt("18446744073709551615")
+                == BigInt("340282366920938463426481119284349108225"));
+        CHECK(BigInt("18446744073709551616") * BigInt("18446744073709551616")
+                == twoTo128);
+        CHECK(maxTwoLimbs * -3 ==
+                BigInt("-1020847100762815390390123822295304634365"));
+        CHECK((twoTo128 + 7) / BigInt("18446744073709551616") ==
+                BigInt("18446744073709551616"));
+        CHECK((twoTo128 + 7) % BigInt("18446744073709551617") == 8);
+    }
+
+    SECTION("Values shrinking back below 128 bits")
+    {
+        BigInt value("6277101735386680763835789423207666416102355444464034"
+                "512896");
+        value -= BigInt("627710173538668076383578942320766641610235544446"
+                "4034512891");
+        CHECK(value == 5);
+
+        BigInt copy = value;
+        CHECK(copy == 5);
+        CHECK(copy * copy == 25);
+
+        value += maxTwoLimbs;
+        CHECK(value == BigInt("340282366920938463463374607431768211460"));
+        CHECK(copy == 5);
+    }
+}
+
+TEST_CASE("Built-in integer tests")
+{
+    BigInt::Int128 int128Min = -(static_cast<BigInt::Int128>(1) << 126) * 2;
+    BigInt::UInt128 uint128Max = ~static_cast<BigInt::UInt128>(0);
+
+    SECTION("Constructing from every width")
+    {
+        CHECK(BigInt(INT64_MIN) == BigInt("-9223372036854775808"));
+        CHECK(BigInt(UINT64_MAX) == BigInt("18446744073709551615"));
+        CHECK(BigInt(int128Min) ==
+                BigInt("-170141183460469231731687303715884105728"));
+        CHECK(BigInt(uint128Max) ==
+                BigInt("340282366920938463463374607431768211455"));
+        CHECK(BigInt(static_cast<short>(-7)) == BigInt("-7"));
+        CHECK(BigInt(0u).isNonNegative());
+    }
+
+    SECTION("Converting back checks the range")
+    {
+        CHECK(static_cast<std::int64_t>(BigInt("-9223372036854775808")) ==
+                INT64_MIN);
+        CHECK(static_cast<std::uint64_t>(BigInt("18446744073709551615")) ==
+                UINT64_MAX);
+        CHECK(static_cast<BigInt::Int128>(BigInt(int128Min)) == int128Min);
+        CHECK(static_cast<BigInt::UInt128>(BigInt(uint128Max)) ==
+                uint128Max);
+        CHECK(static_cast<int>(BigInt(-42)) == -42);
+
+        CHECK_THROWS(static_cast<std::int64_t>(
+                    BigInt("9223372036854775808")));
+        CHECK_THROWS(static_cast<std::uint64_t>(BigInt(-1)));
+        CHECK_THROWS(static_cast<BigInt::UInt128>(
+                    BigInt("340282366920938463463374607431768211456")));
+    }
+
+    SECTION("Arithmetic in both orders")
+    {
+        BigInt big("1000000000000000000000000000000");
+        CHECK(big + 1 == BigInt("1000000000000000000000000000001"));
+        CHECK(1 + big == big + 1);
+        CHECK(big - UINT64_MAX ==
+                BigInt("999999999981553255926290448385"));
+        CHECK(5 - big == BigInt("-999999999999999999999999999995"));
+        CHECK(big * -3LL == BigInt("-3000000000000000000000000000000"));
+        CHECK(BigInt(uint128Max) * 3 == 3 * BigInt(uint128Max));
+        CHECK(BigInt(uint128Max) * 3 ==
+                BigInt("1020847100762815390390123822295304634365"));
+        CHECK(big / 7 == BigInt("142857142857142857142857142857"));
+        CHECK(big % 7 == 1);
+        CHECK((0 - big) / -7 == big / 7);
+        CHECK((0 - big) % 7 == -1);
+        CHECK(100 / BigInt(-7) == -14);
+        CHECK(-100 % BigInt(7) == -2);
+        CHECK(7 / big == 0);
+        CHECK(7 % big == 7);
+        CHECK_THROWS(big / 0);
+        CHECK_THROWS(7 % BigInt());
+    }
+
+    SECTION("Adding a limb carries, borrows and changes sign")
+    {
+        BigInt allOnes = (BigInt(1) << 192) - 1;
+        CHECK(allOnes + 1 == BigInt(1) << 192);
+        CHECK((BigInt(1) << 192) - 1 == allOnes);
+        CHECK(1 - (BigInt(1) << 192) == 0 - allOnes);
+        CHECK((0 - allOnes) - 1 == 0 - (BigInt(1) << 192));
+
+        BigInt value(5);
+        value -= 8;
+        CHECK(value == -3);
+        value += UINT64_MAX;
+        CHECK(value == BigInt("18446744073709551612"));
+        value -= UINT64_MAX;
+        CHECK(value == -3);
+        value += 3;
+        CHECK(value == 0);
+        CHECK(value.isNonNegative());
+        value -= 0;
+        CHECK(value == 0);
+        value -= 4;
+        CHECK(value == -4);
+
+        BigInt twoLimbs = BigInt(1) << 64;
+        twoLimbs -= 1;
+        CHECK(twoLimbs == BigInt(UINT64_MAX));
+        twoLimbs -= UINT64_MAX;
+        CHECK(twoLimbs == 0);
+        CHECK(twoLimbs.isNonNegative());
+    }
+}
+
+TEST_CASE("Compound addition and subtraction tests")
+{
+    SECTION("+= matches +")
+    {
+        BigInt sum("18446744073709551615");
+        sum += BigInt("1");
+        CHECK(sum == BigInt("18446744073709551616"));
+
+        sum += BigInt("-18446744073709551617");
+        CHECK(sum == BigInt("-1"));
+
+        sum += BigInt("1");
+        CHECK(sum == BigInt("0"));
+        CHECK(sum.isNonNegative());
+    }
+
+    SECTION("-= matches -")
+    {
+        BigInt difference("100");
+        difference -= BigInt("1000");
+        CHECK(difference == BigInt("-900"));
+
+        difference -= BigInt("-18446744073709551616");
+        CHECK(difference == BigInt("18446744073709550716"));
+    }
+
+    SECTION("Operands may alias the destination")
+    {
+        BigInt doubled("9223372036854775808");
+        doubled += doubled;
+        CHECK(doubled == BigInt("18446744073709551616"));
+
+        doubled -= doubled;
+        CHECK(doubled == BigInt("0"));
+    }
+
+    SECTION("Accumulating many terms")
+    {
+        BigInt total;
+        BigInt term("1000000000000000000000");
+        for (int i = 0; i < 1000; i++)
+            total += term;
+        CHECK(total == BigInt("1000000000000000000000000"));
+
+        for (int i = 0; i < 1000; i++)
+            total -= term;
+        CHECK(total == BigInt("0"));
+    }
+}
+
+TEST_CASE("Move and compound assignment tests")
+{
+    BigInt twoTo1000 = BigInt(1) << 1000;
+    BigInt twoTo500 = BigInt(1) << 500;
+
+    SECTION("Multiplying, dividing and shifting in place")
+    {
+        BigInt value("-1000000000000000000000000000001");
+        value *= BigInt("1000000000000000000000");
+        CHECK(value == BigInt("-1000000000000000000000000000001"
+                    "000000000000000000000"));
+        value /= BigInt("-1000000000000000000000");
+        CHECK(value == BigInt("1000000000000000000000000000001"));
+        value %= BigInt("1000000000000");
+        CHECK(value == 1);
+
+        CHECK((BigInt(3) << 130) ==
+                BigInt("4083388403051261561560495289181218537472"));
+        CHECK((BigInt("4083388403051261561560495289181218537472") >> 129)
+                == 6);
+        CHECK((BigInt(7) >> 1) == 3);
+        CHECK((BigInt(-7) >> 1) == -4);
+        CHECK((BigInt(-8) >> 1) == -4);
+        CHECK((BigInt(-1) >> 1000) == -1);
+        CHECK((BigInt(0) - twoTo1000 >> 1000) == -1);
+        CHECK((BigInt(0) - twoTo1000 - 1 >> 1000) == -2);
+        CHECK((twoTo1000 >> 1001) == 0);
+    }
+
+    SECTION("swap exchanges values")
+    {
+        BigInt small(-5);
+        BigInt large = twoTo1000;
+        swap(small, large);
+        CHECK(small == twoTo1000);
+        CHECK(large == -5);
+
+        small.swap(large);
+        CHECK(small == -5);
+        CHECK(std::is_nothrow_move_constructible<BigInt>::value);
+    }
+
+    SECTION("Small values never allocate")
+    {
+        std::size_t before = allocations;
+        BigInt value(12345);
+        value += 1;
+        value -= 2;
+        value *= 3;
+        value /= 7;
+        value %= 1000;
+        value <<= 70;
+        value >>= 3;
+        value = value + value;
+        std::size_t made = allocations - before;
+
+        CHECK(made == 0);
+        CHECK(value == BigInt("85592892502012319498240"));
+    }
+
+    SECTION("Compound assignment reuses storage")
+    {
+        BigInt value = twoTo1000;
+        std::size_t before = allocations;
+        value += twoTo500;
+        value -= twoTo500;
+        value *= 3;
+        value /= 3;
+        value >>= 10;
+        value <<= 10;
+        value += 7;
+        value %= 1000003;
+        std::size_t made = allocations - before;
+
+        CHECK(made == 0);
+        CHECK(value == (twoTo1000 + 7) % 1000003);
+    }
+
+    SECTION("Multi-limb BigInt operands reuse storage")
+    {
+        BigInt large = (twoTo1000 << 5000) - 1;
+        BigInt divisor = (twoTo1000 << 2000) + 7;
+        BigInt factor = twoTo500 + 12345;
+        BigInt remainder = large % divisor;
+
+        // The destination starts out with room for every result, and the
+        // first pass fills the thread's scratch pool
+        BigInt value = large * divisor;
+        BigInt product, quotient, square;
+        std::size_t made = 0;
+        for (int pass = 0; pass < 3; pass++)
+        {
+            std::size_t before = allocations;
+            value = large;
+            value *= divisor;
+            product = value;
+            value /= divisor;
+            quotient = value;
+            value %= divisor;
+            value *= value;
+            square = value;
+            value /= factor;
+            value %= factor;
+            made = allocations - before;
+        }
+
+        CHECK(made == 0);
+        CHECK(product == large * divisor);
+        CHECK(quotient == large);
+        CHECK(square == remainder * remainder);
+        CHECK(value == square / factor % factor);
+    }
+
+    SECTION("Rvalue operands lend their storage")
+    {
+        BigInt value = twoTo1000;
+        std::size_t before = allocations;
+        BigInt result = std::move(value) + twoTo500;
+        result = std::move(result) - twoTo500;
+        result = 5 * std::move(result);
+        BigInt moved(std::move(result));
+        std::size_t made = allocations - before;
+
+        CHECK(made == 0);
+        CHECK(moved == twoTo1000 * 5);
+    }
+
+    SECTION("A sum of two values makes one allocation")
+    {
+        BigInt allOnes = twoTo1000 - 1;
+        std::size_t before = allocations;
+        BigInt sum = allOnes + allOnes;
+        std::size_t made = allocations - before;
+
+        CHECK(made == 1);
+        CHECK(sum == twoTo1000 * 2 - 2);
+    }
+}
+
+TEST_CASE("Lazy expression tests")
+{
+    using BigIntExpr::lazy;
+
+    BigInt big1("10000000000");
+    BigInt big2("30000000000");
+    BigInt twoTo300 = BigInt(1) << 300;
+    BigInt large = twoTo300 - 12345;
+
+    SECTION("Expressions match eager arithmetic")
+    {
+        BigInt eager = 1234 + big1 * 18 * big2 * 2;
+        BigInt fused = 1234 + lazy(big1) * 18 * big2 * 2;
+        CHECK(fused == eager);
+        CHECK(fused == BigInt("10800000000000000001234"));
+
+        BigInt value;
+        value = (lazy(large) + big1) * 7 - large * big2 + 5;
+        CHECK(value == (large + big1) * 7 - large * big2 + 5);
+
+        value = 3 - lazy(large) * -2;
+        CHECK(value == large * 2 + 3);
+
+        value = big1 - (lazy(large) - big2 * large);
+        CHECK(value == big1 - (large - big2 * large));
+
+        value = lazy(large) * 0 + -9;
+        CHECK(value == -9);
+    }
+
+    SECTION("The destination may appear in the expression")
+    {
+        BigInt acc = large;
+        acc = lazy(acc) * acc + acc;
+        CHECK(acc == large * large + large);
+
+        acc = large;
+        acc = 5 - lazy(acc) * 3;
+        CHECK(acc == 5 - large * 3);
+
+        acc = large;
+        acc += lazy(acc) * 2;
+        CHECK(acc == large * 3);
+
+        acc -= lazy(acc) * acc;
+        CHECK(acc == large * 3 - large * large * 9);
+    }
+
+    SECTION("Multiply-accumulate across signs")
+    {
+        BigInt acc = twoTo300;
+        acc -= lazy(large) * 1;
+        CHECK(acc == 12345);
+
+        acc -= lazy(big1) * 7;
+        CHECK(acc == BigInt("-69999987655"));
+
+        acc += lazy(twoTo300) * -3;
+        CHECK(acc == twoTo300 * -3 - BigInt("69999987655"));
+
+        acc = twoTo300 * twoTo300;
+        acc -= lazy(twoTo300 - 1) * 4;
+        CHECK(acc == twoTo300 * twoTo300 - (twoTo300 - 1) * 4);
+
+        acc = 0;
+        acc += lazy(large) * large;
+        acc -= lazy(large) * large;
+        CHECK(acc == 0);
+        CHECK(acc.isNonNegative());
+    }
+
+    SECTION("Carries reach the top of a long destination")
+    {
+        BigInt twoTo64 = BigInt(1) << 64;
+        std::vector<BigInt> destinations = {(BigInt(1) << 256) - 1,
+            (BigInt(1) << 128) - 1, (BigInt(1) << 640) - 1};
+        std::vector<std::pair<BigInt, BigInt>> factors = {
+            {twoTo64 + 1, twoTo64 + 3},
+            {(BigInt(1) << 128) - 1, (BigInt(1) << 128) - 1},
+            {twoTo300 - 1, twoTo64 * twoTo64 - 1}};
+
+        for (const BigInt& allOnes : destinations)
+        {
+            for (const std::pair<BigInt, BigInt>& pair : factors)
+            {
+                for (int signs = 0; signs < 8; signs++)
+                {
+                    BigInt d = signs & 1 ? 0 - allOnes : allOnes;
+                    BigInt a = signs & 2 ? 0 - pair.first : pair.first;
+                    BigInt b = signs & 4 ? 0 - pair.second : pair.second;
+
+                    BigInt sum = d;
+                    sum += lazy(a) * b;
+                    CHECK(sum == d + a * b);
+
+                    BigInt difference = d;
+                    difference -= lazy(a) * b;
+                    CHECK(difference == d - a * b);
+                }
+            }
+        }
+    }
+
+    SECTION("Polynomial evaluation stops allocating")
+    {
+        std::vector<BigInt> coefficients;
+        for (int i = 0; i < 8; i++)
+            coefficients.push_back(large * (i + 1) - i);
+
+        BigInt expected = 0;
+        for (const BigInt& coefficient : coefficients)
+            expected = expected * big1 + coefficient;
+
+        BigInt acc;
+        std::size_t made = 0;
+        for (int pass = 0; pass < 2; pass++)
+        {
+            std::size_t before = allocations;
+            acc = coefficients[0];
+            for (std::size_t i = 1; i < coefficients.size(); i++)
+                acc = lazy(acc) * big1 + coefficients[i];
+            made = allocations - before;
+            CHECK(acc == expected);
+        }
+
+        CHECK(made == 0);
+    }
+}
+
+namespace
+{
+    // Counts what passes through it on the way to operator new
+    class CountingResource : public BigIntMemoryResource
+    {
+        public:
+            CountingResource() : outstanding(0), total(0) {}
+
+            std::size_t outstanding;
+            std::size_t total;
+
+        protected:
+            void* doAllocate(std::size_t bytes) override
+            {
+                outstanding++;
+                total++;
+                return ::operator new(bytes);
+            }
+
+            void doDeallocate(void* memory, std::size_t) override
+            {
+                outstanding--;
+                ::operator delete(memory);
+            }
+    };
+}
+
+TEST_CASE("Memory resource tests")
+{
+    BigInt large = (BigInt(1) << 5000) / 3;
+    BigInt expected = large * large + large;
+
+    SECTION("BigInts use the resource current when they were made")
+    {
+        CountingResource counting;
+        CHECK(BigIntMemoryResource::getCurrent() ==
+                BigIntMemoryResource::getDefault());
+        {
+            BigIntMemoryScope scope(counting);
+            CHECK(BigIntMemoryResource::getCurrent() == &counting);
+
+            BigInt value = large * large + large;
+            CHECK(value == expected);
+            CHECK(counting.outstanding == 1);
+
+            BigInt copy = value;
+            CHECK(counting.outstanding == 2);
+        }
+        CHECK(BigIntMemoryResource::getCurrent() ==
+                BigIntMemoryResource::getDefault());
+        CHECK(counting.outstanding == 0);
+        CHECK(counting.total >= 2);
+    }
+
+    SECTION("Moved values free into their own resource")
+    {
+        CountingResource counting;
+        BigInt kept;
+        {
+            BigIntMemoryScope scope(counting);
+            BigInt value = large + 1;
+            kept = std::move(value);
+        }
+        CHECK(counting.outstanding == 1);
+        CHECK(kept == large + 1);
+
+        BigInt copied = kept;
+        CHECK(counting.outstanding == 1);
+        kept = BigInt();
+        CHECK(counting.outstanding == 0);
+        CHECK(copied == large + 1);
+    }
+
+    SECTION("An arena frees everything at once")
+    {
+        BigIntArena arena(4096);
+        BigInt result;
+        {
+            BigIntMemoryScope scope(arena);
+            BigInt value = large;
+            for (int i = 0; i < 10; i++)
+                value = value * 3 + i;
+            result = value;
+        }
+        CHECK(arena.bytesInUse() > 0);
+
+        // Expressions evaluated in the arena must not keep its memory
+        {
+            BigIntMemoryScope scope(arena);
+            BigInt value = large;
+            value = BigIntExpr::lazy(value) * value + value;
+            CHECK(value == expected);
+        }
+
+        BigInt kept(result);
+        result = BigInt();
+        arena.release();
+
+        BigInt value = large;
+        value = BigIntExpr::lazy(value) * value + value;
+        CHECK(value == expected);
+        CHECK(arena.bytesInUse() == 0);
+
+        BigInt check = large;
+        for (int i = 0; i < 10; i++)
+            check = check * 3 + i;
+        CHECK(kept == check);
+    }
+
+    SECTION("A pool stops reaching the global heap")
+    {
+        BigIntPool pool;
+        BigIntMemoryScope scope(pool);
+        BigInt other = large - 12345;
+
+        std::size_t made = 0;
+        for (int pass = 0; pass < 3; pass++)
+        {
+            std::size_t before = allocations;
+            BigInt product = large * other;
+            BigInt quotient = product / other;
+            CHECK(quotient == large);
+            made = allocations - before;
+        }
+        CHECK(made == 0);
+    }
+}
+
+TEST_CASE("Workspace tests")
+{
+    BigIntWorkspace workspace;
+
+    SECTION("Results match the operators")
+    {
+        for (std::size_t bits : {100, 5000, 100000})
+        {
+            BigInt a = (BigInt(1) << bits) / 7;
+            BigInt b = 0 - ((BigInt(1) << (bits / 2)) / 11 + 5);
+
+            BigInt product;
+            workspace.mul(product, a, b);
+            CHECK(product == a * b);
+
+            BigInt quotient;
+            BigInt remainder;
+            workspace.divmod(quotient, remainder, a, b);
+            CHECK(quotient == a / b);
+            CHECK(remainder == a % b);
+            workspace.divmod(quotient, remainder, b, a);
+            CHECK(quotient == 0);
+            CHECK(remainder == b);
+        }
+
+        BigInt modulus = (BigInt(1) << 2000) / 3;
+        BigInt power;
+        for (BigInt m : {modulus, modulus + 1})
+        {
+            workspace.powmod(power, BigInt(-12345), BigInt(65537), m);
+            CHECK(power == BigInt::powmod(BigInt(-12345), BigInt(65537), m));
+            workspace.powmod(power, m * 2 + 3, BigInt(0), m);
+            CHECK(power == 1);
+        }
+
+        CHECK_THROWS(workspace.divmod(power, power, modulus, power));
+        CHECK_THROWS(workspace.divmod(power, modulus, power, BigInt(0)));
+        CHECK_THROWS(workspace.powmod(power, modulus, BigInt(3), 0));
+        CHECK_THROWS(workspace.powmod(power, modulus, BigInt(3),
+                    BigInt(10), true));
+    }
+
+    SECTION("Results may be operands")
+    {
+        BigInt a = (BigInt(1) << 5000) / 7;
+        BigInt b = (BigInt(1) << 3000) / 11;
+        BigInt product = a * b;
+
+        BigInt value = a;
+        workspace.mul(value, value, b);
+        CHECK(value == product);
+        value = b;
+        workspace.mul(value, a, value);
+        CHECK(value == product);
+
+        BigInt quotient = product;
+        BigInt remainder = b;
+        workspace.divmod(quotient, remainder, quotient, remainder);
+        CHECK(quotient == a);
+        CHECK(remainder == 0);
+
+        BigInt modulus = b + 1;
+        value = a;
+        workspace.powmod(value, value, BigInt(3), modulus);
+        CHECK(value == BigInt::powmod(a, BigInt(3), modulus));
+    }
+
+    SECTION("Steady-state loops do not allocate")
+    {
+        BigInt a = (BigInt(1) << 100000) / 7;
+        BigInt b = (BigInt(1) << 60000) / 11;
+        BigInt modulus = (BigInt(1) << 1024) / 3;
+        BigInt product;
+        BigInt quotient;
+        BigInt remainder;
+        BigInt power;
+
+        workspace.reserveMul(1563, 938);
+        workspace.reserveDivmod(2500, 938);
+        workspace.reservePowmod(16, 16);
+        workspace.mul(product, a, b);
+        workspace.divmod(quotient, remainder, product, b);
+        workspace.powmod(power, a, modulus, modulus);
+        workspace.mul(power, power, power);
+
+        std::size_t before = allocations;
+        for (int pass = 0; pass < 3; pass++)
+        {
+            workspace.mul(product, a, b);
+            workspace.divmod(quotient, remainder, product, b);
+            workspace.powmod(power, a, modulus, modulus);
+            workspace.mul(power, power, power);
+        }
+        CHECK(allocations == before);
+        CHECK(quotient == a);
+        CHECK(remainder == 0);
+    }
+
+    SECTION("Scratch space can be queried in advance")
+    {
+        std::size_t mulBytes = BigIntWorkspace::mulScratchBytes(1563, 938);
+        std::size_t divmodBytes =
+            BigIntWorkspace::divmodScratchBytes(2500, 938);
+        std::size_t powmodBytes = BigIntWorkspace::powmodScratchBytes(16, 16);
+        CHECK(mulBytes > 0);
+        CHECK(divmodBytes > 0);
+        CHECK(powmodBytes > 0);
+        CHECK(BigIntWorkspace::mulScratchBytes(1, 1) == 0);
+
+        workspace.reserveMul(1563, 938);
+        CHECK(workspace.peakBytes() == mulBytes);
+
+        BigInt a = (BigInt(1) << 100000) / 7;
+        BigInt b = (BigInt(1) << 60000) / 11;
+        BigInt product;
+        workspace.mul(product, a, b);
+        CHECK(workspace.peakBytes() <= mulBytes);
+    }
+
+    SECTION("Each thread has its own workspace")
+    {
+        BigIntWorkspace& own = BigIntWorkspace::forThread();
+        CHECK(&own == &BigIntWorkspace::forThread());
+
+        BigInt value = BigInt(1) << 3000;
+        own.mul(value, value, value);
+        CHECK(value == BigInt(1) << 6000);
+    }
+}
+
+TEST_CASE("Decimal conversion tests")
+{
+    SECTION("Large values survive a round trip")
+    {
+        std::string digits;
+        for (int i = 0; i < 5000; i++)
+            digits.push_back('0' + (i * 7 + i / 13) % 10);
+        digits[0] = '4';
+
+        CHECK(static_cast<std::string>(BigInt(digits)) == digits);
+        CHECK(static_cast<std::string>(BigInt("-" + digits)) ==
+                "-" + digits);
+
+        std::ostringstream stream;
+        stream << BigInt("-" + digits);
+        CHECK(stream.str() == "-" + digits);
+    }
+
+    SECTION("Powers of ten and their neighbours")
+    {
+        std::string power = "1" + std::string(3000, '0');
+        std::string below(3000, '9');
+
+        CHECK(static_cast<std::string>(BigInt(power)) == power);
+        CHECK(static_cast<std::string>(BigInt(below)) == below);
+        CHECK(BigInt(power) - BigInt("1") == BigInt(below));
+        CHECK(static_cast<std::string>(BigInt("000" + below)) == below);
+    }
+
+    SECTION("Streams honour the field width")
+    {
+        std::ostringstream stream;
+        stream << std::setw(6) << BigInt("-42") << BigInt("0");
+        CHECK(stream.str() == "   -420");
+    }
+}
+
+TEST_CASE("Multiplication algorithm tests")
+{
+    BigInt::Thresholds defaults = BigInt::getThresholds();
+
+    // (10^n - 1)^2 = 99...9800...01, with n - 1 nines and n - 1 zeros
+    std::string nines(3000, '9');
+    std::string square = std::string(2999, '9') + "8" +
+        std::string(2999, '0') + "1";
+
+    BigInt a(nines);
+    BigInt b("-" + std::string(1500, '7') + std::string(1500, '3'));
+    BigInt c("123456789012345678901234567890");
+
+    BigInt::Thresholds schoolbook =
+        {1000000, 1000000, 1000000, 1000000, 1000000};
+    BigInt::setThresholds(schoolbook);
+    BigInt bCopy = b;
+    BigInt expectedBB = b * bCopy;
+    BigInt expectedAB = a * b;
+    BigInt expectedAC = a * c;
+    CHECK(a * a == BigInt(square));
+
+    SECTION("Karatsuba")
+    {
+        BigInt::Thresholds karatsuba =
+            {4, 1000000, 1000000, 1000000, 1000000};
+        BigInt::setThresholds(karatsuba);
+    }
+
+    SECTION("Toom-3")
+    {
+        BigInt::Thresholds toom3 = {4, 6, 1000000, 1000000, 1000000};
+        BigInt::setThresholds(toom3);
+    }
+
+    SECTION("Toom-4")
+    {
+        BigInt::Thresholds toom4 = {4, 6, 9, 1000000, 1000000};
+        BigInt::setThresholds(toom4);
+    }
+
+    SECTION("NTT")
+    {
+        BigInt::Thresholds ntt = {4, 6, 9, 1, 1000000};
+        BigInt::setThresholds(ntt);
+    }
+
+    SECTION("NTT below Toom-4")
+    {
+        BigInt::Thresholds ntt = {4, 6, 9, 7, 1000000};
+        BigInt::setThresholds(ntt);
+    }
+
+    CHECK(a * a == BigInt(square));
+    CHECK(b * b == expectedBB);
+    CHECK(a * b == expectedAB);
+    CHECK(b * a == expectedAB);
+    CHECK(a * c == expectedAC);
+    CHECK(c * a == expectedAC);
+
+    BigInt::setThresholds(defaults);
+}
+
+TEST_CASE("Limb kernel tests")
+{
+    std::string initial = BigInt::getKernels();
+    std::vector<std::string> available = BigInt::getAvailableKernels();
+    REQUIRE(!available.empty());
+    CHECK(std::find(available.begin(), available.end(), initial) !=
+            available.end());
+    CHECK(available.back() == "portable");
+    CHECK_THROWS(BigInt::setKernels("no such kernels"));
+    CHECK(BigInt::getKernels() == initial);
+
+    // Results on operands of every length up to a few vectors, with
+    // runs of full and empty limbs to carry through
+    auto compute = []()
+    {
+        std::vector<BigInt> results;
+        for (int limbs = 1; limbs <= 20; limbs++)
+        {
+            BigInt ones = (BigInt(1) << (64 * limbs)) - 1;
+            BigInt mixed = (BigInt(1) << (64 * limbs + 17)) / 3 + 12345;
+            BigInt small = (BigInt(1) << (32 * limbs)) / 7;
+
+            results.push_back(ones + mixed);
+            results.push_back(ones - mixed);
+            results.push_back(ones * mixed);
+            results.push_back(ones * ones);
+            results.push_back(mixed * 1000000007);
+            results.push_back(mixed / small);
+            results.push_back(ones % (small + 1));
+            results.push_back(mixed << 37);
+            results.push_back(mixed >> 37);
+            results.push_back(BigInt(ones < ones + 1 ? 1 : 0));
+            results.push_back(BigInt(mixed == mixed + 0 ? 1 : 0));
+        }
+        return results;
+    };
+
+    BigInt::setKernels("portable");
+    CHECK(BigInt::getKernels() == "portable");
+    std::vector<BigInt> expected = compute();
+
+    for (const std::string& name : available)
+    {
+        BigInt::setKernels(name);
+        CHECK(BigInt::getKernels() == name);
+        CHECK(compute() == expected);
+    }
+
+    BigInt::setKernels(initial);
+}
+
+TEST_CASE("Parallel multiplication tests")
+{
+    BigInt::Parallelism initial = BigInt::getParallelism();
+
+    BigInt::setParallelism({0, 4096});
+    CHECK(BigInt::getParallelism().threads >= 1);
+    CHECK(BigInt::getParallelism().threshold == 4096);
+
+    // Long enough for the transforms to be split, and lopsided enough for
+    // the shorter operand to set the length
+    auto compute = []()
+    {
+        BigInt ones = (BigInt(1) << (64 * 9000)) - 1;
+        BigInt mixed = (BigInt(1) << (64 * 9000 + 17)) / 3 + 12345;
+        BigInt longer = (BigInt(1) << (64 * 12000 + 5)) / 7 - 1;
+        BigInt shorter = (BigInt(1) << (64 * 1500)) / 11;
+
+        std::vector<BigInt> results;
+        results.push_back(ones * mixed);
+        results.push_back(mixed * mixed);
+        results.push_back(ones * ones);
+        results.push_back(longer * shorter);
+        results.push_back(shorter * (0 - mixed));
+        return results;
+    };
+
+    BigInt::setParallelism({1, 1});
+    std::vector<BigInt> expected = compute();
+    CHECK(expected[2] == (BigInt(1) << (64 * 18000)) -
+            (BigInt(1) << (64 * 9000 + 1)) + 1);
+
+    for (std::size_t threads : {2, 3, 4, 8})
+    {
+        BigInt::setParallelism({threads, 1});
+        CHECK(compute() == expected);
+    }
+
+    // Above the threshold nothing is split
+    BigInt::setParallelism({4, 1000000});
+    CHECK(compute() == expected);
+
+    BigInt::setParallelism(initial);
+}
+
+TEST_CASE("Product and sum tests")
+{
+    std::vector<BigInt> empty;
+    CHECK(BigInt::product(empty.begin(), empty.end()) == 1);
+    CHECK(BigInt::sum(empty.begin(), empty.end()) == 0);
+
+    int small[] = {7, -3, 5};
+    CHECK(BigInt::product(small, small + 1) == 7);
+    CHECK(BigInt::product(small, small + 3) == -105);
+    CHECK(BigInt::sum(small, small + 3) == 9);
+
+    // Values of mixed sizes and signs, with left folds to compare against
+    std::vector<BigInt> values;
+    BigInt folded = 1;
+    BigInt total = 0;
+    for (int i = 1; i <= 300; i++)
+    {
+        BigInt value = (BigInt(i) << (7 * i)) + i * 1000003;
+        if (i % 7 == 0)
+            value = 0 - value;
+        values.push_back(value);
+        folded *= value;
+        total += value;
+    }
+
+    CHECK(BigInt::product(values.begin(), values.end()) == folded);
+    CHECK(BigInt::sum(values.begin(), values.end()) == total);
+    CHECK(BigInt::product(values.begin(), values.begin() + 2) ==
+            values[0] * values[1]);
+
+    std::vector<int> factors;
+    for (int i = 1; i <= 25; i++)
+        factors.push_back(i);
+    CHECK(BigInt::product(factors.begin(), factors.end()) ==
+            BigInt("15511210043330985984000000"));
+
+    // The input is left alone, and splitting the tree across threads does
+    // not change the results
+    BigInt::Parallelism initial = BigInt::getParallelism();
+    BigInt::setParallelism({4, 1});
+    CHECK(BigInt::product(values.begin(), values.end()) == folded);
+    CHECK(BigInt::sum(values.begin(), values.end()) == total);
+    CHECK(values[6] == 0 - ((BigInt(7) << 49) + 7 * 1000003));
+    BigInt::setParallelism(initial);
+}
+
+TEST_CASE("Factorial, binomial and primorial tests")
+{
+    SECTION("Factorials")
+    {
+        CHECK(BigInt::factorial(0) == 1);
+        CHECK(BigInt::factorial(1) == 1);
+        CHECK(BigInt::factorial(2) == 2);
+        CHECK(BigInt::factorial(20) == BigInt(2432902008176640000ULL));
+        CHECK(BigInt::factorial(25) ==
+                BigInt("15511210043330985984000000"));
+
+        BigInt running = 1;
+        for (int n = 1; n <= 1500; n++)
+        {
+            running *= n;
+            if (n % 97 == 0 || n == 1500)
+                CHECK(BigInt::factorial(n) == running);
+        }
+
+        CHECK(BigInt::factorial(20000) / BigInt::factorial(19999) == 20000);
+        CHECK_THROWS(BigInt::factorial(1ULL << 32));
+    }
+
+    SECTION("Binomials")
+    {
+        CHECK(BigInt::binomial(0, 0) == 1);
+        CHECK(BigInt::binomial(5, 6) == 0);
+        CHECK(BigInt::binomial(100, 50) ==
+                BigInt("100891344545564193334812497256"));
+
+        // Pascal's rule covers both ways of computing them
+        std::vector<BigInt> row(1, BigInt(1));
+        for (std::uint64_t n = 1; n <= 200; n++)
+        {
+            std::vector<BigInt> next(n + 1, BigInt(1));
+            for (std::uint64_t k = 1; k < n; k++)
+                next[k] = row[k - 1] + row[k];
+            row = next;
+
+            if (n % 13 == 0 || n == 200)
+            {
+                for (std::uint64_t k = 0; k <= n; k++)
+                    CHECK(BigInt::binomial(n, k) == row[k]);
+            }
+        }
+
+        BigInt large = BigInt(1000000000000ULL);
+        CHECK(BigInt::binomial(1000000000000ULL, 3) ==
+                large * (large - 1) * (large - 2) / 6);
+        CHECK(BigInt::binomial(~0ULL, 1) == BigInt(~0ULL));
+        CHECK(BigInt::binomial(~0ULL, ~0ULL) == 1);
+        CHECK(BigInt::binomial(5000, 2500) == BigInt::factorial(5000) /
+                (BigInt::factorial(2500) * BigInt::factorial(2500)));
+    }
+
+    SECTION("Primorials")
+    {
+        CHECK(BigInt::primorial(0) == 1);
+        CHECK(BigInt::primorial(1) == 1);
+        CHECK(BigInt::primorial(2) == 2);
+        CHECK(BigInt::primorial(30) == 6469693230);
+        CHECK(BigInt::primorial(100) == BigInt("2305567963945518424753102"
+                    "147331756070"));
+        CHECK(BigInt::primorial(1000) % 997 == 0);
+        CHECK_FALSE(BigInt::primorial(1000) % (997 * 997) == 0);
+    }
+}
+
+TEST_CASE("GCD tests")
+{
+    SECTION("Small values")
+    {
+        CHECK(BigInt::gcd(0, 0) == 0);
+        CHECK(BigInt::gcd(0, -5) == 5);
+        CHECK(BigInt::gcd(12, 18) == 6);
+        CHECK(BigInt::gcd(-12, 18) == 6);
+        CHECK(BigInt::gcd(17, 5) == 1);
+        CHECK(BigInt::gcd(BigInt(1) << 100, BigInt(3) << 70) ==
+                BigInt(1) << 70);
+
+        CHECK(BigInt::lcm(4, 6) == 12);
+        CHECK(BigInt::lcm(-4, 6) == 12);
+        CHECK(BigInt::lcm(0, 6) == 0);
+
+        BigInt g, x, y;
+        std::tie(g, x, y) = BigInt::xgcd(240, 46);
+        CHECK(g == 2);
+        CHECK(x == -9);
+        CHECK(y == 47);
+        std::tie(g, x, y) = BigInt::xgcd(-7, 0);
+        CHECK(g == 7);
+        CHECK(x == -1);
+        CHECK(y == 0);
+        std::tie(g, x, y) = BigInt::xgcd(0, 0);
+        CHECK(g == 0);
+
+        CHECK(BigInt::modinv(3, 7) == 5);
+        CHECK(BigInt::modinv(-3, 7) == 2);
+        CHECK(BigInt::modinv(10, 1) == 0);
+        CHECK_THROWS(BigInt::modinv(2, 4));
+        CHECK_THROWS(BigInt::modinv(3, 0));
+        CHECK_THROWS(BigInt::modinv(3, -7));
+    }
+
+    SECTION("Large values")
+    {
+        // Consecutive Fibonacci numbers are coprime and take the most
+        // division steps for their size
+        BigInt previous = 1;
+        BigInt current = 0;
+        std::vector<BigInt> fibonacci;
+        for (int i = 1; i <= 40000; i++)
+        {
+            previous += current;
+            previous.swap(current);
+            if (i == 200 || i == 3000 || i == 39999 || i == 40000)
+                fibonacci.push_back(current);
+        }
+
+        BigInt factor = (BigInt(1) << 9000) - 1;
+        for (std::size_t i = 0; i < fibonacci.size(); i++)
+        {
+            const BigInt& a = fibonacci[i];
+            const BigInt& b = i + 1 < fibonacci.size() ?
+                fibonacci[i + 1] : fibonacci[0];
+            BigInt expected = BigInt::gcd(a, b);
+
+            BigInt g, x, y;
+            std::tie(g, x, y) = BigInt::xgcd(a * factor, b * factor);
+            CHECK(BigInt::gcd(a * factor, b * factor) == expected * factor);
+            CHECK(g == expected * factor);
+            CHECK(a * factor * x + b * factor * y == g);
+            CHECK(BigInt::abs(x) * 2 <= BigInt::abs(b) / expected);
+
+            BigInt reduced = b / expected;
+            BigInt inverse = BigInt::modinv(a / expected, reduced);
+            CHECK(a / expected * inverse % reduced ==
+                    (reduced == 1 ? 0 : 1));
+        }
+
+        CHECK(BigInt::gcd(fibonacci[2], fibonacci[3]) == 1);
+        CHECK(BigInt::gcd(fibonacci[0], fibonacci[3]) == fibonacci[0]);
+    }
+}
+
+TEST_CASE("Root and perfect power tests")
+{
+    SECTION("Small values")
+    {
+        CHECK(BigInt::isqrt(0) == 0);
+        CHECK(BigInt::isqrt(1) == 1);
+        CHECK(BigInt::isqrt(99) == 9);
+        CHECK(BigInt::isqrt(100) == 10);
+        CHECK_THROWS(BigInt::isqrt(-4));
+
+        CHECK(BigInt::iroot(26, 3) == 2);
+        CHECK(BigInt::iroot(27, 3) == 3);
+        CHECK(BigInt::iroot(-27, 3) == -3);
+        CHECK(BigInt::iroot(-26, 3) == -2);
+        CHECK(BigInt::iroot(1000, 1) == 1000);
+        CHECK(BigInt::iroot(1000, 10) == 1);
+        CHECK(BigInt::iroot(1023, 10) == 1);
+        CHECK(BigInt::iroot(1024, 10) == 2);
+        CHECK_THROWS(BigInt::iroot(10, 0));
+        CHECK_THROWS(BigInt::iroot(-16, 4));
+
+        CHECK(BigInt::isPerfectSquare(0));
+        CHECK(BigInt::isPerfectSquare(144));
+        CHECK_FALSE(BigInt::isPerfectSquare(145));
+        CHECK_FALSE(BigInt::isPerfectSquare(-144));
+
+        CHECK(BigInt::isPerfectPower(1));
+        CHECK(BigInt::isPerfectPower(-1));
+        CHECK(BigInt::isPerfectPower(32));
+        CHECK(BigInt::isPerfectPower(-243));
+        CHECK(BigInt::isPerfectPower(36));
+        CHECK_FALSE(BigInt::isPerfectPower(-36));
+        CHECK_FALSE(BigInt::isPerfectPower(2));
+        CHECK_FALSE(BigInt::isPerfectPower(72));
+    }
+
+    SECTION("Large values")
+    {
+        BigInt base("31415926535897932384626433832795028841971693993751");
+        for (unsigned int k = 2; k <= 40; k += 7)
+        {
+            BigInt power = base.expt(k);
+            CHECK(BigInt::iroot(power, k) == base);
+            CHECK(BigInt::iroot(power - 1, k) == base - 1);
+            CHECK(BigInt::iroot(power + 1, k) == base);
+            CHECK(BigInt::isPerfectPower(power));
+            CHECK_FALSE(BigInt::isPerfectPower(power + 1));
+        }
+
+        // Big enough to take several levels of Newton steps
+        BigInt large = (BigInt(1) << 50000) / 7 + 12345;
+        BigInt root = BigInt::isqrt(large);
+        CHECK(root * root <= large);
+        CHECK((root + 1) * (root + 1) > large);
+        CHECK(BigInt::isPerfectSquare(root * root));
+        CHECK_FALSE(BigInt::isPerfectSquare(root * root + 1));
+        CHECK_FALSE(BigInt::isPerfectSquare(root * (root + 1)));
+
+        root = BigInt::iroot(large, 5);
+        CHECK(root.expt(5) <= large);
+        CHECK((root + 1).expt(5) > large);
+        CHECK(BigInt::isPerfectPower(0 - root.expt(5)));
+        CHECK_FALSE(BigInt::isPerfectPower(root.expt(5) * 2));
+    }
+}
+
+TEST_CASE("Primality tests")
+{
+    SECTION("Small values")
+    {
+        CHECK_FALSE(BigInt::isProbablePrime(-7));
+        CHECK_FALSE(BigInt::isProbablePrime(0));
+        CHECK_FALSE(BigInt::isProbablePrime(1));
+        CHECK(BigInt::isProbablePrime(2));
+        CHECK(BigInt::isProbablePrime(1021));
+        CHECK_FALSE(BigInt::isProbablePrime(1023));
+        CHECK(BigInt::isProbablePrime(1048573));
+
+        // A Carmichael number, strong pseudoprimes to base 2 and strong
+        // Lucas pseudoprimes
+        for (long long composite : {561LL, 2047LL, 3215031751LL, 5459LL,
+                5777LL, 10877LL})
+            CHECK_FALSE(BigInt::isProbablePrime(composite));
+
+        CHECK(BigInt::nextPrime(-5) == 2);
+        CHECK(BigInt::nextPrime(2) == 3);
+        CHECK(BigInt::nextPrime(13) == 17);
+        CHECK(BigInt::nextPrime(1048572) == 1048573);
+    }
+
+    SECTION("Large values")
+    {
+        BigInt mersenne127 = (BigInt(1) << 127) - 1;
+        BigInt mersenne521 = (BigInt(1) << 521) - 1;
+        CHECK(BigInt::isProbablePrime(mersenne127));
+        CHECK(BigInt::isProbablePrime(mersenne521));
+        CHECK_FALSE(BigInt::isProbablePrime((BigInt(1) << 523) - 1));
+        CHECK_FALSE(BigInt::isProbablePrime(mersenne127 * mersenne127));
+        CHECK_FALSE(BigInt::isProbablePrime(mersenne127 * mersenne521));
+
+        CHECK(BigInt::nextPrime(BigInt(1) << 64) == (BigInt(1) << 64) + 13);
+        BigInt googol = BigInt(10).expt(100);
+        CHECK(BigInt::nextPrime(googol) == googol + 267);
+        CHECK(BigInt::nextPrime(mersenne521 - 2) == mersenne521);
+    }
+
+    SECTION("Batches")
+    {
+        std::vector<BigInt> candidates;
+        for (int i = 0; i < 40; i++)
+            candidates.push_back((BigInt(1) << 200) + i);
+
+        std::vector<bool> serial = BigInt::isProbablePrime(candidates);
+        BigInt::setParallelism({4, 1});
+        std::vector<bool> parallel = BigInt::isProbablePrime(candidates);
+        BigInt::setParallelism({1, 4096});
+
+        CHECK(serial == parallel);
+        for (std::size_t i = 0; i < candidates.size(); i++)
+            CHECK(serial[i] == BigInt::isProbablePrime(candidates[i]));
+        // 2^200 + 235 is the first prime above 2^200
+        CHECK(std::find(serial.begin(), serial.end(), true) ==
+                serial.end());
+    }
+}
+
+TEST_CASE("Bitwise tests")
+{
+    SECTION("Small values")
+    {
+        CHECK((BigInt(-6) & 3) == 2);
+        CHECK((BigInt(-6) | 3) == -5);
+        CHECK((BigInt(-6) ^ 3) == -7);
+        CHECK((BigInt(-6) & -3) == -8);
+        CHECK((BigInt(-6) | -3) == -1);
+        CHECK((BigInt(-6) ^ -3) == 7);
+        CHECK((12 & BigInt(10)) == 8);
+        CHECK(~BigInt(0) == -1);
+        CHECK(~BigInt(-1) == 0);
+        CHECK(~BigInt(41) == -42);
+
+        BigInt x = 0xF0;
+        x |= 0x0F;
+        CHECK(x == 0xFF);
+        x &= -16;
+        CHECK(x == 0xF0);
+        x ^= x;
+        CHECK(x == 0);
+
+        CHECK(BigInt(0).bitLength() == 0);
+        CHECK(BigInt(255).bitLength() == 8);
+        CHECK(BigInt(-256).bitLength() == 9);
+        CHECK(BigInt(-255).popcount() == 8);
+
+        CHECK(BigInt(-5).testBit(0));
+        CHECK(BigInt(-5).testBit(1));
+        CHECK_FALSE(BigInt(-5).testBit(2));
+        CHECK(BigInt(-5).testBit(3));
+        CHECK_FALSE(BigInt(5).testBit(1000));
+    }
+
+    SECTION("Large values")
+    {
+        BigInt power = BigInt(1) << 128;
+        CHECK(((0 - power) & ((BigInt(1) << 130) - 1)) == BigInt(3) << 128);
+        CHECK(((BigInt(-1) << 64) | 5) ==
+                BigInt("-18446744073709551611"));
+
+        BigInt a = (BigInt(-3) << 200) + 12345;
+        BigInt b = (BigInt(1) << 190) - 7;
+        CHECK((a & b) == 12345);
+        CHECK((a | b) == BigInt("-48192448573431241564349273296676858909625"
+                    "83392487262497275911"));
+        CHECK((a ^ b) == BigInt("-48192448573431241564349273296676858909625"
+                    "83392487262497288256"));
+
+        BigInt negative = 0 - (BigInt(1) << 70);
+        CHECK(negative.bitLength() == 71);
+        CHECK(((BigInt(1) << 100) - 1).popcount() == 100);
+        CHECK_FALSE(negative.testBit(69));
+        CHECK(negative.testBit(70));
+        CHECK(negative.testBit(1000));
+
+        // Identities that hold for every pair in two's complement
+        std::vector<BigInt> values = {a, b, 0 - b, power, 0 - power, 0, -1,
+            (BigInt(1) << 600) / 3, 0 - (BigInt(1) << 700) / 7};
+        for (const BigInt& x : values)
+        {
+            CHECK(~x == -1 - x);
+            CHECK((x & x) == x);
+            CHECK((x | ~x) == -1);
+            CHECK(((x >> 37) & 1) == (x.testBit(37) ? 1 : 0));
+            for (const BigInt& y : values)
+            {
+                CHECK(((x ^ y) & x) == (x & ~y));
+                CHECK((x & y) == ~(~x | ~y));
+                CHECK(x + y == (x ^ y) + 2 * (x & y));
+                CHECK((x | y) == (x ^ y) + (x & y));
+            }
+        }
+    }
+}
+
+TEST_CASE("Three-way comparison tests")
+{
+    BigInt big("123456789012345678901234567890123456789");
+    BigInt minusBig = 0 - big;
+    BigInt huge = big << 64;
+    BigInt minusHuge = 0 - huge;
+    std::vector<BigInt> values = {0, 1, -1, 2, -2,
+        BigInt("18446744073709551615"), BigInt("-18446744073709551615"),
+        BigInt("18446744073709551616"), BigInt("-18446744073709551616"),
+        big, minusBig, big + 1, minusBig - 1, huge, minusHuge};
+
+    SECTION("compare returns -1, 0 or 1")
+    {
+        CHECK(BigInt(3).compare(5) == -1);
+        CHECK(BigInt(5).compare(3) == 1);
+        CHECK(BigInt(5).compare(5) == 0);
+        CHECK(BigInt(-5).compare(3) == -1);
+        CHECK(BigInt(3).compare(-5) == 1);
+        CHECK(BigInt(-5).compare(-3) == -1);
+        CHECK(BigInt(0).compare(BigInt("-0")) == 0);
+        CHECK(big.compare(big + 1) == -1);
+        CHECK(minusBig.compare(minusBig - 1) == 1);
+        CHECK(huge.compare(big) == 1);
+        CHECK(minusHuge.compare(minusBig) == -1);
+    }
+
+    SECTION("The operators agree with compare")
+    {
+        for (const BigInt& a : values)
+        {
+            for (const BigInt& b : values)
+            {
+                int comparison = a.compare(b);
+                CHECK(comparison == -b.compare(a));
+                CHECK((a == b) == (comparison == 0));
+                CHECK((a != b) == (comparison != 0));
+                CHECK((a < b) == (comparison < 0));
+                CHECK((a > b) == (comparison > 0));
+                CHECK((a <= b) == (comparison <= 0));
+                CHECK((a >= b) == (comparison >= 0));
+                CHECK((comparison < 0) == (a - b < 0));
+            }
+        }
+    }
+
+    SECTION("Comparisons do not allocate")
+    {
+        std::size_t before = allocations;
+        int total = 0;
+        for (const BigInt& a : values)
+        {
+            for (const BigInt& b : values)
+                total += a.compare(b) + (a < b) + (a >= b) + (a != b);
+        }
+        CHECK(allocations == before);
+        CHECK(total != 0);
+    }
+
+    SECTION("Sorting")
+    {
+        std::vector<BigInt> sorted = values;
+        std::sort(sorted.begin(), sorted.end());
+        CHECK(std::is_sorted(sorted.begin(), sorted.end()));
+        CHECK(sorted.front() == minusHuge);
+        CHECK(sorted.back() == huge);
+        for (std::size_t i = 1; i < sorted.size(); i++)
+            CHECK(sorted[i - 1].compare(sorted[i]) < 0);
+    }
+
+#if defined(__cpp_impl_three_way_comparison) && \
+    __cpp_impl_three_way_comparison >= 201907L
+    SECTION("operator<=>")
+    {
+        CHECK((BigInt(-5) <=> BigInt(3)) == std::strong_ordering::less);
+        CHECK((big <=> big) == std::strong_ordering::equal);
+        CHECK((big + 1 <=> big) == std::strong_ordering::greater);
+    }
+#endif
+}
+
+TEST_CASE("Modulo and divmod tests")
+{
+    SECTION("Modulo by zero")
+    {
+        CHECK_THROWS(BigInt("100") % BigInt("0"));
+        CHECK_THROWS(BigInt::divmod(BigInt("100"), BigInt("0")));
+
+        BigInt value("100");
+        CHECK_THROWS(value %= BigInt("0"));
+    }
+
+    SECTION("Remainder takes the sign of the dividend")
+    {
+        CHECK(BigInt("13") % BigInt("4") == BigInt("1"));
+        CHECK(BigInt("-13") % BigInt("4") == BigInt("-1"));
+        CHECK(BigInt("13") % BigInt("-4") == BigInt("1"));
+        CHECK(BigInt("-13") % BigInt("-4") == BigInt("-1"));
+        CHECK(BigInt("12") % BigInt("-4") == BigInt("0"));
+        CHECK(BigInt("3") % BigInt("4") == BigInt("3"));
+    }
+
+    SECTION("divmod returns quotient and remainder")
+    {
+        std::pair<BigInt, BigInt> result =
+            BigInt::divmod(BigInt("-123456"), BigInt("284"));
+        CHECK(result.first == BigInt("-434"));
+        CHECK(result.second == BigInt("-200"));
+    }
+
+    SECTION("Multi-limb divisors")
+    {
+        BigInt a("26561398887587476933878132203577962682923345265339449597"
+                "4574961739092490901302182994384699044001");
+        BigInt b("508021860739623365322188197652216501772434524848346");
+
+        std::pair<BigInt, BigInt> result = BigInt::divmod(a, b);
+        CHECK(result.first ==
+                BigInt("522839683491514170494159221858129462316121929"));
+        CHECK(result.second == BigInt("8949671076769838828735545149856547"
+                    "7403275129064567"));
+        CHECK(result.first * b + result.second == a);
+
+        CHECK(a / b == result.first);
+        CHECK(a % b == result.second);
+    }
+
+    SECTION("Burnikel-Ziegler division")
+    {
+        BigInt::Thresholds defaults = BigInt::getThresholds();
+        BigInt::Thresholds schoolbook = defaults;
+        schoolbook.burnikelZiegler = 1000000;
+        BigInt::Thresholds recursive = defaults;
+        recursive.burnikelZiegler = 4;
+
+        // 2^1536 - 1: a divisor of all ones limbs makes every quotient
+        // estimate hit its largest value
+        BigInt ones("1");
+        for (int i = 0; i < 24; i++)
+            ones = ones * BigInt("18446744073709551616");
+        ones = ones - BigInt("1");
+
+        BigInt nines(std::string(2000, '9'));
+        BigInt sevens(std::string(650, '7') + "1");
+        BigInt mixed(std::string(400, '3') + std::string(417, '8'));
+
+        std::vector<std::pair<BigInt, BigInt>> operands = {
+            {ones * ones * ones + BigInt("12345"), ones},
+            {ones * ones - BigInt("1"), ones},
+            {nines, sevens},
+            {nines, BigInt("-1") * mixed},
+            {BigInt("-1") * nines * mixed, ones},
+        };
+
+        for (const std::pair<BigInt, BigInt>& pair : operands)
+        {
+            BigInt::setThresholds(schoolbook);
+            std::pair<BigInt, BigInt> expected =
+                BigInt::divmod(pair.first, pair.second);
+            BigInt::setThresholds(recursive);
+            std::pair<BigInt, BigInt> result =
+                BigInt::divmod(pair.first, pair.second);
+
+            CHECK(result.first == expected.first);
+            CHECK(result.second == expected.second);
+            CHECK(result.first * pair.second + result.second == pair.first);
+        }
+
+        BigInt::setThresholds(defaults);
+    }
+
+    SECTION("%= reuses the destination")
+    {
+        BigInt value("18446744073709551621");
+        value %= BigInt("18446744073709551616");
+        CHECK(value == BigInt("5"));
+
+        value %= value;
+        CHECK(value == BigInt("0"));
+    }
+}